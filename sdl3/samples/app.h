@@ -50,6 +50,13 @@ struct InteractiveCamera {
 	return proj;
     }
     
+    /**
+     * Pixels per world unit at distance 1 divided by tolerated error in pixels, for level of detail selection.
+     */
+    float lod_scale(float height, float pixels = 1.0f) {
+	return height / (2.0f * std::tan(glm::radians(fov) * 0.5f)) / pixels;
+    }
+    
     void update_mouse(int x, int y) {
         yaw += x * mouse_sensitivity;
         pitch = std::clamp(pitch - y * mouse_sensitivity, pitch_limit.x, pitch_limit.y);
@@ -87,6 +94,12 @@ struct App {
         float frametime;
         uint64_t triangles;
         uint64_t drawcalls;
+	uint64_t draws;
+	uint64_t visible;
+	uint64_t culled;
+	uint64_t barriers;
+	uint64_t barrier_calls;
+	uint64_t lod_triangles[4];
         float update_time;
         float draw_time;
     } stats;
@@ -94,26 +107,35 @@ struct App {
     bool running {true};
     bool resize {false};
 
-    vb::CommandPool frames_cmdpool {&vbc};
-    struct Frame {
-	VkCommandBuffer cmd;
-	VkSemaphore image_available;
-	VkSemaphore finish_render;
-	VkFence render;
-    };
-    std::vector<Frame> frames;
-    uint8_t frame_index;
+    // Set VB_FRAMES_IN_FLIGHT to trade latency for throughput.
+    uint32_t frames_in_flight {2};
+    vb::FrameRing frames {&vbc};
 
     vb::DescriptorPool imgui_descriptor_pool {&vbc};
 
     vb::QueueIndex* queue;
     vb::CommandPool cmdpool {&vbc};
     VkCommandBuffer global_cmd_buffer;
+    vb::QueueIndex* transfer_queue {nullptr};
+    vb::CommandPool transfer_cmdpool {&vbc};
+    vb::StagingRing staging_ring {&vbc};
+    vb::ThreadPool thread_pool;
+    vb::PipelineCache pipeline_cache {&vbc};
+    vb::PipelineRegistry pipeline_registry {&vbc};
+    vb::LayoutCache layout_cache {&vbc};
+    vb::ShaderCache shader_cache {&vbc};
+    // Frame's barriers are recorded through this, so its stats fill `stats.barriers`.
+    vb::Barriers barriers;
+    // Set by samples enabling `VK_KHR_maintenance5` before `create`, so pipelines get SPIR-V without `VkShaderModule`s.
+    bool maintenance5 {false};
 
     float aspect_ratio {0.0f};
     VkExtent2D render_extent;
     vb::Image render_target {&vbc};
     vb::Image depth_target {&vbc};
+    // Bumped whenever target images are recreated. Handles of destroyed views can be reused by new ones,
+    // so anything written with the old views compares this instead.
+    uint32_t target_generation {0};
 
     InteractiveCamera interactive_camera;
 
@@ -125,15 +147,30 @@ struct App {
 	height = window_info.height;
 	assert(vbc.init());
 	assert(vbc.create_instance_window(window_info));
+	// `barriers` records with vkCmdPipelineBarrier2.
+	device_info.vk13features.synchronization2 = VK_TRUE;
 	assert(vbc.create_device(device_info));
 	assert(vbc.create_surface_swapchain(swapchain_info));
 	assert(vbc.init_vma(allocator_flags));
+	staging_ring.create(64 * 1024 * 1024);
+	assert(staging_ring.all_valid());
+	vbc.set_staging_ring(&staging_ring);
+	vbc.set_layout_cache(&layout_cache);
+	thread_pool.create();
+	shader_cache.create(maintenance5);
+	// Set VB_NO_PIPELINE_CACHE to run without cache, tests/pipelines.cc benchmarks cold and warm caches.
+	if(!SDL_getenv("VB_NO_PIPELINE_CACHE")) {
+	    pipeline_cache.create("pipeline_cache.bin");
+	    assert(pipeline_cache.all_valid());
+	    vbc.set_pipeline_cache(&pipeline_cache);
+	}
 	queue = vbc.find_queue(vb::Queue::Graphics);
 	assert(queue);
 	cmdpool.create(queue->index);
 	assert(cmdpool.all_valid());
 	global_cmd_buffer = cmdpool.allocate();
 	assert(vbc.init_command_submitter(global_cmd_buffer, queue->queue, queue->index));
+	init_transfer();
 	init_frames();
 	init_imgui();
 	vbc.set_resize_callback([&]() {recreate_targets();});
@@ -143,31 +180,61 @@ struct App {
 
     ~App() {
 	destroy_target_images();
+	vb::log(std::format("Staging ring: {} allocations, {} bytes, {} stalls",
+		    staging_ring.stats.allocations.load(), staging_ring.stats.bytes.load(),
+		    staging_ring.stats.stalls.load()));
+	staging_ring.clean();
+	thread_pool.clean();
+	vb::log(std::format("Pipeline registry: {} shared, {} created",
+		    pipeline_registry.stats.hits, pipeline_registry.stats.misses));
+	pipeline_registry.clean();
+	vb::log(std::format("Layout cache: {} shared, {} created", layout_cache.stats.hits, layout_cache.stats.misses));
+	layout_cache.clean();
+	vb::log(std::format("Shader cache: {} shared, {} loaded, {} bytes mapped{}",
+		    shader_cache.stats.hits, shader_cache.stats.misses, shader_cache.stats.mapped_bytes,
+		    shader_cache.inline_modules ? ", inline modules" : ""));
+	shader_cache.clean();
+	if(pipeline_cache.all_valid()) {
+	    if(!pipeline_cache.save()) vb::log("Failed to save pipeline cache");
+	    vb::log(std::format("Pipeline cache: {} hits, {} misses, {:.2f}ms creating pipelines, loaded {} bytes, saved {} bytes",
+			pipeline_cache.stats.hits.load(), pipeline_cache.stats.misses.load(),
+			pipeline_cache.stats.creation_ns.load() / 1000000.0,
+			pipeline_cache.stats.loaded_bytes, pipeline_cache.stats.saved_bytes));
+	    pipeline_cache.clean();
+	}
 	cmdpool.clean();
+	transfer_cmdpool.clean();
 	ImGui_ImplVulkan_Shutdown();
 	imgui_descriptor_pool.clean();
-	for(auto& frame: frames) {
-	    vkDestroyFence(vbc.device, frame.render, nullptr);
-	    vkDestroySemaphore(vbc.device, frame.finish_render, nullptr);
-	    vkDestroySemaphore(vbc.device, frame.image_available, nullptr);
-	}
-	frames_cmdpool.clean();
+	frames.clean();
+    }
+
+    void init_transfer() {
+	// Set VB_FORCE_OWNERSHIP_TRANSFER to go through release/acquire path on single family devices.
+	vbc.force_ownership_transfer = SDL_getenv("VB_FORCE_OWNERSHIP_TRANSFER") != nullptr;
+	transfer_queue = vbc.find_queue(vb::Queue::Transfer);
+	if(!transfer_queue && vbc.force_ownership_transfer) transfer_queue = queue;
+	if(!transfer_queue) return;
+	transfer_cmdpool.create(transfer_queue->index);
+	assert(transfer_cmdpool.all_valid());
+	assert(vbc.init_transfer_submitter(transfer_cmdpool.allocate(),
+		    transfer_queue->queue, transfer_queue->index));
+	vb::log(std::format("Uploading on queue family {}, ownership transfer {}",
+		    transfer_queue->index, vbc.upload_ownership().enabled ? "enabled" : "disabled"));
     }
 
     void init_frames() {
-	frames_cmdpool.create(queue->index);
-	assert(frames_cmdpool.all_valid());
-	frames.resize(vbc.swapchain_image_views.size());
-	for(auto& frame: frames) {
-	    frame.cmd = frames_cmdpool.allocate();
-	    assert(frame.cmd);
-	    frame.finish_render = vb::create_semaphore(vbc.device);
-	    assert(frame.finish_render);
-	    frame.image_available = vb::create_semaphore(vbc.device);
-	    assert(frame.image_available);
-	    frame.render = vb::create_fence(vbc.device, VK_FENCE_CREATE_SIGNALED_BIT);
-	    assert(frame.render);
-	}
+	if(auto count = SDL_getenv("VB_FRAMES_IN_FLIGHT")) frames_in_flight = std::max(atoi(count), 1);
+	vb::DescriptorAllocator::Ratio transient[] = {
+	    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f},
+	};
+	frames.create(queue->index, frames_in_flight, transient);
+	assert(frames.all_valid());
+	vb::log(std::format("{} frames in flight for {} swapchain images",
+		    frames.size(), vbc.swapchain_images.size()));
     }
 
     void create_target_images() {
@@ -184,8 +251,9 @@ struct App {
 
 	depth_target.create({render_extent.width, render_extent.height, 1},
 		false, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_D32_SFLOAT,
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 	assert(depth_target.all_valid());
+	target_generation++;
     } 
 
     void destroy_target_images() { render_target.clean(); depth_target.clean(); }
@@ -196,19 +264,11 @@ struct App {
     }
 
     void init_imgui() {
+	// ImGui only allocates combined image samplers: one for font atlas and one per user texture.
 	VkDescriptorPoolSize pool_sizes[] = {
-    	    {VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
-    	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-    	    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-    	    {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000},
-    	    {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000},
-    	    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-    	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-    	    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000},
-    	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000},
-    	    {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000},
+    	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16},
     	};
-	imgui_descriptor_pool.create(pool_sizes, 1000,
+	imgui_descriptor_pool.create(pool_sizes, 16,
 		VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT);
 	ImGui::CreateContext();
     	assert(ImGui_ImplSDL3_InitForVulkan(vbc.window));
@@ -221,6 +281,7 @@ struct App {
     	    .MinImageCount = (uint32_t)vbc.swapchain_images.size(),
     	    .ImageCount = (uint32_t)vbc.swapchain_images.size(),
     	    .MSAASamples = VK_SAMPLE_COUNT_1_BIT,
+    	    .PipelineCache = vbc.pipeline_cache_handle(),
     	    .UseDynamicRendering = true,
     	    .PipelineRenderingCreateInfo = {
     	        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
@@ -232,10 +293,19 @@ struct App {
     	assert(ImGui_ImplVulkan_CreateFontsTexture());
     }
 
+    // Last users of swapchain image in `layout`. Swapchain image is acquired with semaphore waited at
+    // color attachment output stage, so undefined image only has to wait for that instead of all commands.
+    vb::Access swapchain_access(VkImageLayout layout) {
+	vb::Access access = {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE};
+	if(layout != VK_IMAGE_LAYOUT_UNDEFINED) access = vb::layout_access(layout);
+	access.stage |= VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	return access;
+    }
+
     VkImageLayout render_imgui(VkCommandBuffer cmd, 
 	    VkImageLayout input_layout, uint32_t index) {
-	vb::transition_image(cmd, vbc.swapchain_images[index],
-		input_layout, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	barriers.image(vbc.swapchain_images[index], input_layout, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		swapchain_access(input_layout)).record(cmd);
 	VkRenderingAttachmentInfo color_attach = {
 	    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
 	    .imageView = vbc.swapchain_image_views[index],
@@ -266,8 +336,15 @@ struct App {
 	ImGui::Text("fps:        %ld", stats.fps);
 	ImGui::Text("frame time: %.3f ms", stats.frametime);
 	ImGui::Text("draw time:  %.3f ms", stats.draw_time);
+	ImGui::Text("update time: %.3f ms", stats.update_time);
 	ImGui::Text("triangles:  %ld", stats.triangles);
 	ImGui::Text("draw calls: %ld", stats.drawcalls);
+	ImGui::Text("draws:      %ld", stats.draws);
+	ImGui::Text("visible:    %ld", stats.visible);
+	ImGui::Text("culled:     %ld", stats.culled);
+	ImGui::Text("barriers:   %ld in %ld calls", stats.barriers, stats.barrier_calls);
+	ImGui::Text("lod tris:   %ld / %ld / %ld / %ld", stats.lod_triangles[0], stats.lod_triangles[1],
+		stats.lod_triangles[2], stats.lod_triangles[3]);
 	ImGui::Separator();
 	// SCREENSHOT
 	static std::string screenshot_filename = "";
@@ -322,59 +399,31 @@ struct App {
 	    imgui_interface();
 	    ImGui::Render();
 
-	    auto frame = &frames[frame_index%frames.size()];
-	    assert(vkWaitForFences(vbc.device, 1, &frame->render, VK_TRUE, UINT64_MAX)
-		    == VK_SUCCESS);
-	    auto next = vbc.acquire_next_image(frame->image_available);
+	    auto next = frames.begin();
 	    if(!next.has_value()) continue;
 	    uint32_t index = next.value();
-	    vkResetFences(vbc.device, 1, &frame->render);
-	    vkResetCommandBuffer(frame->cmd, 0);
-	    VkCommandBufferBeginInfo begin = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	    };
-	    assert(vkBeginCommandBuffer(frame->cmd, &begin) == VK_SUCCESS);
+	    auto cmd = frames.current().cmd;
 
 	    auto layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	    stats.drawcalls = 0;
+	    stats.draws = 0;
+	    stats.visible = 0;
+	    stats.culled = 0;
 	    stats.triangles = 0;
+	    barriers.stats = {};
+	    for(auto& triangles: stats.lod_triangles) triangles = 0;
 	    auto draw_start = std::chrono::high_resolution_clock::now();
-	    layout = render(frame->cmd, layout, index);
+	    layout = render(cmd, layout, index);
     	    auto draw_end = std::chrono::high_resolution_clock::now();
 	    auto draw_elapsed = std::chrono::duration_cast<std::chrono::microseconds>
 		(draw_end - draw_start);
 	    stats.draw_time = draw_elapsed.count() / 1000.0f;
-	    layout = render_imgui(frame->cmd, layout, index);
-
-	    vb::transition_image(frame->cmd, vbc.swapchain_images[index],
-		    layout, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-	    assert(vkEndCommandBuffer(frame->cmd) == VK_SUCCESS);
-
-	    VkPipelineStageFlags mask[1] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-	    VkSubmitInfo submit = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &frame->image_available,
-		.pWaitDstStageMask = mask,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &frame->cmd,
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &frame->finish_render,
-	    };
-	    assert(vkQueueSubmit(queue->queue, 1, &submit, frame->render)
-		    == VK_SUCCESS);
-
-	    VkPresentInfoKHR present = {
-		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &frame->finish_render,
-		.swapchainCount = 1,
-		.pSwapchains = &vbc.swapchain,
-		.pImageIndices = &index,
-	    };
-	    vkQueuePresentKHR(queue->queue, &present);
-	    frame_index++;
+	    layout = render_imgui(cmd, layout, index);
+
+	    barriers.image(vbc.swapchain_images[index], layout, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR).record(cmd);
+	    stats.barriers = barriers.stats.barriers;
+	    stats.barrier_calls = barriers.stats.calls;
+	    assert(frames.end(queue->queue));
 
 	    auto end = std::chrono::high_resolution_clock::now();
 	    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
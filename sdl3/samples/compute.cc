@@ -47,36 +47,11 @@ struct Rectangle {
 		    | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
 	    assert(index_buffer.all_valid());
 
-	    auto staging_buffer = vb::Buffer{context};
-    	    staging_buffer.create(vertices_size + indices_size,
-		    VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-	    assert(staging_buffer.all_valid());
-    	    memcpy(staging_buffer.info.pMappedData, vertices.data(), vertices_size);
-    	    memcpy((char*)(staging_buffer.info.pMappedData)+vertices_size, indices.data(),
-		    indices_size);
-	    context->submit_command_to_queue([&](VkCommandBuffer cmd) {
-    	        VkBufferCopy copy = { .size = vertices_size };
-    	        vkCmdCopyBuffer(cmd, staging_buffer.buffer, vertex_buffer.buffer, 1, &copy);
-    	        VkBufferCopy copy2 = { .srcOffset = vertices_size, .size = indices_size };
-    	        vkCmdCopyBuffer(cmd, staging_buffer.buffer, index_buffer.buffer, 1, &copy2);
-    	    });
-    	    staging_buffer.clean();
+	    assert(vertex_buffer.upload(vertices.data(), vertices_size));
+	    assert(index_buffer.upload(indices.data(), indices_size));
     }
 };
 
-inline VkDeviceSize aligned_size(VkDeviceSize value, VkDeviceSize alignment) {
-    return (value+alignment-1)&~(alignment-1);
-}
-
-struct DescriptorBuffer {
-    VkDescriptorSetLayout layout;
-    vb::Buffer buffer;
-    VkDeviceAddress address;
-    VkDescriptorBufferBindingInfoEXT binding_info;
-    uint32_t buffer_index;
-    size_t binding_offset;
-};
-
 struct ComputeDescriptorBuffers: public App {
     vb::CommandPool cmdpool {&vbc};
     vb::Image texture {&vbc};
@@ -85,10 +60,15 @@ struct ComputeDescriptorBuffers: public App {
     VkSampler sampler;
     Rectangle* rectangle;
     Rectangle* rectangle2;
-    VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptor_buffer_prop
-	{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT};
-    DescriptorBuffer graphics_descriptor{.buffer=&vbc};
-    DescriptorBuffer compute_descriptor{.buffer=&vbc};
+    vb::DescriptorHeap descriptor_heap {&vbc};
+    VkDescriptorSetLayout graphics_set_layout;
+    VkDescriptorSetLayout compute_set_layout;
+    vb::DescriptorHeap::Set graphics_set;
+    vb::DescriptorHeap::Set compute_set;
+    // `comp_image` is recreated on resize, possibly with the same view handle as the destroyed one,
+    // so every version of compute set remembers generation of the image it was written with.
+    uint32_t comp_generation {0};
+    std::vector<uint32_t> compute_generations;
     vb::GraphicsPipeline graphics_pipeline {&vbc};
     VkPipelineLayout compute_layout;
     VkPipeline compute_pipeline;
@@ -110,6 +90,7 @@ struct ComputeDescriptorBuffers: public App {
     	    .vk10features = {.samplerAnisotropy = VK_TRUE},
     	    .vk12features = {
     	        .descriptorIndexing = VK_TRUE,
+    	        .timelineSemaphore = VK_TRUE,
     	        .bufferDeviceAddress = VK_TRUE,
     	    },
     	    .vk13features = {
@@ -136,18 +117,18 @@ struct ComputeDescriptorBuffers: public App {
 		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
     	    comp_image.create({vbc.swapchain_extent.width, vbc.swapchain_extent.height, 1},
     	        VK_FORMAT_R16G16B16A16_SFLOAT);
+	    comp_generation++;
     	});
     }
 
     ~ComputeDescriptorBuffers() {
 	graphics_pipeline.clean();
 	graphics_pipeline.clean_shaders();
-	vkDestroyDescriptorSetLayout(vbc.device, graphics_descriptor.layout, nullptr);
-    	graphics_descriptor.buffer.clean();
+	vkDestroyDescriptorSetLayout(vbc.device, graphics_set_layout, nullptr);
     	vkDestroyPipeline(vbc.device, compute_pipeline, nullptr);
     	vkDestroyPipelineLayout(vbc.device, compute_layout, nullptr);
-    	vkDestroyDescriptorSetLayout(vbc.device, compute_descriptor.layout, nullptr);
-    	compute_descriptor.buffer.clean();
+    	vkDestroyDescriptorSetLayout(vbc.device, compute_set_layout, nullptr);
+    	descriptor_heap.clean();
 	rectangle->vertex_buffer.clean();
     	rectangle->index_buffer.clean();
     	rectangle2->vertex_buffer.clean();
@@ -234,52 +215,7 @@ struct ComputeDescriptorBuffers: public App {
     	    .pBindings = &binding,
     	};
     	assert(vkCreateDescriptorSetLayout(vbc.device, &layout_info, nullptr,
-		    &graphics_descriptor.layout) == VK_SUCCESS);
-    	VkPhysicalDeviceProperties2 properties = {
-    	    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
-    	    &descriptor_buffer_prop,
-    	};
-    	vkGetPhysicalDeviceProperties2(vbc.physical_device, &properties);
-    	size_t layout_size = 0;
-    	vkGetDescriptorSetLayoutSizeEXT(vbc.device, graphics_descriptor.layout, &layout_size);
-    	layout_size = aligned_size(layout_size, descriptor_buffer_prop.descriptorBufferOffsetAlignment);
-    	size_t binding_offset = 0;
-    	vkGetDescriptorSetLayoutBindingOffsetEXT(vbc.device, graphics_descriptor.layout,
-		0, &binding_offset);
-    	graphics_descriptor.buffer.create(texture.extent.depth*texture.extent.width
-		*texture.extent.height*4*layout_size,
-    	        VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT
-		| VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT 
-		| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    	assert(graphics_descriptor.buffer.all_valid());
-    	char* buffer_data = (char*)graphics_descriptor.buffer.info.pMappedData;
-    	VkDescriptorImageInfo image_info {
-    	    .sampler = sampler,
-    	    .imageView = texture.image_view,
-    	    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-    	};
-    	VkDescriptorGetInfoEXT image_desc_info {
-    	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
-    	    .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-    	    .data {
-    	        .pCombinedImageSampler = &image_info,
-    	    },
-    	};
-    	vkGetDescriptorEXT(vbc.device, &image_desc_info,
-		descriptor_buffer_prop.combinedImageSamplerDescriptorSize,
-		buffer_data+0 * layout_size + binding_offset);
-    	VkBufferDeviceAddressInfo addr_info {
-    	    .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-    	    .buffer = graphics_descriptor.buffer.buffer,
-    	};
-    	graphics_descriptor.address = vkGetBufferDeviceAddress(vbc.device, &addr_info);
-    	graphics_descriptor.binding_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
-    	graphics_descriptor.binding_info.address = graphics_descriptor.address;
-    	graphics_descriptor.binding_info.usage = VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT
-	    | VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
-    	graphics_descriptor.buffer_index = 0;
-	graphics_descriptor.binding_offset = binding_offset;
-
+		    &graphics_set_layout) == VK_SUCCESS);
 	VkDescriptorSetLayoutBinding compute_binding {
     	    .binding = 0,
     	    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
@@ -293,40 +229,25 @@ struct ComputeDescriptorBuffers: public App {
     	    .pBindings = &compute_binding,
     	};
     	assert(vkCreateDescriptorSetLayout(vbc.device, &compute_layout_info,
-		    nullptr, &compute_descriptor.layout) == VK_SUCCESS);
-    	size_t compute_dlayout_size = 0;
-    	vkGetDescriptorSetLayoutSizeEXT(vbc.device, compute_descriptor.layout, &compute_dlayout_size);
-    	compute_dlayout_size = aligned_size(compute_dlayout_size, descriptor_buffer_prop.descriptorBufferOffsetAlignment);
-    	size_t cbinding_offset = 0;
-    	vkGetDescriptorSetLayoutBindingOffsetEXT(vbc.device, compute_descriptor.layout,
-		0, &cbinding_offset);
-    	compute_descriptor.buffer.create(vbc.swapchain_extent.width*vbc.swapchain_extent.height
-		*4*compute_dlayout_size, VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT
-		| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    	assert(compute_descriptor.buffer.all_valid());
-    	char* cbuffer_data = (char*)compute_descriptor.buffer.info.pMappedData;
-    	VkDescriptorImageInfo cimage_info {
-    	    .imageView = comp_image.image_view,
-    	    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
-    	};
-    	VkDescriptorGetInfoEXT cimage_desc_info {
-    	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
-    	    .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-    	    .data {
-    	        .pStorageImage = &cimage_info,
-    	    },
-    	};
-    	vkGetDescriptorEXT(vbc.device, &cimage_desc_info, descriptor_buffer_prop.storageImageDescriptorSize, cbuffer_data);
-    	VkBufferDeviceAddressInfo caddr_info {
-    	    .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-    	    .buffer = compute_descriptor.buffer.buffer,
-    	};
-    	compute_descriptor.address = vkGetBufferDeviceAddress(vbc.device, &caddr_info);
-    	compute_descriptor.binding_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
-    	compute_descriptor.binding_info.address = compute_descriptor.address;
-    	compute_descriptor.binding_info.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
-	compute_descriptor.buffer_index = 0;
-	compute_descriptor.binding_offset = cbinding_offset;
+		    nullptr, &compute_set_layout) == VK_SUCCESS);
+
+	// Compute set gets one version per frame in flight, so it's rewritten without waiting for the GPU.
+	const uint32_t versions = frames.size();
+	descriptor_heap.create(descriptor_heap.set_size(graphics_set_layout)
+		+ descriptor_heap.set_size(compute_set_layout) * versions);
+	assert(descriptor_heap.all_valid());
+	auto graphics = descriptor_heap.allocate(graphics_set_layout);
+	assert(graphics.has_value());
+	graphics_set = graphics.value();
+	auto compute = descriptor_heap.allocate(compute_set_layout, versions);
+	assert(compute.has_value());
+	compute_set = compute.value();
+	descriptor_heap.write_image(graphics_set, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, {
+		.sampler = sampler,
+		.imageView = texture.image_view,
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    });
+	compute_generations.resize(versions, UINT32_MAX);
     }
 
     void create_pipelines() {
@@ -335,7 +256,7 @@ struct ComputeDescriptorBuffers: public App {
     	graphics_pipeline.add_shader("../samples/shaders/full_vert.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
     	graphics_pipeline.add_shader("../samples/shaders/textured.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
     	graphics_pipeline.add_push_constant(sizeof(PushConstants), VK_SHADER_STAGE_VERTEX_BIT);
-    	graphics_pipeline.add_descriptor_set_layout(graphics_descriptor.layout);
+    	graphics_pipeline.add_descriptor_set_layout(graphics_set_layout);
     	VkFormat color_format[1] = {vbc.swapchain_format};
     	VkPipelineRenderingCreateInfo rendering_info {
     	    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
@@ -349,7 +270,7 @@ struct ComputeDescriptorBuffers: public App {
 	VkPipelineLayoutCreateInfo compute_layout_inf {
     	    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
     	    .setLayoutCount = 1,
-    	    .pSetLayouts = &compute_descriptor.layout, 
+    	    .pSetLayouts = &compute_set_layout,
     	};
     	vkCreatePipelineLayout(vbc.device, &compute_layout_inf, nullptr, &compute_layout);
     	auto comp_shader = vb::create_shader_module(vbc.device, "../samples/shaders/grad.comp.spv");
@@ -366,7 +287,7 @@ struct ComputeDescriptorBuffers: public App {
     	    .stage = stage,
     	    .layout = compute_layout,
     	};
-    	assert(vkCreateComputePipelines(vbc.device, 0, 1, &compute_info, nullptr, &compute_pipeline) == VK_SUCCESS);
+    	assert(vkCreateComputePipelines(vbc.device, vbc.pipeline_cache_handle(), 1, &compute_info, nullptr, &compute_pipeline) == VK_SUCCESS);
     	vkDestroyShaderModule(vbc.device, comp_shader, nullptr);
     }
 
@@ -376,10 +297,18 @@ struct ComputeDescriptorBuffers: public App {
 	    {.depthStencil = {1.0f, 0}},
 	};
 	vb::transition_image(cmd, comp_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	const uint32_t version = frames.index();
+	if(compute_generations[version] != comp_generation) {
+	    descriptor_heap.write_image(compute_set, version, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, {
+		    .imageView = comp_image.image_view,
+		    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+		});
+	    compute_generations[version] = comp_generation;
+	}
 	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline);
-	vkCmdBindDescriptorBuffersEXT(cmd, 1, &compute_descriptor.binding_info);
-	vkCmdSetDescriptorBufferOffsetsEXT(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
-		compute_layout, 0, 1, &compute_descriptor.buffer_index, &compute_descriptor.binding_offset);
+	descriptor_heap.bind(cmd);
+	descriptor_heap.bind_set(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, compute_layout, 0,
+		compute_set, version);
 	vkCmdDispatch(cmd, ceil(vbc.swapchain_extent.width/16.0),
 		ceil(vbc.swapchain_extent.height/16.0), 1);
 	vb::transition_image(cmd, comp_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
@@ -419,9 +348,8 @@ struct ComputeDescriptorBuffers: public App {
 	VkRect2D scissor {{0,0}, vbc.swapchain_extent};
 	vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-	vkCmdBindDescriptorBuffersEXT(cmd, 1, &graphics_descriptor.binding_info);
-	vkCmdSetDescriptorBufferOffsetsEXT(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-		graphics_pipeline.layout, 0, 1, &graphics_descriptor.buffer_index, &graphics_descriptor.binding_offset);
+	descriptor_heap.bind_set(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline.layout, 0,
+		graphics_set);
 	glm::mat4 view = glm::lookAt(glm::vec3(2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 	glm::mat4 proj = glm::perspective(glm::radians(45.0f),
 		(float)vbc.swapchain_extent.width/(float)vbc.swapchain_extent.height, 0.1f, 100.0f);
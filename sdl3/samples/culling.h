@@ -0,0 +1,419 @@
+#pragma once
+#include <vb.h>
+#include "gltf_pbr.h"
+
+/**
+ * GPU culling of `GLTF` draws.
+ *
+ * Compute pass tests every draw's bounding sphere against camera frustum and, with occlusion enabled,
+ * against depth pyramid built from previous frame's depth. Surviving draws are compacted per material batch
+ * into `commands`, with their number in `counts`, for `vkCmdDrawIndexedIndirectCount`.
+ */
+struct Culling {
+    vb::Context* ctx;
+    static constexpr uint32_t max_hiz_levels = 16;
+    static constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    // `counts` starts with visible, frustum culled, occluded, triangle and per level of detail triangle counters,
+    // followed by one count per batch.
+    static constexpr VkDeviceSize header_size = (4 + GLTF::max_lods) * sizeof(uint32_t);
+
+    vb::DescriptorPool cull_pool;
+    VkDescriptorSetLayout cull_set_layout;
+    VkDescriptorSet cull_set;
+    VkPipelineLayout cull_layout;
+    VkPipeline cull_pipeline;
+
+    vb::DescriptorPool hiz_pool;
+    VkDescriptorSetLayout hiz_set_layout;
+    std::vector<VkDescriptorSet> hiz_sets;
+    VkPipelineLayout hiz_layout;
+    VkPipeline hiz_pipeline;
+    vb::Image hiz;
+    std::vector<VkImageView> hiz_views;
+    VkImageView depth_view {VK_NULL_HANDLE};
+    // `App::target_generation` of the depth image the pyramid was created for.
+    uint32_t depth_generation {UINT32_MAX};
+    VkSampler sampler;
+    bool hiz_general {false};
+    bool hiz_ready {false};
+
+    vb::Buffer batches;
+    vb::Buffer commands;
+    vb::Buffer counts;
+    std::vector<vb::Buffer> readbacks;
+
+    uint32_t draw_count {0};
+    bool occlusion {true};
+    glm::mat4 view_projection {1.0f};
+    glm::mat4 previous_view_projection {1.0f};
+
+    struct PushConstants {
+	glm::mat4 previous_view_projection;
+	uint32_t draw_count;
+	uint32_t occlusion;
+	uint32_t hiz_levels;
+	float lod_scale;
+    };
+
+    struct {
+	uint32_t visible = 0;
+	uint32_t frustum_culled = 0;
+	uint32_t occluded = 0;
+	uint32_t triangles = 0;
+	uint32_t lod_triangles[GLTF::max_lods] = {};
+    } stats;
+    static_assert(sizeof(stats) == header_size);
+
+    Culling(vb::Context* context): ctx{context}, cull_pool{context}, hiz_pool{context}, hiz{context},
+	batches{context}, commands{context}, counts{context} {}
+
+    /**
+     * @param mesh Loaded `GLTF` with draws.
+     * @param view Uniform buffer with `View` that the scene is rendered with.
+     * @param frames Number of frames in flight, each gets its own stats readback.
+     */
+    void create(GLTF& mesh, vb::Buffer& view, vb::ShaderCache& shaders, uint32_t frames) {
+	draw_count = mesh.draw_count;
+	std::vector<uint32_t> firsts;
+	for(auto& batch: mesh.draw_batches) firsts.push_back(batch.first_command);
+	batches.create(firsts.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	assert(batches.all_valid());
+	assert(batches.upload(firsts.data(), firsts.size() * sizeof(uint32_t)));
+	commands.create(draw_count * stride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	assert(commands.all_valid());
+	counts.create(header_size + firsts.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	assert(counts.all_valid());
+	for(uint32_t i = 0; i < frames; i++) {
+	    vb::Buffer readback {ctx};
+	    readback.create(header_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+	    assert(readback.all_valid());
+	    memset(readback.info.pMappedData, 0, header_size);
+	    readbacks.push_back(readback);
+	}
+
+	VkSamplerCreateInfo sampler_info = {
+	    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+	    .magFilter = VK_FILTER_NEAREST,
+	    .minFilter = VK_FILTER_NEAREST,
+	    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+	    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+	    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+	    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+	    .maxLod = VK_LOD_CLAMP_NONE,
+	};
+	assert(vkCreateSampler(ctx->device, &sampler_info, nullptr, &sampler) == VK_SUCCESS);
+
+	VkDescriptorPoolSize cull_sizes[3] = {
+	    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4},
+	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+	};
+	cull_pool.create(cull_sizes, 1);
+	assert(cull_pool.all_valid());
+	cull_pool.add_binding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0);
+	for(uint32_t i = 1; i <= 4; i++)
+	    cull_pool.add_binding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i);
+	cull_pool.add_binding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 5);
+	cull_set_layout = cull_pool.create_layout();
+	assert(cull_set_layout);
+	cull_set = cull_pool.create_set(cull_set_layout);
+	assert(cull_set);
+
+	VkDescriptorPoolSize hiz_sizes[2] = {
+	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, max_hiz_levels},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, max_hiz_levels},
+	};
+	hiz_pool.create(hiz_sizes, max_hiz_levels);
+	assert(hiz_pool.all_valid());
+	hiz_pool.add_binding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0);
+	hiz_pool.add_binding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1);
+	hiz_set_layout = hiz_pool.create_layout();
+	assert(hiz_set_layout);
+
+	create_pipeline(shaders, "../samples/shaders/cull.comp.spv", cull_set_layout,
+		sizeof(PushConstants), cull_layout, cull_pipeline);
+	create_pipeline(shaders, "../samples/shaders/hiz.comp.spv", hiz_set_layout, 0,
+		hiz_layout, hiz_pipeline);
+
+	VkDescriptorBufferInfo infos[5] = {
+	    {view.buffer, 0, VK_WHOLE_SIZE},
+	    {mesh.draws.buffer, 0, VK_WHOLE_SIZE},
+	    {batches.buffer, 0, VK_WHOLE_SIZE},
+	    {commands.buffer, 0, VK_WHOLE_SIZE},
+	    {counts.buffer, 0, VK_WHOLE_SIZE},
+	};
+	VkWriteDescriptorSet writes[5];
+	for(uint32_t i = 0; i < 5; i++) {
+	    writes[i] = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = cull_set,
+		.dstBinding = i,
+		.descriptorCount = 1,
+		.descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = &infos[i],
+	    };
+	}
+	vkUpdateDescriptorSets(ctx->device, 5, writes, 0, nullptr);
+    }
+
+    void create_pipeline(vb::ShaderCache& shaders, const char* path, VkDescriptorSetLayout set_layout,
+	    uint32_t push_constants_size, VkPipelineLayout& layout, VkPipeline& pipeline) {
+	VkPushConstantRange push_constant = {
+	    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	    .size = push_constants_size,
+	};
+	VkPipelineLayoutCreateInfo layout_info = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+	    .setLayoutCount = 1,
+	    .pSetLayouts = &set_layout,
+	    .pushConstantRangeCount = push_constants_size ? 1u : 0u,
+	    .pPushConstantRanges = &push_constant,
+	};
+	assert(vkCreatePipelineLayout(ctx->device, &layout_info, nullptr, &layout) == VK_SUCCESS);
+	auto shader = shaders.load(path);
+	assert(shader);
+	VkComputePipelineCreateInfo pipeline_info = {
+	    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+	    .stage = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+		.pName = "main",
+	    },
+	    .layout = layout,
+	};
+	vb::ShaderCache::set_stage(pipeline_info.stage, shader);
+	assert(vkCreateComputePipelines(ctx->device, ctx->pipeline_cache_handle(), 1, &pipeline_info,
+		    nullptr, &pipeline) == VK_SUCCESS);
+    }
+
+    /**
+     * Recreates depth pyramid for `depth`. Waits for device to be idle.
+     *
+     * @param generation Generation of `depth`, compared with `depth_generation` to tell when it's recreated.
+     */
+    void resize(vb::Image& depth, uint32_t generation) {
+	vkDeviceWaitIdle(ctx->device);
+	clean_hiz();
+	depth_view = depth.image_view;
+	depth_generation = generation;
+	hiz.create({depth.extent.width, depth.extent.height, 1}, true, VK_SAMPLE_COUNT_1_BIT,
+		VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	assert(hiz.all_valid());
+	assert(hiz.mip_level <= max_hiz_levels);
+	for(uint32_t i = 0; i < hiz.mip_level; i++) {
+	    VkImageViewCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = hiz.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = VK_FORMAT_R32_SFLOAT,
+		.subresourceRange = {
+		    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		    .baseMipLevel = i,
+		    .levelCount = 1,
+		    .layerCount = 1,
+		},
+	    };
+	    VkImageView view;
+	    assert(vkCreateImageView(ctx->device, &info, nullptr, &view) == VK_SUCCESS);
+	    hiz_views.push_back(view);
+	}
+	// Level 0 copies depth, every other level reduces the one before it.
+	for(uint32_t i = 0; i < hiz.mip_level; i++) {
+	    auto set = hiz_pool.create_set(hiz_set_layout);
+	    assert(set);
+	    hiz_sets.push_back(set);
+	    VkDescriptorImageInfo source = {
+		.sampler = sampler,
+		.imageView = i == 0 ? depth_view : hiz_views[i - 1],
+		.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL,
+	    };
+	    VkDescriptorImageInfo destination = {
+		.imageView = hiz_views[i],
+		.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+	    };
+	    VkWriteDescriptorSet writes[2] = {
+		{
+		    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		    .dstSet = set,
+		    .dstBinding = 0,
+		    .descriptorCount = 1,
+		    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		    .pImageInfo = &source,
+		},
+		{
+		    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		    .dstSet = set,
+		    .dstBinding = 1,
+		    .descriptorCount = 1,
+		    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		    .pImageInfo = &destination,
+		},
+	    };
+	    vkUpdateDescriptorSets(ctx->device, 2, writes, 0, nullptr);
+	}
+	VkDescriptorImageInfo hiz_info = {
+	    .sampler = sampler,
+	    .imageView = hiz.image_view,
+	    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+	};
+	VkWriteDescriptorSet write = {
+	    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+	    .dstSet = cull_set,
+	    .dstBinding = 5,
+	    .descriptorCount = 1,
+	    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+	    .pImageInfo = &hiz_info,
+	};
+	vkUpdateDescriptorSets(ctx->device, 1, &write, 0, nullptr);
+    }
+
+    /**
+     * Records culling dispatch, leaving `commands` and `counts` ready for indirect draws.
+     *
+     * @param frame Index of frame in flight whose fence was waited on, `stats` are read from its previous recording.
+     * @param view_projection Camera matrix the scene is rendered with this frame, used for occlusion in the next.
+     * @param lod_scale Selects level of detail of every draw, see `GLTF::Primitive::select_lod`.
+     */
+    void record_cull(VkCommandBuffer cmd, vb::Barriers& barriers, uint32_t frame, const glm::mat4& view_projection,
+	    float lod_scale) {
+	auto& readback = readbacks[frame];
+	vmaInvalidateAllocation(ctx->allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+	memcpy(&stats, readback.info.pMappedData, sizeof(stats));
+	this->view_projection = view_projection;
+	// Pyramid was just created, nothing used it yet.
+	if(!hiz_general) {
+	    barriers.image(hiz.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		    {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE});
+	    hiz_general = true;
+	}
+
+	// Last frame's culling, indirect draws and copy to readback have to be done before buffers are reset.
+	// Its pyramid is made visible by the barrier after the last level in `record_hiz`.
+	barriers.buffer(counts.buffer,
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+		    | VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT},
+		{VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT});
+	barriers.buffer(commands.buffer,
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+		    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT},
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT});
+	barriers.record(cmd);
+	vkCmdFillBuffer(cmd, counts.buffer, 0, VK_WHOLE_SIZE, 0);
+	barriers.buffer(counts.buffer, {VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT},
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		    VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT});
+	barriers.record(cmd);
+
+	PushConstants constants = {
+	    .previous_view_projection = previous_view_projection,
+	    .draw_count = draw_count,
+	    .occlusion = occlusion && hiz_ready,
+	    .hiz_levels = hiz.mip_level,
+	    .lod_scale = lod_scale,
+	};
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_layout, 0, 1, &cull_set,
+		0, nullptr);
+	vkCmdPushConstants(cmd, cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+		&constants);
+	vkCmdDispatch(cmd, (draw_count + 63) / 64, 1, 1);
+
+	barriers.buffer(commands.buffer, {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT},
+		{VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT});
+	barriers.buffer(counts.buffer, {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT},
+		{VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
+		    VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT});
+	barriers.record(cmd);
+	VkBufferCopy copy = {.size = header_size};
+	vkCmdCopyBuffer(cmd, counts.buffer, readback.buffer, 1, &copy);
+	barriers.buffer(readback.buffer, {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT},
+		{VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT}, 0, header_size);
+	barriers.record(cmd);
+    }
+
+    /**
+     * Records indirect draws of culled `mesh`, one per material batch.
+     *
+     * @return Number of recorded draw calls.
+     */
+    uint32_t record_draws(VkCommandBuffer cmd, GLTF& mesh, uint32_t max_draw_count,
+	    std::function<void(uint32_t material)> bind_material) {
+	for(uint32_t i = 0; i < mesh.draw_batches.size(); i++) {
+	    auto& batch = mesh.draw_batches[i];
+	    bind_material(batch.material);
+	    vkCmdDrawIndexedIndirectCount(cmd, commands.buffer, (VkDeviceSize)batch.first_command * stride,
+		    counts.buffer, header_size + i * sizeof(uint32_t), std::min(batch.count, max_draw_count),
+		    stride);
+	}
+	return mesh.draw_batches.size();
+    }
+
+    /**
+     * Records depth pyramid build from `depth` after the scene was rendered to it, for occlusion in the next frame.
+     *
+     * `depth` has to be in `VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL` and is left in `VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL`.
+     */
+    void record_hiz(VkCommandBuffer cmd, vb::Barriers& barriers, vb::Image& depth) {
+	if(!occlusion) return;
+	// Depth is written in both early and late fragment tests. Culling of this frame has to be done reading
+	// the pyramid before it's overwritten.
+	barriers.image(depth.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		{VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT},
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT},
+		{.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .levelCount = 1, .layerCount = 1});
+	barriers.image(hiz.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE},
+		{VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT},
+		{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = hiz.mip_level, .layerCount = 1});
+	barriers.record(cmd);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hiz_pipeline);
+	for(uint32_t i = 0; i < hiz.mip_level; i++) {
+	    uint32_t width = std::max(hiz.extent.width >> i, 1u);
+	    uint32_t height = std::max(hiz.extent.height >> i, 1u);
+	    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hiz_layout, 0, 1,
+		    &hiz_sets[i], 0, nullptr);
+	    vkCmdDispatch(cmd, (width + 7) / 8, (height + 7) / 8, 1);
+	    // Level is sampled by the next one and, after the last, by culling of the next frame.
+	    barriers.image(hiz.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		    {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT},
+		    {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT},
+		    {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = i, .levelCount = 1, .layerCount = 1});
+	    barriers.record(cmd);
+	}
+	previous_view_projection = view_projection;
+	hiz_ready = true;
+    }
+
+    void clean_hiz() {
+	for(auto& view: hiz_views) vkDestroyImageView(ctx->device, view, nullptr);
+	hiz_views.clear();
+	if(hiz.all_valid()) hiz.clean();
+	if(!hiz_sets.empty()) vkResetDescriptorPool(ctx->device, hiz_pool.pool, 0);
+	hiz_sets.clear();
+	hiz_general = false;
+	hiz_ready = false;
+    }
+
+    void clean() {
+	clean_hiz();
+	vkDestroyPipeline(ctx->device, cull_pipeline, nullptr);
+	vkDestroyPipelineLayout(ctx->device, cull_layout, nullptr);
+	vkDestroyPipeline(ctx->device, hiz_pipeline, nullptr);
+	vkDestroyPipelineLayout(ctx->device, hiz_layout, nullptr);
+	cull_pool.clean_layout(cull_set_layout);
+	cull_pool.clean();
+	hiz_pool.clean_layout(hiz_set_layout);
+	hiz_pool.clean();
+	vkDestroySampler(ctx->device, sampler, nullptr);
+	batches.clean();
+	commands.clean();
+	counts.clean();
+	for(auto& readback: readbacks) readback.clean();
+    }
+};
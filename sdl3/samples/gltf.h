@@ -6,7 +6,6 @@
 #include <variant>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
-#include <stb/stb_image.h>
 #include <format>
 #include <fastgltf/core.hpp>
 #include <fastgltf/glm_element_traits.hpp>
@@ -16,7 +15,9 @@
 #include <fastgltf/types.hpp>
 #include <fastgltf/tools.hpp>
 #include <vb.h>
+#include "gltf_images.h"
 #include <filesystem>
+#include <chrono>
 
 struct GLTF {
     vb::Context* ctx;
@@ -128,9 +129,11 @@ struct GLTF {
     GLTF(vb::Context* context): ctx{context}, descriptor{context},
         vertices{context}, indices{context} {}
 
-    void load(const std::filesystem::path& path) {
+    void load(const std::filesystem::path& path, vb::ThreadPool& pool) {
         vb::log(std::format("Loading {}...", path.string()));
-        fastgltf::Parser parser {fastgltf::Extensions::KHR_lights_punctual};
+	auto parse_start = std::chrono::high_resolution_clock::now();
+        fastgltf::Parser parser {fastgltf::Extensions::KHR_lights_punctual
+	    | fastgltf::Extensions::KHR_texture_basisu};
         auto data = fastgltf::GltfDataBuffer::FromPath(path);
         assert(data.error() == fastgltf::Error::None);
         auto options = fastgltf::Options::LoadExternalBuffers
@@ -139,10 +142,42 @@ struct GLTF {
         auto parent_path = path.parent_path();
         auto asset = parser.loadGltf(data.get(), parent_path, options);
         assert(asset.error() == fastgltf::Error::None);
-
-	load_images(asset.get(), parent_path);
-	load_textures(asset.get());
+	auto decode_start = std::chrono::high_resolution_clock::now();
+	auto decoded = GLTFImages::decode(asset.get(), parent_path, pool);
+	auto decode_end = std::chrono::high_resolution_clock::now();
+
+	vb::UploadQueue uploads {ctx};
+	auto transfer = ctx->transfer_submitter.value_or(*ctx->command_submitter);
+	uploads.create(transfer.index, transfer.queue);
+	assert(uploads.all_valid());
+	assert(uploads.set_owner(ctx->command_submitter->index, ctx->command_submitter->queue));
+	// Compute and blit mip chains are compared by tests/mipmaps.cc.
+	vb::MipGenerator mip_generator {ctx};
+	mip_generator.create("../samples/shaders/spd.comp.spv", asset->images.size());
+	auto upload_start = std::chrono::high_resolution_clock::now();
+	GLTFImages::load(ctx, images, decoded, uploads, mip_generator.all_valid() ? &mip_generator : nullptr);
+	GLTFImages::load_textures(ctx, asset.get(), images, textures, default_image_index, uploads);
 	load_materials(asset.get());
+	assert(uploads.finish());
+	// Mip chains are recorded as a separate batch to time them apart from copies.
+	auto mips_start = std::chrono::high_resolution_clock::now();
+	for(size_t i = 0; i < decoded.size(); i++) if(decoded[i].ktx2.empty())
+	    uploads.record_acquire([&](VkCommandBuffer cmd) { images[i].image.generate_mipmaps(cmd); });
+	assert(uploads.finish());
+	auto mips_end = std::chrono::high_resolution_clock::now();
+	auto ms = [](auto start, auto end) {
+	    return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	};
+	vb::log(std::format("Uploaded {} images with {} jobs in {} submits",
+		    images.size(), uploads.stats.jobs, uploads.stats.submits));
+	vb::log(std::format("Parse {}ms, decode {}ms on {} threads, upload {}ms, mips {}ms",
+		    ms(parse_start, decode_start), ms(decode_start, decode_end), pool.size(),
+		    ms(upload_start, mips_start), ms(mips_start, mips_end)));
+	vb::log(std::format("Mip chains: {} compute dispatches, {} blit fallbacks",
+		    mip_generator.stats.dispatches, mip_generator.stats.fallbacks));
+	uploads.clean();
+	for(auto& image: images) image.image.set_mip_generator(nullptr);
+	mip_generator.clean();
 	load_nodes(asset.get());
 
         vb::log(std::format("Camera {}", first_camera.has_value() ? "found" : "not found"));
@@ -165,46 +200,8 @@ struct GLTF {
         for(auto& image: images) image.image.clean();
     }
     
-    void load_textures(const fastgltf::Asset& asset) {
-	textures.resize(asset.textures.size());
-        for(size_t i = 0; i < asset.textures.size(); i++)
-	    textures[i] = asset.textures[i].imageIndex.value();
-    }
-
-    void load_images(const fastgltf::Asset& asset, const std::filesystem::path& parent_path) {
-	images.resize(asset.images.size(), {ctx, VK_NULL_HANDLE});
-	for(size_t i = 0; i < asset.images.size(); i++) {
-	    int w, h, c;
-	    const auto& data = asset.images[i].data;
-	    if(const auto& uri = std::get_if<fastgltf::sources::URI>(&data); uri) {
-    		auto path = std::format("{}/{}", parent_path.c_str(), uri->uri.c_str());
-		vb::log(std::format("Loading {}...", path.c_str()));
-    		assert(uri->fileByteOffset == 0);
-    		assert(uri->uri.isLocalPath());
-    		images[i].image.create(path.c_str(), true);
-    		assert(images[i].image.all_valid());
-    	    } else if(const auto& vector = std::get_if<fastgltf::sources::Vector>(&data); vector) {
-    		auto data = stbi_load_from_memory((stbi_uc*)vector->bytes.data(),
-		    (int)vector->bytes.size(), &w, &h, &c, 4);
-		assert(data);
-    		VkExtent3D size = {(uint32_t)w, (uint32_t)h, 1};
-    		images[i].image.create(data, size, true);
-    		assert(images[i].image.all_valid());
-    		stbi_image_free(data);
-    	    } else if(const auto& view = std::get_if<fastgltf::sources::BufferView>(&data); view) {
-		auto& bfview = asset.bufferViews[view->bufferViewIndex];
-		auto& bf = asset.buffers[bfview.bufferIndex];
-		const auto& v = std::get_if<fastgltf::sources::Array>(&bf.data);
-		auto data = stbi_load_from_memory((stbi_uc*)v->bytes.data() + bfview.byteOffset,
-	    	    bfview.byteLength, &w, &h, &c, 4);
-		assert(data);
-    		VkExtent3D size = {(uint32_t)w, (uint32_t)h, 1};
-    		images[i].image.create(data, size, true);
-    		assert(images[i].image.all_valid());
-    		stbi_image_free(data);
-	    }
-	}
-    }
+    // Index of 1x1 default image, created the first time a texture has no usable source.
+    std::optional<uint32_t> default_image_index;
 
     void load_materials(const fastgltf::Asset& asset) {
 	materials.resize(asset.materials.size());
@@ -324,24 +321,9 @@ struct GLTF {
         this->indices.create(indices_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT
         	| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
         assert(this->indices.all_valid());
-        vb::Buffer staging_buffer {ctx};
-        staging_buffer.create(vertices_size + indices_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        	VMA_MEMORY_USAGE_CPU_ONLY);
-        assert(staging_buffer.all_valid());
-        char* buf_data = (char*)staging_buffer.info.pMappedData;
-        memcpy(buf_data, vertex_vec.data(), vertices_size);
-        memcpy(buf_data + vertices_size, index_vec.data(), indices_size);
         vb::log("Copying data to buffers...");
-        ctx->submit_command_to_queue([&](VkCommandBuffer cmd) {
-            VkBufferCopy copy = { .size = vertices_size };
-            vkCmdCopyBuffer(cmd, staging_buffer.buffer, this->vertices.buffer, 1, &copy);
-            VkBufferCopy copy2 = {
-        	.srcOffset = vertices_size,
-        	.size = indices_size,
-            };
-            vkCmdCopyBuffer(cmd, staging_buffer.buffer, this->indices.buffer, 1, &copy2);
-        });
-        staging_buffer.clean();
+        assert(this->vertices.upload(vertex_vec.data(), vertices_size));
+        assert(this->indices.upload(index_vec.data(), indices_size));
     }
 
     void setup_descriptors() {
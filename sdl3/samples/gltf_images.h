@@ -0,0 +1,139 @@
+#pragma once
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <variant>
+#include <vector>
+#include <stb/stb_image.h>
+#include <fastgltf/core.hpp>
+#include <fastgltf/types.hpp>
+#include <vb.h>
+
+/**
+ * Decoding and upload of glTF images and textures shared by `GLTF` of gltf.h and gltf_pbr.h.
+ *
+ * Images go into sample's own image structs, which need `vb::Image image` as their first member.
+ * Images that can't be read, decoded or created are replaced by 1x1 `default_texel`.
+ */
+struct GLTFImages {
+    struct Decoded {
+	stbi_uc* data = nullptr;
+	int width = 0;
+	int height = 0;
+	std::vector<char> ktx2;
+	// Set when the image couldn't be read or decoded, it's replaced by `default_texel`.
+	bool failed = false;
+    };
+
+    // Opaque white, neutral for every texture multiplying its material factor.
+    static constexpr uint32_t default_texel = 0xffffffff;
+
+    /**
+     * Reads and decodes every image of `asset` on `pool`, KTX2 files are only read.
+     */
+    static std::vector<Decoded> decode(const fastgltf::Asset& asset,
+	    const std::filesystem::path& parent_path, vb::ThreadPool& pool) {
+	// Every image writes only its own slot, so order doesn't depend on which thread finished first.
+	std::vector<Decoded> decoded(asset.images.size());
+	pool.run(asset.images.size(), [&](uint32_t i, uint32_t) {
+	    int c;
+	    auto& out = decoded[i];
+	    const auto& data = asset.images[i].data;
+	    if(const auto& uri = std::get_if<fastgltf::sources::URI>(&data); uri) {
+    		auto path = std::format("{}/{}", parent_path.c_str(), uri->uri.c_str());
+		vb::log(std::format("Loading {}...", path.c_str()));
+    		assert(uri->fileByteOffset == 0);
+    		assert(uri->uri.isLocalPath());
+		if(uri->mimeType == fastgltf::MimeType::KTX2 || path.ends_with(".ktx2")) {
+		    vb::MappedFile file {path.c_str()};
+		    out.ktx2.assign(file.data, file.data + file.size);
+		} else out.data = stbi_load(path.c_str(), &out.width, &out.height, &c, 4);
+    	    } else if(const auto& vector = std::get_if<fastgltf::sources::Vector>(&data); vector) {
+		auto bytes = (const char*)vector->bytes.data();
+		if(vector->mimeType == fastgltf::MimeType::KTX2)
+		    out.ktx2.assign(bytes, bytes + vector->bytes.size());
+    		else out.data = stbi_load_from_memory((stbi_uc*)bytes,
+		    (int)vector->bytes.size(), &out.width, &out.height, &c, 4);
+    	    } else if(const auto& view = std::get_if<fastgltf::sources::BufferView>(&data); view) {
+		auto& bfview = asset.bufferViews[view->bufferViewIndex];
+		auto& bf = asset.buffers[bfview.bufferIndex];
+		const auto& v = std::get_if<fastgltf::sources::Array>(&bf.data);
+		auto bytes = (const char*)v->bytes.data() + bfview.byteOffset;
+		if(view->mimeType == fastgltf::MimeType::KTX2)
+		    out.ktx2.assign(bytes, bytes + bfview.byteLength);
+		else out.data = stbi_load_from_memory((stbi_uc*)bytes,
+	    	    bfview.byteLength, &out.width, &out.height, &c, 4);
+	    }
+	    if(out.data || !out.ktx2.empty()) return;
+	    // Worker only reports it, main thread uploads the replacement with the rest.
+	    out.failed = true;
+	    vb::log(std::format("Failed to decode image {} ({}), using default texture", i, stbi_failure_reason()));
+	});
+	return decoded;
+    }
+
+    /**
+     * Records uploads of `decoded` into `images`, one per glTF image. Mip chains of decoded images are left
+     * for `vb::Image::generate_mipmaps`, KTX2 images keep their own. Decoded pixels are freed.
+     */
+    template<typename Image>
+    static void load(vb::Context* ctx, std::vector<Image>& images, std::vector<Decoded>& decoded,
+	    vb::UploadQueue& uploads, vb::MipGenerator* mip_generator) {
+	images.resize(decoded.size(), Image{vb::Image{ctx}});
+	for(size_t i = 0; i < decoded.size(); i++) {
+	    images[i].image.set_mip_generator(mip_generator);
+	    images[i].image.set_defer_mipmaps(true);
+	    // KTX2 files bring their own mip chain in the stored, possibly block compressed, format.
+	    if(!decoded[i].ktx2.empty()) {
+		images[i].image.create_ktx2(uploads, decoded[i].ktx2.data(), decoded[i].ktx2.size());
+		if(images[i].image.all_valid()) continue;
+		// Basis Universal payloads and formats device can't sample are rejected with a log message.
+		images[i].image.clean();
+		decoded[i].ktx2.clear();
+		decoded[i].failed = true;
+	    }
+	    if(decoded[i].failed) {
+		auto texel = default_texel;
+		images[i].image.create(uploads, &texel, {1, 1, 1}, true);
+		assert(images[i].image.all_valid());
+		continue;
+	    }
+	    VkExtent3D size = {(uint32_t)decoded[i].width, (uint32_t)decoded[i].height, 1};
+	    images[i].image.create(uploads, decoded[i].data, size, true);
+	    assert(images[i].image.all_valid());
+	    stbi_image_free(decoded[i].data);
+	    decoded[i].data = nullptr;
+	}
+    }
+
+    /**
+     * Maps every texture of `asset` to index of its image in `textures`.
+     *
+     * @param default_image Index of 1x1 `default_texel` image appended to `images` the first time a texture
+     * has no usable source, kept by caller so it's created only once.
+     */
+    template<typename Image>
+    static void load_textures(vb::Context* ctx, const fastgltf::Asset& asset, std::vector<Image>& images,
+	    std::vector<uint32_t>& textures, std::optional<uint32_t>& default_image, vb::UploadQueue& uploads) {
+	textures.resize(asset.textures.size());
+        for(size_t i = 0; i < asset.textures.size(); i++) {
+	    // With KHR_texture_basisu `imageIndex` is optional fallback to KTX2 source. It's preferred when present,
+	    // because Basis Universal payloads can't be transcoded here and are rejected by `create_ktx2`.
+	    auto& texture = asset.textures[i];
+	    auto image = texture.imageIndex.has_value() ? texture.imageIndex : texture.basisuImageIndex;
+	    if(image.has_value()) {
+		textures[i] = image.value();
+		continue;
+	    }
+	    vb::log(std::format("Texture {} has no supported image source", i));
+	    if(!default_image.has_value()) {
+		auto texel = default_texel;
+		images.push_back(Image{vb::Image{ctx}});
+		images.back().image.create(uploads, &texel, {1, 1, 1});
+		assert(images.back().image.all_valid());
+		default_image = images.size() - 1;
+	    }
+	    textures[i] = default_image.value();
+	}
+    }
+};
@@ -4,10 +4,14 @@
 #include <glm/glm.hpp>
 #include <vb.h>
 #include "gltf_pbr.h"
+#include "culling.h"
+#include "meshlets.h"
 #include "app.h"
 
 struct PushConstants {
     glm::mat4 model;
+    glm::vec4 position_offset;
+    glm::vec4 position_scale;
 };
 
 struct View {
@@ -22,6 +26,41 @@ struct Lights {
 
 struct GltfTextures : public App {
     vb::GraphicsPipeline gfx_pipeline {&vbc};
+    vb::GraphicsPipeline indirect_pipeline {&vbc};
+    // Set VB_DIRECT_DRAWS to record one draw per primitive with per node push constants instead.
+    bool indirect {!SDL_getenv("VB_DIRECT_DRAWS")};
+    // Direct draws of primitive ranges are recorded into secondary command buffers on thread pool workers.
+    // Set VB_SERIAL_RECORDING to record them into the frame's primary command buffer instead.
+    bool parallel {!indirect && !SDL_getenv("VB_SERIAL_RECORDING")};
+    static constexpr uint32_t jobs_per_worker = 4;
+    vb::ThreadCommandPools thread_cmdpools {&vbc};
+    std::vector<VkCommandBuffer> secondaries;
+    // Recording time of direct draws summed over frames, logged on exit to compare with VB_SERIAL_RECORDING.
+    double direct_record_ms {0.0};
+    uint64_t direct_record_frames {0};
+    // Set VB_MESH_SHADING to draw meshlets with task and mesh shaders, needs VK_EXT_mesh_shader.
+    // Task shaders cull meshlets themselves and read materials by index, so it implies bindless, packed vertices
+    // and no culling pass.
+    bool mesh_shading {indirect && SDL_getenv("VB_MESH_SHADING") != nullptr};
+    MeshShading meshlets {&vbc};
+    vb::GraphicsPipeline mesh_pipeline {&vbc};
+    // Set VB_INLINE_SHADERS to chain SPIR-V to pipeline stages instead of creating VkShaderModules, needs VK_KHR_maintenance5.
+    bool inline_shaders {SDL_getenv("VB_INLINE_SHADERS") != nullptr};
+    // Set VB_NO_CULLING to draw everything, VB_NO_OCCLUSION to only cull against frustum.
+    bool cull {indirect && !mesh_shading && !SDL_getenv("VB_NO_CULLING")};
+    Culling culling {&vbc};
+    // Set VB_NO_BINDLESS to bind descriptor set of every material before drawing it.
+    bool bindless {mesh_shading || (indirect && !SDL_getenv("VB_NO_BINDLESS"))};
+    // Set VB_FULL_VERTICES to keep 48 byte float vertices instead of quantized GLTF::PackedVertex.
+    bool packed {mesh_shading || !SDL_getenv("VB_FULL_VERTICES")};
+    // Set VB_NO_MESH_OPTIMIZATION to keep vertices and indices in source order.
+    bool optimize {!SDL_getenv("VB_NO_MESH_OPTIMIZATION")};
+    // Set VB_NO_LOD to always draw full detail primitives.
+    bool lods {!SDL_getenv("VB_NO_LOD")};
+    float lod_scale {0.0f};
+    vb::GraphicsPipeline bindless_pipeline {&vbc};
+    uint32_t max_draw_indirect_count;
+    vb::PipelineBatch pipeline_batch {&vbc};
     GLTF mesh {&vbc};
 
     vb::DescriptorPool ubo_pool {&vbc};
@@ -45,29 +84,95 @@ struct GltfTextures : public App {
 	};
 	//windowinfo.require_debug();
 	vb::ContextDeviceInfo deviceinfo = {
-    	    .vk10features = {.samplerAnisotropy = VK_TRUE},
+	    .queues_to_request = {vb::Queue::Graphics, vb::Queue::Transfer},
+    	    .vk10features = {
+		.multiDrawIndirect = VK_TRUE,
+		.drawIndirectFirstInstance = VK_TRUE,
+		.samplerAnisotropy = VK_TRUE,
+	    },
+	    // KTX2 textures are uploaded in their stored format, whichever family the device can sample.
+	    .optional_vk10features = {
+		.textureCompressionETC2 = VK_TRUE,
+		.textureCompressionASTC_LDR = VK_TRUE,
+		.textureCompressionBC = VK_TRUE,
+	    },
     	    .vk12features = {
+		.drawIndirectCount = VK_TRUE,
+		.descriptorIndexing = VK_TRUE,
+		.shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+		.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+		.descriptorBindingPartiallyBound = VK_TRUE,
+		.descriptorBindingVariableDescriptorCount = VK_TRUE,
+		.runtimeDescriptorArray = VK_TRUE,
+		.timelineSemaphore = VK_TRUE,
     	    },
     	    .vk13features = {
+		.synchronization2 = VK_TRUE,
     	        .dynamicRendering = VK_TRUE,
     	    },
     	};
+	VkPhysicalDeviceMeshShaderFeaturesEXT mesh_features = {
+	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+	    .taskShader = VK_TRUE,
+	    .meshShader = VK_TRUE,
+	};
+	if(mesh_shading) {
+	    deviceinfo.required_extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	    deviceinfo.pNext = &mesh_features;
+	}
+	VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5_features = {
+	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR,
+	    .maintenance5 = VK_TRUE,
+	};
+	if(inline_shaders) {
+	    deviceinfo.required_extensions.push_back(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+	    maintenance5_features.pNext = deviceinfo.pNext;
+	    deviceinfo.pNext = &maintenance5_features;
+	    maintenance5 = true;
+	}
 	vb::ContextSwapchainInfo swapchaininfo = {
 	    .present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR,
 	};
 	create(windowinfo, deviceinfo, swapchaininfo,0);
 	load_mesh();
+	// Empty scene has no draws buffer, so there's nothing for culling or task shaders to read.
+	if(mesh.draw_count == 0) cull = mesh_shading = false;
 	setup_ubo();
+	if(mesh_shading) meshlets.create(mesh, ubo);
+	if(parallel) {
+	    thread_cmdpools.create(queue->index, thread_pool.size(), frames.size());
+	    assert(thread_cmdpools.all_valid());
+	}
 	init_pipelines();
+	if(cull) {
+	    culling.occlusion = !SDL_getenv("VB_NO_OCCLUSION");
+	    culling.create(mesh, ubo, shader_cache, frames.size());
+	}
 	interactive_camera.move_speed = 0.01f;
 	scene_data.lights.position = glm::vec4(0.0f, 1.0f, 0.0f, 1.0f);
 	memcpy(ubo2.info.pMappedData, &scene_data.lights, sizeof(Lights));
     }
 
     ~GltfTextures() {
+	if(direct_record_frames > 0)
+	    vb::log(std::format("Recorded {} direct draws {} in {:.3f}ms per frame over {} frames",
+			node_primitives.size(), parallel ? std::format("in {} secondaries", secondaries.size())
+			: std::string("serially"), direct_record_ms / direct_record_frames, direct_record_frames));
+	if(cull) culling.clean();
+	if(parallel) thread_cmdpools.clean();
+	if(mesh_shading) {
+	    meshlets.clean();
+	    mesh_pipeline.clean();
+	    mesh_pipeline.clean_shaders();
+	}
 	mesh.clean();
 	gfx_pipeline.clean();
 	gfx_pipeline.clean_shaders();
+	indirect_pipeline.clean();
+	indirect_pipeline.clean_shaders();
+	bindless_pipeline.clean();
+	bindless_pipeline.clean_shaders();
+	pipeline_batch.clean();
 	ubo_pool.clean_layout(ubo_set_layout);
 	ubo_pool.clean();
 	ubo.clean();
@@ -75,12 +180,16 @@ struct GltfTextures : public App {
     }
 
     void setup_ubo() {
-	VkDescriptorPoolSize sizes[1] = {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2}};
-	ubo_pool.create(sizes, 2);
+	VkDescriptorPoolSize sizes[2] = {
+	    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+	};
+	ubo_pool.create(sizes, 3);
 	assert(ubo_pool.all_valid());
 	ubo_pool.add_binding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 		VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0);
 	ubo_pool.add_binding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1);
+	ubo_pool.add_binding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 2);
 	ubo_set_layout = ubo_pool.create_layout();
 	assert(ubo_set_layout);
 	ubo_set = ubo_pool.create_set(ubo_set_layout);
@@ -89,7 +198,7 @@ struct GltfTextures : public App {
 	assert(ubo.all_valid());
 	ubo2.create(sizeof(Lights), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
 	assert(ubo2.all_valid());
-	VkDescriptorBufferInfo info[2] = {
+	VkDescriptorBufferInfo info[3] = {
 	    {
 		.buffer = ubo.buffer,
 		.offset = 0,
@@ -99,9 +208,14 @@ struct GltfTextures : public App {
 		.buffer = ubo2.buffer,
 		.offset = 0,
 		.range = sizeof(Lights),
+	    },
+	    {
+		.buffer = mesh.draws.buffer,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
 	    }
 	};
-	VkWriteDescriptorSet write[2] = {
+	VkWriteDescriptorSet write[3] = {
 	    {
 		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 		.dstSet = ubo_set,
@@ -117,9 +231,18 @@ struct GltfTextures : public App {
 		.descriptorCount = 1,
 		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 		.pBufferInfo = &info[1],
+	    },
+	    {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = ubo_set,
+		.dstBinding = 2,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = &info[2],
 	    }
 	};
-	vkUpdateDescriptorSets(vbc.device, 2, write, 0, nullptr);
+	// Without draws nothing reads binding 2, so it's left unwritten.
+	vkUpdateDescriptorSets(vbc.device, mesh.draws.all_valid() ? 3 : 2, write, 0, nullptr);
     }
 
     void init_pipelines() {
@@ -161,64 +284,245 @@ struct GltfTextures : public App {
 		.offset = offsetof(GLTF::Vertex, tangent),
 	    },
 	};
-	gfx_pipeline.vertex_input.vertexBindingDescriptionCount = 1;
-	gfx_pipeline.vertex_input.pVertexBindingDescriptions = &bind_desc;
-	gfx_pipeline.vertex_input.vertexAttributeDescriptionCount = 5;
-	gfx_pipeline.vertex_input.pVertexAttributeDescriptions = attr_desc.data();
-	gfx_pipeline.set_front_face(VK_FRONT_FACE_COUNTER_CLOCKWISE);
-	gfx_pipeline.enable_blend();
-	gfx_pipeline.enable_depth_test();
-	gfx_pipeline.set_depth_comparison(VK_COMPARE_OP_GREATER_OR_EQUAL);
-
-	gfx_pipeline.add_shader("../samples/shaders/pbr.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-	gfx_pipeline.add_shader("../samples/shaders/pbr.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	if(packed) {
+	    bind_desc = GLTF::packed_binding();
+	    auto attributes = GLTF::packed_attributes();
+	    attr_desc.assign(attributes.begin(), attributes.end());
+	}
+	auto shader = [&](const char* name) {
+	    return std::format("../samples/shaders/{}{}.vert.spv", name, packed ? "_packed" : "");
+	};
+	// All pipelines share fixed function state, only shaders and layout differ.
+	// Mesh shading pipeline passes no vertex shader and fetches vertices itself.
+	auto setup = [&](vb::GraphicsPipeline& pipeline, const char* vertex_shader,
+		const char* fragment_shader) {
+	    if(vertex_shader) {
+		pipeline.vertex_input.vertexBindingDescriptionCount = 1;
+		pipeline.vertex_input.pVertexBindingDescriptions = &bind_desc;
+		pipeline.vertex_input.vertexAttributeDescriptionCount = attr_desc.size();
+		pipeline.vertex_input.pVertexAttributeDescriptions = attr_desc.data();
+		assert(pipeline.add_shader(shader_cache, vertex_shader, VK_SHADER_STAGE_VERTEX_BIT));
+	    }
+	    pipeline.set_front_face(VK_FRONT_FACE_COUNTER_CLOCKWISE);
+	    pipeline.enable_blend();
+	    pipeline.enable_depth_test();
+	    pipeline.set_depth_comparison(VK_COMPARE_OP_GREATER_OR_EQUAL);
+	    assert(pipeline.add_shader(shader_cache, fragment_shader, VK_SHADER_STAGE_FRAGMENT_BIT));
+	};
+	setup(gfx_pipeline, shader("pbr").c_str(), "../samples/shaders/pbr.frag.spv");
 	gfx_pipeline.add_push_constant(sizeof(PushConstants), VK_SHADER_STAGE_VERTEX_BIT);
 	gfx_pipeline.add_descriptor_set_layout(mesh.descriptor_layout);
 	gfx_pipeline.add_descriptor_set_layout(ubo_set_layout);
+	setup(indirect_pipeline, shader("pbr_indirect").c_str(),
+		"../samples/shaders/pbr.frag.spv");
+	indirect_pipeline.add_descriptor_set_layout(mesh.descriptor_layout);
+	indirect_pipeline.add_descriptor_set_layout(ubo_set_layout);
 	VkPipelineRenderingCreateInfo info = {
 	    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
 	    .colorAttachmentCount = 1,
 	    .pColorAttachmentFormats = &vbc.swapchain_format,
 	    .depthAttachmentFormat = VK_FORMAT_D32_SFLOAT,
 	};
-	gfx_pipeline.create(&info, 0);
-	assert(gfx_pipeline.all_valid());
+	pipeline_batch.add(gfx_pipeline, &info);
+	pipeline_batch.add(indirect_pipeline, &info);
+	if(bindless) {
+	    setup(bindless_pipeline, shader("pbr_indirect").c_str(),
+		    "../samples/shaders/pbr_bindless.frag.spv");
+	    bindless_pipeline.add_descriptor_set_layout(mesh.bindless_layout);
+	    bindless_pipeline.add_descriptor_set_layout(ubo_set_layout);
+	    pipeline_batch.add(bindless_pipeline, &info);
+	}
+	if(mesh_shading) {
+	    setup(mesh_pipeline, nullptr, "../samples/shaders/pbr_bindless.frag.spv");
+	    assert(mesh_pipeline.add_shader(shader_cache, "../samples/shaders/pbr.task.spv", VK_SHADER_STAGE_TASK_BIT_EXT));
+	    assert(mesh_pipeline.add_shader(shader_cache, "../samples/shaders/pbr.mesh.spv", VK_SHADER_STAGE_MESH_BIT_EXT));
+	    mesh_pipeline.add_descriptor_set_layout(mesh.bindless_layout);
+	    mesh_pipeline.add_descriptor_set_layout(ubo_set_layout);
+	    mesh_pipeline.add_descriptor_set_layout(meshlets.set_layout);
+	    // First draw of every `MeshShading::record` indirect call.
+	    mesh_pipeline.add_push_constant(sizeof(uint32_t), VK_SHADER_STAGE_TASK_BIT_EXT);
+	    pipeline_batch.add(mesh_pipeline, &info);
+	}
+	assert(pipeline_batch.create(thread_pool));
+	vb::log(std::format("Created {} pipelines with {} layouts in {:.2f}ms, {:.2f}ms of work, slowest {:.2f}ms",
+		    pipeline_batch.stats.pipelines, pipeline_batch.stats.layouts,
+		    pipeline_batch.stats.wall_ns / 1e6, pipeline_batch.stats.creation_ns / 1e6,
+		    pipeline_batch.stats.slowest_ns / 1e6));
     }
 
     void load_mesh() {
-	mesh.load("../samples/sponza/glTF/Sponza.gltf");
+	mesh.bindless = bindless;
+	mesh.packed_vertices = packed;
+	mesh.optimize_meshes = optimize;
+	mesh.generate_lods = lods;
+	mesh.generate_meshlets = mesh_shading;
+	mesh.load("../samples/sponza/glTF/Sponza.gltf", thread_pool);
 	assert(mesh.vertices.all_valid()&&mesh.indices.all_valid());
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vbc.physical_device, &properties);
+	max_draw_indirect_count = properties.limits.maxDrawIndirectCount;
+	for(uint32_t i = 0; i < mesh.nodes.size(); i++) {
+	    if(!mesh.nodes.meshes[i].has_value()) continue;
+	    auto& primitives = mesh.meshes[mesh.nodes.meshes[i].value()].primitives;
+	    for(uint32_t j = 0; j < primitives.size(); j++)
+		if(primitives[j].index_count > 0) node_primitives.push_back({i, j});
+	}
     }
 
-    void render_node(VkCommandBuffer cmd, GLTF::Node* node) {
-	if(node->mesh->primitives.size() == 0) return;
-	auto node_matrix = node->matrix;
-	auto parent = node->parent;
-	while(parent) {
-	    node_matrix = parent->matrix * node_matrix;
-	    parent = parent->parent;
-	}
-	auto push_constants = PushConstants{node_matrix};
-	vkCmdPushConstants(cmd, gfx_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT,
-		0, sizeof(PushConstants), &push_constants);
-	for(auto& primitive: node->mesh->primitives) {
-	    if(primitive.index_count == 0) continue;
+    struct NodeStats {
+	uint64_t drawcalls = 0;
+	uint64_t triangles = 0;
+	uint64_t lod_triangles[GLTF::max_lods] = {};
+    };
+    std::vector<NodeStats> node_stats;
+
+    struct NodePrimitive {
+	uint32_t node;
+	uint32_t primitive;
+    };
+    // Every drawn primitive of every node in node order, so direct draws split evenly across jobs
+    // even when a few nodes hold most primitives, like the single node of Sponza.
+    std::vector<NodePrimitive> node_primitives;
+
+    void render_primitives(VkCommandBuffer cmd, size_t begin, size_t end, NodeStats& counters) {
+	auto& nodes = mesh.nodes;
+	uint32_t pushed = UINT32_MAX;
+	for(size_t i = begin; i < end; i++) {
+	    auto node = node_primitives[i].node;
+	    auto& node_mesh = mesh.meshes[nodes.meshes[node].value()];
+	    // Ranges are in node order, so constants change once per node and at the start of a range.
+	    if(node != pushed) {
+		auto push_constants = PushConstants{nodes.worlds[node],
+		    node_mesh.position_offset, node_mesh.position_scale};
+		vkCmdPushConstants(cmd, gfx_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT,
+			0, sizeof(PushConstants), &push_constants);
+		pushed = node;
+	    }
+	    auto& primitive = node_mesh.primitives[node_primitives[i].primitive];
 	    if(primitive.material_index.has_value()) {
 		auto descriptor = mesh.materials[primitive.material_index.value()].descriptor;
 		VkDescriptorSet descriptors[2] = {descriptor, ubo_set};
 		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
 		    gfx_pipeline.layout, 0, 2, descriptors, 0, nullptr);
 	    }
-	    vkCmdDrawIndexed(cmd, primitive.index_count, 1, primitive.first_index, 0, 0);
-    	    stats.drawcalls++;
-	    stats.triangles += primitive.index_count/3;
+	    auto lod = primitive.select_lod(nodes.worlds[node], glm::vec3(scene_data.view.position), lod_scale);
+	    auto& level = primitive.lods[lod];
+	    vkCmdDrawIndexed(cmd, level.index_count, 1, level.first_index, 0, 0);
+	    counters.drawcalls++;
+	    counters.triangles += level.index_count/3;
+	    counters.lod_triangles[lod] += level.index_count/3;
 	}
-	for(auto& child: node->children) render_node(cmd, child.get());
+    }
+
+    void bind_draw_state(VkCommandBuffer cmd, vb::GraphicsPipeline& pipeline) {
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+	if(bindless) {
+	    assert(mesh.bindless_set);
+	    VkDescriptorSet descriptors[2] = {mesh.bindless_set, ubo_set};
+	    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		    pipeline.layout, 0, 2, descriptors, 0, nullptr);
+	}
+	VkViewport viewport = {0.0f, 0.0f, (float)render_extent.width,
+	    (float)render_extent.height, 0.0f, 1.0f};
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	VkRect2D scissor {{0,0}, render_extent};
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+	if(mesh_shading) return;
+	vkCmdBindIndexBuffer(cmd, mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+	VkDeviceSize offsets[1] = {0};
+	vkCmdBindVertexBuffers(cmd, 0, 1, &mesh.vertices.buffer, offsets);
+    }
+
+    // Splits primitives into a few contiguous ranges per worker so workers that finish early pick up more,
+    // each range recorded into its own secondary command buffer. Secondaries inherit nothing but attachment formats.
+    void record_primitives(VkCommandBuffer cmd) {
+	auto primitives = node_primitives.size();
+	auto jobs = (uint32_t)std::min<size_t>(primitives, thread_pool.size() * jobs_per_worker);
+	if(jobs == 0) return;
+	assert(thread_cmdpools.begin(frames.index()));
+	secondaries.assign(jobs, VK_NULL_HANDLE);
+	node_stats.assign(jobs, {});
+	VkCommandBufferInheritanceRenderingInfo rendering = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+	    .colorAttachmentCount = 1,
+	    .pColorAttachmentFormats = &vbc.swapchain_format,
+	    .depthAttachmentFormat = VK_FORMAT_D32_SFLOAT,
+	    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+	};
+	thread_pool.run(jobs, [&](uint32_t job, uint32_t worker) {
+	    auto secondary = thread_cmdpools.secondary(worker, rendering);
+	    if(!secondary) return;
+	    bind_draw_state(secondary, gfx_pipeline);
+	    render_primitives(secondary, primitives * job / jobs, primitives * (job + 1) / jobs, node_stats[job]);
+	    if(vkEndCommandBuffer(secondary) == VK_SUCCESS) secondaries[job] = secondary;
+	});
+	for(auto secondary: secondaries) assert(secondary);
+	vkCmdExecuteCommands(cmd, jobs, secondaries.data());
+	for(auto& counters: node_stats) add_node_stats(counters);
+    }
+
+    void add_node_stats(const NodeStats& counters) {
+	stats.drawcalls += counters.drawcalls;
+	stats.draws += counters.drawcalls;
+	stats.triangles += counters.triangles;
+	for(uint32_t i = 0; i < GLTF::max_lods; i++) stats.lod_triangles[i] += counters.lod_triangles[i];
+    }
+
+    void bind_material(VkCommandBuffer cmd, uint32_t material) {
+	if(material == GLTF::no_material) return;
+	VkDescriptorSet descriptors[2] = {mesh.materials[material].descriptor, ubo_set};
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	    indirect_pipeline.layout, 0, 2, descriptors, 0, nullptr);
+    }
+
+    void render_indirect(VkCommandBuffer cmd) {
+	if(cull) {
+	    stats.drawcalls += culling.record_draws(cmd, mesh, max_draw_indirect_count,
+		    [&](uint32_t material) { bind_material(cmd, material); });
+	    // Counters come from the last time this frame in flight was recorded.
+	    stats.draws += culling.stats.visible;
+	    stats.triangles += culling.stats.triangles;
+	    for(uint32_t i = 0; i < GLTF::max_lods; i++) stats.lod_triangles[i] += culling.stats.lod_triangles[i];
+	    stats.visible = culling.stats.visible;
+	    stats.culled = culling.stats.frustum_culled + culling.stats.occluded;
+	    return;
+	}
+	constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	for(auto& batch: mesh.draw_batches) {
+	    bind_material(cmd, batch.material);
+	    for(uint32_t offset = 0; offset < batch.count; offset += max_draw_indirect_count) {
+		auto count = std::min(batch.count - offset, max_draw_indirect_count);
+		vkCmdDrawIndexedIndirect(cmd, mesh.draw_commands.buffer,
+			(VkDeviceSize)(batch.first_command + offset) * stride, count, stride);
+		stats.drawcalls++;
+	    }
+	    stats.draws += batch.count;
+	}
+	// Without culling pass nothing selects levels of detail, commands keep full detail.
+	stats.triangles += mesh.draw_triangles;
+	stats.lod_triangles[0] += mesh.draw_triangles;
+    }
+
+    struct Transition {
+	VkImage image;
+	VkImageLayout old_layout;
+	VkImageLayout new_layout;
+	// Last commands using the image, waited for instead of every command before the barrier.
+	vb::Access previous;
+    };
+
+    // Records all `transitions` with one barrier, tests/barriers.cc compares it against barrier per image.
+    void transition(std::initializer_list<Transition> transitions, VkCommandBuffer cmd) {
+	for(auto& t: transitions)
+	    barriers.image(t.image, t.old_layout, t.new_layout, t.previous);
+	barriers.record(cmd);
     }
 
     VkImageLayout render(VkCommandBuffer cmd, VkImageLayout input_layout, uint32_t index) {
 	stats.drawcalls = 0;
+	stats.draws = 0;
 	stats.triangles = 0;
+	for(auto& triangles: stats.lod_triangles) triangles = 0;
 	auto start = std::chrono::high_resolution_clock::now();
 
 	if(!interactive_camera.lock && interactive_camera.use)
@@ -229,11 +533,34 @@ struct GltfTextures : public App {
 	    scene_data.view.position = glm::vec4(interactive_camera.position, 1.0f);
 	    memcpy(ubo.info.pMappedData, &scene_data.view, sizeof(View));
 	}
+	auto update_start = std::chrono::high_resolution_clock::now();
+	mesh.nodes.update();
+	if(indirect) {
+	    VkPipelineStageFlags2 readers = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+	    if(cull) readers |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	    if(mesh_shading) readers |= VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+	    mesh.update_draws(cmd, barriers, readers);
+	}
+	auto update_end = std::chrono::high_resolution_clock::now();
+	stats.update_time = std::chrono::duration_cast<std::chrono::microseconds>
+	    (update_end - update_start).count() / 1000.0f;
+
+	lod_scale = interactive_camera.lod_scale(render_extent.height);
+	if(cull) {
+	    if(culling.depth_generation != target_generation) culling.resize(depth_target, target_generation);
+	    culling.record_cull(cmd, barriers, frames.index(),
+		    scene_data.view.projection * scene_data.view.view, lod_scale);
+	}
 
-	vb::transition_image(cmd, render_target.image, VK_IMAGE_LAYOUT_UNDEFINED, 
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	vb::transition_image(cmd, depth_target.image, VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	// Render target was last read by blit to swapchain, depth by depth tests and pyramid build of culling.
+	auto depth_users = vb::layout_access(VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL).stage;
+	if(cull) depth_users |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	transition({
+	    {render_target.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		{VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_NONE}},
+	    {depth_target.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+		{depth_users, VK_ACCESS_2_NONE}},
+	}, cmd);
 	VkClearValue color[2] = {
 	    {.color = {0.0f, 0.0f, 0.0f, 1.0f}},
 	    {.depthStencil = {0.0f, 0}},
@@ -262,28 +589,48 @@ struct GltfTextures : public App {
 	    .pColorAttachments = &color_attach,
 	    .pDepthAttachment = &depth_attach,
 	};
+	// Render pass instance with secondary contents can't have anything but vkCmdExecuteCommands in it.
+	if(parallel) rendering.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
 	vkCmdBeginRendering(cmd, &rendering);
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, gfx_pipeline.pipeline);
-	VkViewport viewport = {0.0f, 0.0f, (float)render_extent.width,
-	    (float)render_extent.height, 0.0f, 1.0f};
-	vkCmdSetViewport(cmd, 0, 1, &viewport);
-	VkRect2D scissor {{0,0}, render_extent};
-	vkCmdSetScissor(cmd, 0, 1, &scissor);
+	auto& pipeline = mesh_shading ? mesh_pipeline : bindless ? bindless_pipeline
+	    : indirect ? indirect_pipeline : gfx_pipeline;
+	if(!parallel) bind_draw_state(cmd, pipeline);
 
-	vkCmdBindIndexBuffer(cmd, mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-	VkDeviceSize offsets[1] = {0};
-	vkCmdBindVertexBuffers(cmd, 0, 1, &mesh.vertices.buffer, offsets);
-	for(const auto& node: mesh.nodes) render_node(cmd, node.get());
+	auto record_start = std::chrono::high_resolution_clock::now();
+	if(parallel) {
+	    record_primitives(cmd);
+	} else if(mesh_shading) {
+	    // Task shaders don't report what they culled, counters are upper bounds.
+	    stats.drawcalls += meshlets.record(cmd, mesh_pipeline.layout);
+	    stats.draws += mesh.draw_count;
+	    stats.triangles += mesh.draw_triangles;
+	    stats.lod_triangles[0] += mesh.draw_triangles;
+	} else if(indirect) {
+	    render_indirect(cmd);
+	} else {
+	    NodeStats counters;
+	    render_primitives(cmd, 0, node_primitives.size(), counters);
+	    add_node_stats(counters);
+	}
+	if(!indirect) {
+	    auto record_end = std::chrono::high_resolution_clock::now();
+	    direct_record_ms += std::chrono::duration_cast<std::chrono::microseconds>
+		(record_end - record_start).count() / 1000.0;
+	    direct_record_frames++;
+	}
 
 	vkCmdEndRendering(cmd);
+	if(cull) culling.record_hiz(cmd, barriers, depth_target);
 	auto end = std::chrono::high_resolution_clock::now();
     	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 	stats.draw_time = elapsed.count() / 1000.0f;
 
-	vb::transition_image(cmd, render_target.image,
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-	vb::transition_image(cmd, vbc.swapchain_images[index], input_layout,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	transition({
+	    {render_target.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		vb::layout_access(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)},
+	    {vbc.swapchain_images[index], input_layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		swapchain_access(input_layout)},
+	}, cmd);
 	vb::blit_image(cmd, render_target.image, vbc.swapchain_images[index],
 		{render_extent.width, render_extent.height, 1},
 		{vbc.swapchain_extent.width, vbc.swapchain_extent.height, 1});
@@ -292,7 +639,58 @@ struct GltfTextures : public App {
     }
 };
 
+// Compares per frame cost of walking parent chains, as nodes used to be rendered, against linear update of flat hierarchy.
+void benchmark_transforms(uint32_t depth, uint32_t frames) {
+    GLTF::Nodes nodes;
+    uint32_t parent = GLTF::Nodes::no_parent;
+    for(uint32_t i = 0; i < depth; i++)
+	parent = nodes.add(parent, glm::vec3(0.0f, 1.0f, 0.0f),
+		glm::angleAxis(0.01f, glm::vec3(0.0f, 0.0f, 1.0f)), glm::vec3(1.0f));
+    auto measure = [&](uint32_t frames, auto&& fn) {
+	auto start = std::chrono::high_resolution_clock::now();
+	for(uint32_t frame = 0; frame < frames; frame++) fn(frame);
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000.0 / frames;
+    };
+    glm::mat4 sink {0.0f};
+    // Walking is quadratic in depth, so it gets fewer frames on deep hierarchies.
+    auto walk = measure(std::max(frames * 100 / depth, 1u), [&](uint32_t) {
+	for(size_t i = 0; i < nodes.size(); i++) {
+	    auto local = [&](size_t n) {
+		return glm::translate(glm::mat4(1.0f), nodes.translations[n])
+		    * glm::mat4(nodes.rotations[n]) * glm::scale(glm::mat4(1.0f), nodes.scales[n]);
+	    };
+	    auto matrix = local(i);
+	    for(auto p = nodes.parents[i]; p != GLTF::Nodes::no_parent; p = nodes.parents[p])
+		matrix = local(p) * matrix;
+	    sink += matrix;
+	}
+    });
+    auto root_dirty = measure(frames, [&](uint32_t frame) {
+	nodes.set_transform(0, glm::vec3(0.0f, frame * 0.001f, 0.0f), nodes.rotations[0], nodes.scales[0]);
+	nodes.update();
+	sink += nodes.worlds.back();
+    });
+    auto leaf_dirty = measure(frames, [&](uint32_t frame) {
+	auto leaf = nodes.size() - 1;
+	nodes.set_transform(leaf, glm::vec3(0.0f, frame * 0.001f, 0.0f), nodes.rotations[leaf], nodes.scales[leaf]);
+	nodes.update();
+	sink += nodes.worlds.back();
+    });
+    auto clean = measure(frames, [&](uint32_t) {
+	nodes.update();
+	sink += nodes.worlds.back();
+    });
+    vb::log(std::format("Transforms of {} deep hierarchy per frame: parent walk {:.2f}us, root dirty {:.2f}us, leaf dirty {:.2f}us, clean {:.2f}us ({})",
+		depth, walk, root_dirty, leaf_dirty, clean, sink[0][0]));
+}
+
 int main() {
+    // Set VB_BENCH_TRANSFORMS to hierarchy depth to only run transform benchmark.
+    if(auto depth = SDL_getenv("VB_BENCH_TRANSFORMS"); depth) {
+	benchmark_transforms(std::max(atoi(depth), 1), 100);
+	return 0;
+    }
     GltfTextures app {};
     app.run();
 }
@@ -5,12 +5,15 @@
 #include <variant>
 #include <memory>
 #include <unordered_set>
+#include <algorithm>
+#include <limits>
+#include <array>
+#include <numeric>
 #include <glm/gtx/hash.hpp>
 #include <glm/vector_relational.hpp>
 #include <glm/packing.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
-#include <stb/stb_image.h>
 #include <format>
 #include <fastgltf/core.hpp>
 #include <fastgltf/glm_element_traits.hpp>
@@ -20,7 +23,11 @@
 #include <fastgltf/types.hpp>
 #include <fastgltf/tools.hpp>
 #include <vb.h>
+#include "gltf_images.h"
+#include "mesh_optimizer.h"
+#include "packed_vertex.h"
 #include <filesystem>
+#include <chrono>
 
 struct GLTF {
     vb::Context* ctx;
@@ -82,22 +89,208 @@ struct GLTF {
 	glm::vec4 tangent;
     };
 
+    using PackedVertex = ::PackedVertex;
+
+    // Vertex input of `PackedVertex`.
+    static VkVertexInputBindingDescription packed_binding() {
+	return {
+	    .binding = 0,
+	    .stride = sizeof(PackedVertex),
+	    .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	};
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 4> packed_attributes() {
+	return {{
+	    {
+		.location = 0,
+		.binding = 0,
+		.format = VK_FORMAT_R16G16B16A16_UNORM,
+		.offset = offsetof(PackedVertex, position),
+	    },
+	    {
+		.location = 1,
+		.binding = 0,
+		.format = VK_FORMAT_R16G16_SNORM,
+		.offset = offsetof(PackedVertex, normal),
+	    },
+	    {
+		.location = 2,
+		.binding = 0,
+		.format = VK_FORMAT_R16G16_SNORM,
+		.offset = offsetof(PackedVertex, tangent),
+	    },
+	    {
+		.location = 3,
+		.binding = 0,
+		.format = VK_FORMAT_R16G16_SFLOAT,
+		.offset = offsetof(PackedVertex, uv),
+	    },
+	}};
+    }
+
+    static constexpr uint32_t max_lods = 4;
+
+    /**
+     * Level of detail in shared index buffer, `error` is the largest displacement of its vertices in mesh space.
+     */
+    struct Lod {
+	uint32_t first_index;
+	uint32_t index_count;
+	float error;
+    };
+
     struct Primitive {
         uint32_t first_index;
         uint32_t index_count;
 	std::optional<uint32_t> material_index;
+	glm::vec3 min;
+	glm::vec3 max;
+	// Center of bounding box in xyz, radius in w.
+	glm::vec4 sphere;
+	// Finest first, `lods[0]` is the primitive itself.
+	std::vector<Lod> lods;
+	// Meshlets of full detail level, in `GLTF::meshlets`.
+	uint32_t first_meshlet {0};
+	uint32_t meshlet_count {0};
+
+	/**
+	 * Selects coarsest level whose error projects to at most one pixel.
+	 *
+	 * @param world Transform of the node drawing the primitive.
+	 * @param camera Camera position in world space.
+	 * @param lod_scale Pixels per world unit at distance 1 divided by tolerated error in pixels, see `InteractiveCamera::lod_scale`.
+	 */
+	uint32_t select_lod(const glm::mat4& world, glm::vec3 camera, float lod_scale) const {
+	    auto center = glm::vec3(world * glm::vec4(glm::vec3(sphere), 1.0f));
+	    float scale = std::max({glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])),
+		    glm::length(glm::vec3(world[2]))});
+	    // Distance to the nearest point of bounding sphere, so no part of primitive is closer.
+	    float distance = std::max(glm::length(center - camera) - sphere.w * scale, 0.0f);
+	    uint32_t lod = 0;
+	    for(uint32_t i = 1; i < lods.size(); i++)
+		if(lods[i].error * scale * lod_scale <= distance) lod = i;
+	    return lod;
+	}
     };
 
     struct Mesh {
         std::vector<Primitive> primitives;
+	uint32_t first_vertex;
+	uint32_t vertex_count;
+	glm::vec3 min {std::numeric_limits<float>::max()};
+	glm::vec3 max {std::numeric_limits<float>::lowest()};
+	// Dequantizes `PackedVertex` position as `offset + position * scale`, identity for unpacked vertices.
+	glm::vec4 position_offset {0.0f};
+	glm::vec4 position_scale {1.0f};
+    };
+
+    /**
+     * Flat node hierarchy in structure of arrays, sorted so every parent comes before its children.
+     *
+     * World matrices are updated in one linear pass that recomputes only nodes marked dirty and their descendants.
+     */
+    struct Nodes {
+	static constexpr uint32_t no_parent = UINT32_MAX;
+	std::vector<uint32_t> parents;
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> worlds;
+	std::vector<std::optional<uint32_t>> meshes;
+	std::vector<uint8_t> dirty;
+	bool any_dirty = false;
+	// Nodes recomputed by last `update`, so copies of their world matrices can be refreshed.
+	std::vector<uint32_t> updated;
+
+	size_t size() const { return parents.size(); }
+
+	uint32_t add(uint32_t parent, glm::vec3 translation, glm::quat rotation, glm::vec3 scale,
+		std::optional<uint32_t> mesh = std::nullopt) {
+	    assert(parent == no_parent || parent < size());
+	    parents.push_back(parent);
+	    translations.push_back(translation);
+	    rotations.push_back(rotation);
+	    scales.push_back(scale);
+	    worlds.push_back(glm::mat4(1.0f));
+	    meshes.push_back(mesh);
+	    dirty.push_back(1);
+	    any_dirty = true;
+	    return size() - 1;
+	}
+
+	void set_transform(uint32_t node, glm::vec3 translation, glm::quat rotation, glm::vec3 scale) {
+	    translations[node] = translation;
+	    rotations[node] = rotation;
+	    scales[node] = scale;
+	    dirty[node] = 1;
+	    any_dirty = true;
+	}
+
+	void update() {
+	    updated.clear();
+	    if(!any_dirty) return;
+	    // Parents come first, so their dirty flag and world matrix are final when children are reached.
+	    for(size_t i = 0; i < size(); i++) {
+		auto parent = parents[i];
+		if(parent != no_parent && dirty[parent]) dirty[i] = 1;
+		if(!dirty[i]) continue;
+		auto local = glm::translate(glm::mat4(1.0f), translations[i])
+		    * glm::mat4(rotations[i]) * glm::scale(glm::mat4(1.0f), scales[i]);
+		worlds[i] = parent == no_parent ? local : worlds[parent] * local;
+		updated.push_back(i);
+	    }
+	    std::fill(dirty.begin(), dirty.end(), 0);
+	    any_dirty = false;
+	}
+    };
+
+    static constexpr uint32_t no_material = UINT32_MAX;
+
+    /**
+     * Per draw data in storage buffer, selected in vertex shader by `gl_InstanceIndex`.
+     *
+     * Layout matches std430 `Draw` in pbr_indirect.vert, pbr_indirect_packed.vert, cull.comp, pbr.task and pbr.mesh.
+     */
+    struct Draw {
+	glm::mat4 world;
+	// Inverted once on CPU, so shaders transforming camera into mesh space don't invert per invocation.
+	glm::mat4 inverse_world;
+	uint32_t material;
+	uint32_t first_index;
+	uint32_t index_count;
+	uint32_t batch;
+	glm::vec4 sphere;
+	glm::vec4 position_offset;
+	glm::vec4 position_scale;
+	// Per level of detail, unused levels have zero count.
+	glm::uvec4 lod_first;
+	glm::uvec4 lod_count;
+	glm::vec4 lod_error;
+	uint32_t first_meshlet;
+	uint32_t meshlet_count;
+	uint32_t pad[2];
+    };
+
+    /**
+     * Range of indirect commands sharing one material, recorded as single `vkCmdDrawIndexedIndirect`.
+     */
+    struct DrawBatch {
+	uint32_t material;
+	uint32_t first_command;
+	uint32_t count;
     };
 
-    struct Node;
-    struct Node {
-        Node* parent;
-        std::vector<std::unique_ptr<Node>> children;
-        glm::mat4 matrix;
-	std::optional<Mesh> mesh;
+    /**
+     * Material in bindless storage buffer with indices into bindless texture array.
+     *
+     * Layout matches std430 `Material` in pbr_bindless.frag.
+     */
+    struct BindlessMaterial {
+	uint32_t color;
+	uint32_t rough_metal;
+	uint32_t normal;
+	uint32_t pad;
     };
 
     struct Material {
@@ -115,11 +308,47 @@ struct GLTF {
     };
 
     vb::DescriptorPool descriptor;
+    vb::DescriptorAllocator descriptor_sets;
     VkDescriptorSetLayout descriptor_layout;
     VkSampler sampler;
 
+    // Set before `load` to also create one global set with all textures and materials, see `setup_bindless`.
+    bool bindless = false;
+    static constexpr uint32_t max_bindless_textures = 4096;
+    vb::DescriptorPool bindless_pool;
+    VkDescriptorSetLayout bindless_layout {VK_NULL_HANDLE};
+    VkDescriptorSet bindless_set {VK_NULL_HANDLE};
+    vb::Buffer bindless_materials;
+
+    // Set before `load` to deduplicate and reorder vertices and indices of every primitive with `MeshOptimizer`.
+    bool optimize_meshes = false;
+    MeshOptimizer::Stats optimize_stats;
+    // Set before `load` to add simplified levels of detail to every primitive.
+    bool generate_lods = false;
+    // Triangles of every level of detail summed over all primitives.
+    uint64_t lod_triangles[max_lods] = {};
+    // Set before `load` to store vertices as `PackedVertex`.
+    bool packed_vertices = false;
+    // Largest round trip error of packed attributes, measured in `create_buffers`.
+    PackingError packing_error;
+    // Set before `load` to split every primitive into meshlets for mesh shading, see `MeshShading`.
+    bool generate_meshlets = false;
+
     vb::Buffer vertices;
     vb::Buffer indices;
+    vb::Buffer draws;
+    vb::Buffer draw_commands;
+    // Indices of every node's draws, so moved nodes refresh `Draw::world` and `Draw::inverse_world` through `update_draws`.
+    std::vector<std::vector<uint32_t>> node_draws;
+    vb::Buffer meshlets;
+    vb::Buffer meshlet_vertices;
+    vb::Buffer meshlet_triangles;
+    uint32_t meshlet_count {0};
+    // Meshlets of every draw in `draws` order, `MeshShading` dispatches task shaders for each draw's own count.
+    std::vector<uint32_t> draw_meshlets;
+    std::vector<DrawBatch> draw_batches;
+    uint32_t draw_count {0};
+    uint64_t draw_triangles {0};
 
     std::optional<Camera> first_camera;
     std::vector<Camera> cameras;
@@ -127,14 +356,18 @@ struct GLTF {
     std::vector<Image> images;
     std::vector<uint32_t> textures;
     std::vector<Material> materials;
-    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<Mesh> meshes;
+    Nodes nodes;
 
-    GLTF(vb::Context* context): ctx{context}, descriptor{context},
-        vertices{context}, indices{context} {}
+    GLTF(vb::Context* context): ctx{context}, descriptor{context}, descriptor_sets{context}, bindless_pool{context},
+	bindless_materials{context}, vertices{context}, indices{context}, draws{context},
+	draw_commands{context}, meshlets{context}, meshlet_vertices{context}, meshlet_triangles{context} {}
 
-    void load(const std::filesystem::path& path) {
+    void load(const std::filesystem::path& path, vb::ThreadPool& pool) {
         vb::log(std::format("Loading {}...", path.string()));
-        fastgltf::Parser parser {fastgltf::Extensions::KHR_lights_punctual};
+	auto parse_start = std::chrono::high_resolution_clock::now();
+        fastgltf::Parser parser {fastgltf::Extensions::KHR_lights_punctual
+	    | fastgltf::Extensions::KHR_texture_basisu};
         auto data = fastgltf::GltfDataBuffer::FromPath(path);
         assert(data.error() == fastgltf::Error::None);
         auto options = fastgltf::Options::LoadExternalBuffers
@@ -143,18 +376,53 @@ struct GLTF {
         auto parent_path = path.parent_path();
         auto asset = parser.loadGltf(data.get(), parent_path, options);
         assert(asset.error() == fastgltf::Error::None);
+	auto decode_start = std::chrono::high_resolution_clock::now();
+	auto decoded = GLTFImages::decode(asset.get(), parent_path, pool);
+	auto decode_end = std::chrono::high_resolution_clock::now();
 
-	load_images(asset.get(), parent_path);
-	load_textures(asset.get());
+	vb::UploadQueue uploads {ctx};
+	auto transfer = ctx->transfer_submitter.value_or(*ctx->command_submitter);
+	uploads.create(transfer.index, transfer.queue);
+	assert(uploads.all_valid());
+	assert(uploads.set_owner(ctx->command_submitter->index, ctx->command_submitter->queue));
+	vb::MipGenerator mip_generator {ctx};
+	mip_generator.create("../samples/shaders/spd.comp.spv", asset->images.size());
+	GLTFImages::load(ctx, images, decoded, uploads, mip_generator.all_valid() ? &mip_generator : nullptr);
+	GLTFImages::load_textures(ctx, asset.get(), images, textures, default_image_index, uploads);
 	load_materials(asset.get());
-	create_dummy_textures();
+	// Bindless draws always index a material, so scene without any gets a default one. Its dummy textures
+	// also make sure the bindless set is allocated.
+	if(bindless && materials.empty()) materials.emplace_back();
+	create_dummy_textures(uploads);
+	assert(uploads.finish());
+	// Mip chains are recorded as a separate batch to time them apart from copies, like in gltf.h.
+	auto mips_start = std::chrono::high_resolution_clock::now();
+	for(size_t i = 0; i < decoded.size(); i++) if(decoded[i].ktx2.empty())
+	    uploads.record_acquire([&](VkCommandBuffer cmd) { images[i].image.generate_mipmaps(cmd); });
+	assert(uploads.finish());
+	auto mips_end = std::chrono::high_resolution_clock::now();
+	auto ms = [](auto start, auto end) {
+	    return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	};
+	vb::log(std::format("Uploaded {} images with {} jobs in {} submits",
+		    images.size(), uploads.stats.jobs, uploads.stats.submits));
+	vb::log(std::format("Parse {}ms, decode {}ms on {} threads, upload {}ms, mips {}ms",
+		    ms(parse_start, decode_start), ms(decode_start, decode_end), pool.size(),
+		    ms(decode_end, mips_start), ms(mips_start, mips_end)));
+	vb::log(std::format("Mip chains: {} compute dispatches, {} blit fallbacks",
+		    mip_generator.stats.dispatches, mip_generator.stats.fallbacks));
+	uploads.clean();
+	for(auto& image: images) image.image.set_mip_generator(nullptr);
+	mip_generator.clean();
 	load_nodes(asset.get());
+	create_draws();
 
         vb::log(std::format("Camera {}", first_camera.has_value() ? "found" : "not found"));
         vb::log("All GLTF data loaded");
         if (images.size() > 0) {
             setup_sampler();
             setup_descriptors();
+	    if(bindless) setup_bindless();
         }
         vb::log("GLTF object created");
     }
@@ -164,52 +432,25 @@ struct GLTF {
             vkDestroySampler(ctx->device, sampler, nullptr);
 	    descriptor.clean_layout(descriptor_layout);
 	    descriptor.clean();
+	    descriptor_sets.clean();
+	    if(bindless) {
+		bindless_pool.clean_layout(bindless_layout);
+		bindless_pool.clean();
+		bindless_materials.clean();
+	    }
         }
         vertices.clean();
         indices.clean();
+	draws.clean();
+	draw_commands.clean();
+	meshlets.clean();
+	meshlet_vertices.clean();
+	meshlet_triangles.clean();
         for(auto& image: images) image.image.clean();
     }
     
-    void load_textures(const fastgltf::Asset& asset) {
-	textures.resize(asset.textures.size());
-        for(size_t i = 0; i < asset.textures.size(); i++)
-	    textures[i] = asset.textures[i].imageIndex.value();
-    }
-
-    void load_images(const fastgltf::Asset& asset, const std::filesystem::path& parent_path) {
-	images.resize(asset.images.size(), {ctx});
-	for(size_t i = 0; i < asset.images.size(); i++) {
-	    int w, h, c;
-	    const auto& data = asset.images[i].data;
-	    if(const auto& uri = std::get_if<fastgltf::sources::URI>(&data); uri) {
-    		auto path = std::format("{}/{}", parent_path.c_str(), uri->uri.c_str());
-		vb::log(std::format("Loading {}...", path.c_str()));
-    		assert(uri->fileByteOffset == 0);
-    		assert(uri->uri.isLocalPath());
-    		images[i].image.create(path.c_str());
-    		assert(images[i].image.all_valid());
-    	    } else if(const auto& vector = std::get_if<fastgltf::sources::Vector>(&data); vector) {
-    		auto data = stbi_load_from_memory((stbi_uc*)vector->bytes.data(),
-		    (int)vector->bytes.size(), &w, &h, &c, 4);
-		assert(data);
-    		VkExtent3D size = {(uint32_t)w, (uint32_t)h, 1};
-    		images[i].image.create(data, size);
-    		assert(images[i].image.all_valid());
-    		stbi_image_free(data);
-    	    } else if(const auto& view = std::get_if<fastgltf::sources::BufferView>(&data); view) {
-		auto& bfview = asset.bufferViews[view->bufferViewIndex];
-		auto& bf = asset.buffers[bfview.bufferIndex];
-		const auto& v = std::get_if<fastgltf::sources::Array>(&bf.data);
-		auto data = stbi_load_from_memory((stbi_uc*)v->bytes.data() + bfview.byteOffset,
-	    	    bfview.byteLength, &w, &h, &c, 4);
-		assert(data);
-    		VkExtent3D size = {(uint32_t)w, (uint32_t)h, 1};
-    		images[i].image.create(data, size);
-    		assert(images[i].image.all_valid());
-    		stbi_image_free(data);
-	    }
-	}
-    }
+    // Index of 1x1 default image, created the first time a texture has no usable source.
+    std::optional<uint32_t> default_image_index;
 
     void load_materials(const fastgltf::Asset& asset) {
 	materials.resize(asset.materials.size());
@@ -227,7 +468,7 @@ struct GLTF {
 	}
     }
 
-    void create_dummy_textures() {
+    void create_dummy_textures(vb::UploadQueue& uploads) {
 	std::vector<glm::vec4> colors;
 	for(auto& material: materials) {
 	    if(!material.base_color_tex_index.has_value())
@@ -246,7 +487,7 @@ struct GLTF {
 	for(auto& vec: textures_needed) {
 	    uint32_t data = glm::packUnorm4x8(vec);
 	    vb::Image newtex {ctx};
-	    newtex.create((void*)&data, VkExtent3D{1,1,1});
+	    newtex.create(uploads, (void*)&data, VkExtent3D{1,1,1});
 	    assert(newtex.all_valid());
 	    images.push_back({newtex});
 	    uint32_t imgidx = images.size() - 1;
@@ -279,44 +520,66 @@ struct GLTF {
     void load_nodes(const fastgltf::Asset& asset) {
         std::vector<Vertex> vertices;
         std::vector<uint32_t> indices;
-        for(auto& node: asset.nodes) load_node(node, nullptr, asset, vertices, indices);
-	create_buffers(vertices, indices);
-    }
+	// Every mesh is loaded once, nodes refer to it by index.
+	meshes.resize(asset.meshes.size());
+	for(size_t i = 0; i < asset.meshes.size(); i++)
+	    load_mesh(asset.meshes[i], meshes[i], asset, vertices, indices);
 
-    void load_node(const fastgltf::Node& node_in, GLTF::Node* parent, 
-	    const fastgltf::Asset& asset, std::vector<Vertex>& vertex_vec,
-	    std::vector<uint32_t>& index_vec) {
-	auto node = std::make_unique<Node>();
-    	node->matrix = glm::mat4(1.0f);
-    	node->parent = parent;
-
-	if(auto trs = std::get_if<fastgltf::TRS>(&node_in.transform); trs) {
-	    node->matrix = glm::translate(node->matrix, glm::make_vec3(trs->translation.data()));
-	    node->matrix *= glm::mat4(glm::make_quat(trs->rotation.data()));
-	    node->matrix = glm::scale(node->matrix, glm::make_vec3(trs->scale.data()));
+	std::vector<size_t> roots;
+	if(!asset.scenes.empty()) {
+	    auto& scene = asset.scenes[asset.defaultScene.has_value() ? asset.defaultScene.value() : 0];
+	    roots.assign(scene.nodeIndices.begin(), scene.nodeIndices.end());
+	} else {
+	    std::vector<bool> is_child(asset.nodes.size());
+	    for(auto& node: asset.nodes) for(auto child: node.children) is_child[child] = true;
+	    for(size_t i = 0; i < asset.nodes.size(); i++) if(!is_child[i]) roots.push_back(i);
 	}
-
-    	if(node_in.children.size() > 0) {
-    	    for(const auto& child_idx: node_in.children)
-    		load_node(asset.nodes[child_idx], node.get(), asset, vertex_vec, index_vec);
-    	}
-
-    	if(node_in.meshIndex.has_value()) {
-	    load_mesh(asset.meshes[node_in.meshIndex.value()], node.get(), asset, vertex_vec, index_vec);
-    	}
-
-    	if(parent) parent->children.push_back(std::move(node));
-    	else nodes.push_back(std::move(node));
+	// Depth first with explicit stack, so parents are always added before their children.
+	std::vector<std::pair<size_t, uint32_t>> stack;
+	for(auto it = roots.rbegin(); it != roots.rend(); it++) stack.push_back({*it, Nodes::no_parent});
+	while(!stack.empty()) {
+	    auto [index, parent] = stack.back();
+	    stack.pop_back();
+	    auto& node = asset.nodes[index];
+	    glm::vec3 translation {0.0f};
+	    glm::quat rotation {1.0f, 0.0f, 0.0f, 0.0f};
+	    glm::vec3 scale {1.0f};
+	    if(auto trs = std::get_if<fastgltf::TRS>(&node.transform); trs) {
+		translation = glm::make_vec3(trs->translation.data());
+		rotation = glm::make_quat(trs->rotation.data());
+		scale = glm::make_vec3(trs->scale.data());
+	    }
+	    auto added = nodes.add(parent, translation, rotation, scale,
+		    parse_fastgltf_optional<uint32_t>(node.meshIndex));
+	    for(size_t i = node.children.size(); i > 0; i--)
+		stack.push_back({node.children[i - 1], added});
+	}
+	nodes.update();
+	if(generate_lods)
+	    vb::log(std::format("LOD triangles {} / {} / {} / {}", lod_triangles[0], lod_triangles[1],
+			lod_triangles[2], lod_triangles[3]));
+	if(optimize_meshes) {
+	    auto& s = optimize_stats;
+	    vb::log(std::format("Optimized meshes in {}ms: {} -> {} vertices, ACMR {:.3f} -> {:.3f}, "
+			"ATVR {:.3f} -> {:.3f}, {} overdraw clusters", s.time.count() / 1000.0,
+			s.vertices_before, s.vertices_after, s.before.acmr(), s.after.acmr(),
+			s.before.atvr(), s.after.atvr(), s.clusters));
+	}
+	create_buffers(vertices, indices);
+	if(generate_meshlets) create_meshlets(vertices, indices);
     }
 
-    void load_mesh(const fastgltf::Mesh& mesh, GLTF::Node* node, 
+    void load_mesh(const fastgltf::Mesh& mesh, Mesh& mesh_out,
 	    const fastgltf::Asset& asset, std::vector<Vertex>& vertex_vec,
 	    std::vector<uint32_t>& index_vec) {
+	mesh_out.first_vertex = vertex_vec.size();
 	for(const auto& prim: mesh.primitives) {
 	    uint32_t first_index = index_vec.size();
 	    uint32_t vertex_start = vertex_vec.size();
 	    uint32_t index_count = asset.accessors[prim.indicesAccessor.value()].count;
 	    size_t v_idx = 0;
+	    glm::vec3 min {std::numeric_limits<float>::max()};
+	    glm::vec3 max {std::numeric_limits<float>::lowest()};
 	    { // INDEX
 		auto& acc = asset.accessors[prim.indicesAccessor.value()];
 	       	index_vec.reserve(index_vec.size() + acc.count);
@@ -330,6 +593,8 @@ struct GLTF {
     		    v_idx = i;
 		    Vertex vert = {.position = v, .normal = {1,0,0}};
 		    vertex_vec[vertex_start + i] = vert;
+		    min = glm::min(min, v);
+		    max = glm::max(max, v);
 		});
 	    } { // NORMALS
 		auto att = prim.findAttribute("NORMAL");
@@ -357,19 +622,130 @@ struct GLTF {
 		    });
 		}
 	    }
+	    if(optimize_meshes) {
+		std::span<uint32_t> local {index_vec.data() + first_index, index_count};
+		for(auto& index: local) index -= vertex_start;
+		auto count = MeshOptimizer::optimize(local,
+			std::span<Vertex>(vertex_vec).subspan(vertex_start), optimize_stats);
+		for(auto& index: local) index += vertex_start;
+		vertex_vec.resize(vertex_start + count);
+	    }
+	    // Primitive without positions would get inverted bounds and NaN sphere, it gets zero ones at origin instead.
+	    bool has_positions = min.x <= max.x;
+	    if(!has_positions) min = max = glm::vec3(0.0f);
 	    Primitive primitive = {
 	        .first_index = first_index,
 	        .index_count = index_count,
+		.min = min,
+		.max = max,
+		.sphere = glm::vec4((min + max) * 0.5f, glm::length(max - min) * 0.5f),
 	    };
 	    if(prim.materialIndex.has_value())
 	        primitive.material_index = prim.materialIndex.value();
-	    node->mesh->primitives.push_back(primitive);
+	    primitive.lods.push_back({first_index, index_count, 0.0f});
+	    if(generate_lods) add_lods(primitive, vertex_start, vertex_vec, index_vec);
+	    for(size_t i = 0; i < primitive.lods.size(); i++) lod_triangles[i] += primitive.lods[i].index_count / 3;
+	    mesh_out.primitives.push_back(primitive);
+	    if(!has_positions) continue;
+	    mesh_out.min = glm::min(mesh_out.min, min);
+	    mesh_out.max = glm::max(mesh_out.max, max);
 	}
+	mesh_out.vertex_count = vertex_vec.size() - mesh_out.first_vertex;
+    }
+
+    /**
+     * Appends simplified levels of `primitive` to `index_vec`, each coarse enough to drop at least 40% of triangles
+     * of the previous level.
+     */
+    void add_lods(Primitive& primitive, uint32_t vertex_start, const std::vector<Vertex>& vertex_vec,
+	    std::vector<uint32_t>& index_vec) {
+	auto vertices = std::span<const Vertex>(vertex_vec).subspan(vertex_start);
+	std::vector<uint32_t> source(index_vec.begin() + primitive.first_index,
+		index_vec.begin() + primitive.first_index + primitive.index_count);
+	for(auto& index: source) index -= vertex_start;
+	auto extent = primitive.max - primitive.min;
+	float size = std::max({extent.x, extent.y, extent.z});
+	if(!(size > 0.0f)) return;
+	uint32_t previous = primitive.index_count;
+	for(float cell = size / 64.0f; cell <= size && primitive.lods.size() < max_lods; cell *= 2.0f) {
+	    auto lod = MeshOptimizer::simplify(std::span<const uint32_t>(source), vertices, cell);
+	    if(lod.empty()) break;
+	    if(lod.size() > previous * 0.6f) continue;
+	    MeshOptimizer::optimize_vertex_cache(lod, vertices.size());
+	    primitive.lods.push_back({(uint32_t)index_vec.size(), (uint32_t)lod.size(), cell * std::sqrt(3.0f)});
+	    for(auto index: lod) index_vec.push_back(index + vertex_start);
+	    previous = lod.size();
+	}
+    }
+
+    /**
+     * Splits full detail level of every primitive into meshlets and uploads them with their vertex and triangle lists.
+     */
+    void create_meshlets(const std::vector<Vertex>& vertex_vec, const std::vector<uint32_t>& index_vec) {
+	std::vector<MeshOptimizer::Meshlet> meshlet_vec;
+	std::vector<uint32_t> vertex_list;
+	std::vector<uint32_t> triangle_list;
+	for(auto& mesh: meshes) {
+	    auto vertices = std::span<const Vertex>(vertex_vec).subspan(mesh.first_vertex, mesh.vertex_count);
+	    for(auto& primitive: mesh.primitives) {
+		std::vector<uint32_t> local(index_vec.begin() + primitive.first_index,
+			index_vec.begin() + primitive.first_index + primitive.index_count);
+		for(auto& index: local) index -= mesh.first_vertex;
+		primitive.first_meshlet = meshlet_vec.size();
+		size_t first_vertex = vertex_list.size();
+		MeshOptimizer::build_meshlets(std::span<const uint32_t>(local), vertices,
+			meshlet_vec, vertex_list, triangle_list);
+		for(size_t i = first_vertex; i < vertex_list.size(); i++) vertex_list[i] += mesh.first_vertex;
+		primitive.meshlet_count = meshlet_vec.size() - primitive.first_meshlet;
+	    }
+	}
+	meshlet_count = meshlet_vec.size();
+	if(meshlet_vec.empty()) return;
+	auto upload = [&](vb::Buffer& buffer, const void* data, size_t size) {
+	    buffer.create(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		    VMA_MEMORY_USAGE_GPU_ONLY);
+	    assert(buffer.all_valid());
+	    assert(buffer.upload(data, size));
+	};
+	upload(meshlets, meshlet_vec.data(), meshlet_vec.size() * sizeof(MeshOptimizer::Meshlet));
+	upload(meshlet_vertices, vertex_list.data(), vertex_list.size() * sizeof(uint32_t));
+	upload(meshlet_triangles, triangle_list.data(), triangle_list.size() * sizeof(uint32_t));
+	vb::log(std::format("Built {} meshlets, {:.1f} vertices and {:.1f} triangles on average",
+		    meshlet_count, (float)vertex_list.size() / meshlet_count,
+		    (float)triangle_list.size() / meshlet_count));
+    }
+
+    /**
+     * Quantizes vertices of every mesh inside its bounds and measures round trip error of each attribute.
+     * Error bounds of the encoding are checked by tests/packed_vertex.cc, here they are only logged.
+     */
+    std::vector<PackedVertex> pack_vertices(const std::vector<Vertex>& vertex_vec) {
+	std::vector<PackedVertex> packed(vertex_vec.size());
+	for(auto& mesh: meshes) {
+	    if(mesh.vertex_count == 0) continue;
+	    // Flat meshes keep non zero scale, so quantization never divides by zero.
+	    auto scale = glm::max(mesh.max - mesh.min, glm::vec3(std::numeric_limits<float>::min()));
+	    mesh.position_offset = glm::vec4(mesh.min, 0.0f);
+	    mesh.position_scale = glm::vec4(scale, 0.0f);
+	    for(uint32_t i = mesh.first_vertex; i < mesh.first_vertex + mesh.vertex_count; i++) {
+		auto& vertex = vertex_vec[i];
+		packed[i] = PackedVertex::pack(vertex, mesh.min, scale);
+		packing_error.add(vertex, packed[i].unpack<Vertex>(mesh.min, scale), scale);
+	    }
+	}
+	vb::log(std::format("Packed {} vertices, max error position {}, normal {}, tangent {}, uv {}, {} uvs out of half float range",
+		    packed.size(), packing_error.position, packing_error.normal,
+		    packing_error.tangent, packing_error.uv, packing_error.uv_overflows));
+	return packed;
     }
 
     void create_buffers(std::vector<Vertex>& vertex_vec, std::vector<uint32_t>& index_vec) {
         vb::log("Creating buffers...");
-        size_t vertices_size = vertex_vec.size() * sizeof(Vertex);
+	std::vector<PackedVertex> packed;
+	if(packed_vertices) packed = pack_vertices(vertex_vec);
+	const void* vertex_data = packed_vertices ? (const void*)packed.data() : vertex_vec.data();
+	size_t vertices_size = vertex_vec.size() * (packed_vertices ? sizeof(PackedVertex) : sizeof(Vertex));
+	vb::log(std::format("Vertex buffer {} KiB", vertices_size / 1024));
         this->vertices.create(vertices_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
         	| VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
         	VMA_MEMORY_USAGE_GPU_ONLY);
@@ -378,31 +754,133 @@ struct GLTF {
         this->indices.create(indices_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT
         	| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
         assert(this->indices.all_valid());
-        vb::Buffer staging_buffer {ctx};
-        staging_buffer.create(vertices_size + indices_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        	VMA_MEMORY_USAGE_CPU_ONLY);
-        assert(staging_buffer.all_valid());
-        char* buf_data = (char*)staging_buffer.info.pMappedData;
-        memcpy(buf_data, vertex_vec.data(), vertices_size);
-        memcpy(buf_data + vertices_size, index_vec.data(), indices_size);
         vb::log("Copying data to buffers...");
-        ctx->submit_command_to_queue([&](VkCommandBuffer cmd) {
-            VkBufferCopy copy = { .size = vertices_size };
-            vkCmdCopyBuffer(cmd, staging_buffer.buffer, this->vertices.buffer, 1, &copy);
-            VkBufferCopy copy2 = {
-        	.srcOffset = vertices_size,
-        	.size = indices_size,
-            };
-            vkCmdCopyBuffer(cmd, staging_buffer.buffer, this->indices.buffer, 1, &copy2);
-        });
-        staging_buffer.clean();
+	assert(this->vertices.upload(vertex_data, vertices_size));
+        assert(this->indices.upload(index_vec.data(), indices_size));
+    }
+
+    /**
+     * Flattens every primitive of every node into `Draw` and matching indirect command,
+     * grouped by material so scene is drawn with one indirect call per material.
+     *
+     * Commands use their index as `firstInstance`, which becomes `gl_InstanceIndex` of their `Draw`.
+     * `Draw::world` and its inverse are computed from node at load, `update_draws` refreshes them for nodes moved later.
+     */
+    void create_draws() {
+	std::vector<Draw> draw_vec;
+	std::vector<uint32_t> draw_nodes;
+	for(size_t i = 0; i < nodes.size(); i++) {
+	    if(!nodes.meshes[i].has_value()) continue;
+	    auto& mesh = meshes[nodes.meshes[i].value()];
+	    for(auto& primitive: mesh.primitives) {
+		if(primitive.index_count == 0) continue;
+		draw_vec.push_back({
+		    .world = nodes.worlds[i],
+		    .inverse_world = glm::inverse(nodes.worlds[i]),
+		    // Bindless draws always index some material, direct ones keep whatever set was bound.
+		    .material = primitive.material_index.value_or(bindless ? 0 : no_material),
+		    .first_index = primitive.first_index,
+		    .index_count = primitive.index_count,
+		    .sphere = primitive.sphere,
+		    .position_offset = mesh.position_offset,
+		    .position_scale = mesh.position_scale,
+		    .lod_count = glm::uvec4(0),
+		    .first_meshlet = primitive.first_meshlet,
+		    .meshlet_count = primitive.meshlet_count,
+		});
+		draw_nodes.push_back(i);
+		auto& draw = draw_vec.back();
+		for(size_t lod = 0; lod < primitive.lods.size(); lod++) {
+		    draw.lod_first[lod] = primitive.lods[lod].first_index;
+		    draw.lod_count[lod] = primitive.lods[lod].index_count;
+		    draw.lod_error[lod] = primitive.lods[lod].error;
+		}
+	    }
+	}
+	if(draw_vec.empty()) return;
+	std::vector<uint32_t> order(draw_vec.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+	    return draw_vec[a].material < draw_vec[b].material;
+	});
+	std::vector<Draw> sorted;
+	sorted.reserve(draw_vec.size());
+	node_draws.assign(nodes.size(), {});
+	for(uint32_t i = 0; i < order.size(); i++) {
+	    sorted.push_back(draw_vec[order[i]]);
+	    node_draws[draw_nodes[order[i]]].push_back(i);
+	}
+	draw_vec = std::move(sorted);
+	std::vector<VkDrawIndexedIndirectCommand> commands;
+	commands.reserve(draw_vec.size());
+	for(uint32_t i = 0; i < draw_vec.size(); i++) {
+	    auto& draw = draw_vec[i];
+	    commands.push_back({
+		.indexCount = draw.index_count,
+		.instanceCount = 1,
+		.firstIndex = draw.first_index,
+		.vertexOffset = 0,
+		.firstInstance = i,
+	    });
+	    // Bindless draws pick their material in the shader, so all of them share one batch.
+	    auto material = bindless ? no_material : draw.material;
+	    if(draw_batches.empty() || draw_batches.back().material != material)
+		draw_batches.push_back({material, i, 0});
+	    draw_batches.back().count++;
+	    draw.batch = draw_batches.size() - 1;
+	    draw_triangles += draw.index_count / 3;
+	    if(generate_meshlets) draw_meshlets.push_back(draw.meshlet_count);
+	}
+	draw_count = draw_vec.size();
+
+	size_t draws_size = draw_vec.size() * sizeof(Draw);
+	draws.create(draws_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	assert(draws.all_valid());
+	size_t commands_size = commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+	draw_commands.create(commands_size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	assert(draw_commands.all_valid());
+	assert(draws.upload(draw_vec.data(), draws_size));
+	assert(draw_commands.upload(commands.data(), commands_size));
+	vb::log(std::format("Created {} draws in {} indirect batches", draw_count, draw_batches.size()));
+    }
+
+    /**
+     * Records copies of world matrices of nodes recomputed by last `Nodes::update` and their inverses into their `Draw`s.
+     * Has to be recorded outside of rendering.
+     *
+     * @param barriers Records barriers around the copies.
+     * @param readers Stages reading `draws`, waited for before the copies and made to wait for them.
+     * @return `false` if nothing moved and nothing was recorded.
+     */
+    bool update_draws(VkCommandBuffer cmd, vb::Barriers& barriers, VkPipelineStageFlags2 readers) {
+	if(!draws.all_valid()) return false;
+	bool moved = std::any_of(nodes.updated.begin(), nodes.updated.end(),
+		[&](uint32_t node) { return !node_draws[node].empty(); });
+	if(!moved) return false;
+	vb::Access read = {readers, VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+	vb::Access write = {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+	// Previous frames may still read the buffer, only their execution has to finish before it's overwritten.
+	barriers.buffer(draws.buffer, {readers, VK_ACCESS_2_NONE}, write).record(cmd);
+	for(auto node: nodes.updated) {
+	    if(node_draws[node].empty()) continue;
+	    // `world` and `inverse_world` are adjacent, so both go in one update, copied into the command buffer.
+	    glm::mat4 matrices[2] = {nodes.worlds[node], glm::inverse(nodes.worlds[node])};
+	    for(auto draw: node_draws[node])
+		vkCmdUpdateBuffer(cmd, draws.buffer, draw * sizeof(Draw) + offsetof(Draw, world),
+			sizeof(matrices), matrices);
+	}
+	barriers.buffer(draws.buffer, write, read).record(cmd);
+	return true;
     }
 
     void setup_descriptors() {
-	std::vector<VkDescriptorPoolSize> sizes = {
-	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (uint32_t)materials.size() * 3}
+	vb::DescriptorAllocator::Ratio ratios[] = {
+	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3.0f},
 	};
-    	descriptor.create(sizes, images.size());
+	descriptor_sets.create(ratios, materials.size());
+	assert(descriptor_sets.all_valid());
 	descriptor.add_binding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 		VK_SHADER_STAGE_FRAGMENT_BIT, 0);
 	descriptor.add_binding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
@@ -411,9 +889,12 @@ struct GLTF {
 		VK_SHADER_STAGE_FRAGMENT_BIT, 2);
 	descriptor_layout = descriptor.create_layout();
 	assert(descriptor_layout);
-	for(auto& material: materials) {
-	    material.descriptor = descriptor.create_set(descriptor_layout);
-	    assert(material.descriptor);
+	std::vector<VkDescriptorSetLayout> layouts(materials.size(), descriptor_layout);
+	std::vector<VkDescriptorSet> sets(materials.size());
+	assert(descriptor_sets.allocate(layouts, sets.data()));
+	for(size_t i = 0; i < materials.size(); i++) {
+	    auto& material = materials[i];
+	    material.descriptor = sets[i];
 	    assert(material.base_color_tex_index.has_value());
 	    assert(material.metallic_roughness_tex_index.has_value());
 	    assert(material.normal_tex_index.has_value());
@@ -464,6 +945,110 @@ struct GLTF {
 	}
     }
 
+    /**
+     * Creates one descriptor set with materials in storage buffer at binding 0 and every texture in
+     * partially bound, update after bind array at binding 1, so draws don't need per material binds.
+     *
+     * Array is sized for `max_bindless_textures` (or less, if device limits are lower) and allocated with
+     * the current texture count, textures streamed in later can be written while the set is bound.
+     */
+    void setup_bindless() {
+	VkPhysicalDeviceVulkan12Properties properties12 = {
+	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES,
+	};
+	VkPhysicalDeviceProperties2 properties = {
+	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+	    .pNext = &properties12,
+	};
+	vkGetPhysicalDeviceProperties2(ctx->physical_device, &properties);
+	uint32_t capacity = std::min({max_bindless_textures,
+		properties12.maxPerStageDescriptorUpdateAfterBindSamplers,
+		properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		properties12.maxDescriptorSetUpdateAfterBindSamplers,
+		properties12.maxDescriptorSetUpdateAfterBindSampledImages});
+	uint32_t count = textures.size();
+	assert(count <= capacity);
+
+	std::vector<VkDescriptorPoolSize> sizes = {
+	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, capacity},
+	};
+	bindless_pool.create(sizes, 1, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+	assert(bindless_pool.all_valid());
+	bindless_pool.add_binding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+	bindless_pool.add_binding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_SHADER_STAGE_FRAGMENT_BIT, 1, capacity);
+	VkDescriptorBindingFlags flags[2] = {
+	    0,
+	    VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+		| VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT,
+	};
+	VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+	    .bindingCount = 2,
+	    .pBindingFlags = flags,
+	};
+	bindless_layout = bindless_pool.create_layout(
+		VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT, &binding_flags);
+	assert(bindless_layout);
+	VkDescriptorSetVariableDescriptorCountAllocateInfo variable_count = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+	    .descriptorSetCount = 1,
+	    .pDescriptorCounts = &count,
+	};
+	bindless_set = bindless_pool.create_set(bindless_layout, &variable_count);
+	assert(bindless_set);
+
+	std::vector<BindlessMaterial> material_vec;
+	for(auto& material: materials) {
+	    material_vec.push_back({
+		.color = material.base_color_tex_index.value(),
+		.rough_metal = material.metallic_roughness_tex_index.value(),
+		.normal = material.normal_tex_index.value(),
+	    });
+	}
+	size_t materials_size = material_vec.size() * sizeof(BindlessMaterial);
+	bindless_materials.create(materials_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	assert(bindless_materials.all_valid());
+	assert(bindless_materials.upload(material_vec.data(), materials_size));
+
+	VkDescriptorBufferInfo materials_info = {
+	    .buffer = bindless_materials.buffer,
+	    .offset = 0,
+	    .range = VK_WHOLE_SIZE,
+	};
+	std::vector<VkDescriptorImageInfo> texture_infos;
+	for(auto texture: textures) {
+	    texture_infos.push_back({
+		.sampler = sampler,
+		.imageView = images[texture].image.image_view,
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    });
+	}
+	VkWriteDescriptorSet writes[2] = {
+	    {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = bindless_set,
+		.dstBinding = 0,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = &materials_info,
+	    },
+	    {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = bindless_set,
+		.dstBinding = 1,
+		.descriptorCount = count,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.pImageInfo = texture_infos.data(),
+	    },
+	};
+	vkUpdateDescriptorSets(ctx->device, 2, writes, 0, nullptr);
+	vb::log(std::format("Bindless set with {} of {} textures and {} materials",
+		    count, capacity, material_vec.size()));
+    }
+
     void setup_sampler() {
 	VkPhysicalDeviceProperties pdev_prop{};
     	vkGetPhysicalDeviceProperties(ctx->physical_device, &pdev_prop);
@@ -481,7 +1066,7 @@ struct GLTF {
 	    .compareEnable = VK_FALSE,
 	    .compareOp = VK_COMPARE_OP_ALWAYS,
 	    .minLod = 0.0f,
-	    .maxLod = 0.0f,
+	    .maxLod = VK_LOD_CLAMP_NONE,
 	    .borderColor = VK_BORDER_COLOR_INT_OPAQUE_WHITE,
 	    .unnormalizedCoordinates = VK_FALSE,
 	};
@@ -27,7 +27,15 @@ struct GltfTextures : public App {
 	};
 	windowinfo.require_debug();
 	vb::ContextDeviceInfo deviceinfo = {
+	    .queues_to_request = {vb::Queue::Graphics, vb::Queue::Transfer},
     	    .vk10features = {.samplerAnisotropy = VK_TRUE},
+	    // KTX2 textures are uploaded in their stored format, whichever family the device can sample.
+	    .optional_vk10features = {
+		.textureCompressionETC2 = VK_TRUE,
+		.textureCompressionASTC_LDR = VK_TRUE,
+		.textureCompressionBC = VK_TRUE,
+	    },
+    	    .vk12features = {.timelineSemaphore = VK_TRUE},
     	    .vk13features = {
     	        .dynamicRendering = VK_TRUE,
     	    },
@@ -95,8 +103,8 @@ struct GltfTextures : public App {
 	gfx_pipeline.enable_depth_test();
 	gfx_pipeline.set_depth_comparison(VK_COMPARE_OP_GREATER_OR_EQUAL);
 
-	gfx_pipeline.add_shader("../samples/shaders/locvert.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-	gfx_pipeline.add_shader("../samples/shaders/basictex.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	assert(gfx_pipeline.add_shader(shader_cache, "../samples/shaders/locvert.vert.spv", VK_SHADER_STAGE_VERTEX_BIT));
+	assert(gfx_pipeline.add_shader(shader_cache, "../samples/shaders/basictex.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT));
 	gfx_pipeline.add_push_constant(sizeof(PushConstants), VK_SHADER_STAGE_VERTEX_BIT);
 	gfx_pipeline.add_descriptor_set_layout(mesh.descriptor_layout);
 	VkPipelineRenderingCreateInfo info = {
@@ -105,12 +113,11 @@ struct GltfTextures : public App {
 	    .pColorAttachmentFormats = &vbc.swapchain_format,
 	    .depthAttachmentFormat = VK_FORMAT_D32_SFLOAT,
 	};
-	gfx_pipeline.create(&info, 0);
-	assert(gfx_pipeline.all_valid());
+	assert(pipeline_registry.acquire(gfx_pipeline, &info));
     }
 
     void load_mesh() {
-	mesh.load("../samples/sponza/glTF/Sponza.gltf");
+	mesh.load("../samples/sponza/glTF/Sponza.gltf", thread_pool);
 	assert(mesh.vertices.all_valid()&&mesh.indices.all_valid());
     }
 
@@ -136,6 +143,7 @@ struct GltfTextures : public App {
 		vkCmdDrawIndexed(cmd, primitive.index_count, 1, 
 	    	    primitive.first_index, 0, 0);
 		stats.drawcalls++;
+		stats.draws++;
 		stats.triangles += primitive.index_count/3;
 	    }
 	}
@@ -144,6 +152,7 @@ struct GltfTextures : public App {
 
     VkImageLayout render(VkCommandBuffer cmd, VkImageLayout input_layout, uint32_t index) {
 	stats.drawcalls = 0;
+	stats.draws = 0;
 	stats.triangles = 0;
 	auto start = std::chrono::high_resolution_clock::now();
 
@@ -54,20 +54,8 @@ struct Rectangle {
 		    | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
 	    assert(index_buffer.all_valid());
 
-	    auto staging_buffer = vb::Buffer{context};
-    	    staging_buffer.create(vertices_size + indices_size,
-		    VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-	    assert(staging_buffer.all_valid());
-    	    memcpy(staging_buffer.info.pMappedData, vertices.data(), vertices_size);
-    	    memcpy((char*)(staging_buffer.info.pMappedData)+vertices_size, indices.data(),
-		    indices_size);
-	    context->submit_command_to_queue([&](VkCommandBuffer cmd) {
-    	        VkBufferCopy copy = { .size = vertices_size };
-    	        vkCmdCopyBuffer(cmd, staging_buffer.buffer, vertex_buffer.buffer, 1, &copy);
-    	        VkBufferCopy copy2 = { .srcOffset = vertices_size, .size = indices_size };
-    	        vkCmdCopyBuffer(cmd, staging_buffer.buffer, index_buffer.buffer, 1, &copy2);
-    	    });
-    	    staging_buffer.clean();
+	    assert(vertex_buffer.upload(vertices.data(), vertices_size));
+	    assert(index_buffer.upload(indices.data(), indices_size));
     }
 };
 
@@ -98,6 +86,11 @@ int main(int argc, char** argv) {
     assert(vbc.create_surface_swapchain(sinfo));
     assert(vbc.init_vma(VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT));
 
+    auto staging_ring = vb::StagingRing(&vbc);
+    staging_ring.create(16 * 1024 * 1024);
+    assert(staging_ring.all_valid());
+    vbc.set_staging_ring(&staging_ring);
+
     vb::QueueIndex* graphics_queue = vbc.find_queue(vb::Queue::Graphics);
     assert(graphics_queue);
 
@@ -480,4 +473,5 @@ int main(int argc, char** argv) {
     }
     frames_cmdpool.clean();
     cmdpool.clean();
+    staging_ring.clean();
 }
@@ -0,0 +1,465 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <limits>
+#include <glm/glm.hpp>
+
+/**
+ * CPU optimization passes for indexed triangle lists, run on every glTF primitive after loading.
+ *
+ * All passes work on primitive local indices, `0` is the first vertex of the primitive.
+ * Vertex types only need `position` member and have to be comparable bytewise.
+ */
+struct MeshOptimizer {
+    // Size of FIFO cache used to measure results, close to post transform caches of current hardware.
+    static constexpr uint32_t fifo_size = 16;
+    // Size of LRU cache modelled by `optimize_vertex_cache`.
+    static constexpr int32_t lru_size = 32;
+
+    /**
+     * Post transform cache efficiency: ACMR is vertex shader invocations per triangle, 0.5 at best for regular meshes.
+     * ATVR is invocations per unique vertex, 1.0 at best.
+     */
+    struct CacheStats {
+	uint64_t triangles = 0;
+	uint64_t vertices = 0;
+	uint64_t misses = 0;
+
+	float acmr() const { return triangles ? (float)misses / triangles : 0.0f; }
+	float atvr() const { return vertices ? (float)misses / vertices : 0.0f; }
+
+	CacheStats& operator+=(const CacheStats& other) {
+	    triangles += other.triangles;
+	    vertices += other.vertices;
+	    misses += other.misses;
+	    return *this;
+	}
+    };
+
+    static constexpr uint32_t max_meshlet_vertices = 64;
+    static constexpr uint32_t max_meshlet_triangles = 124;
+
+    /**
+     * Cluster of at most `max_meshlet_vertices` vertices and `max_meshlet_triangles` triangles.
+     *
+     * Layout matches std430 `Meshlet` in pbr.task and pbr.mesh.
+     */
+    struct Meshlet {
+	// Into vertex list of meshlets, whose entries index vertex buffer.
+	uint32_t vertex_offset;
+	// Into triangle list of meshlets, each entry packs 3 meshlet local 8 bit indices.
+	uint32_t triangle_offset;
+	uint32_t vertex_count;
+	uint32_t triangle_count;
+	// Bounding sphere, center in xyz and radius in w.
+	glm::vec4 sphere;
+	// Normal cone axis in xyz, in w sine of its half angle widened by 90 degrees, `1` if it can't be culled.
+	glm::vec4 cone;
+    };
+
+    struct Stats {
+	CacheStats before;
+	CacheStats after;
+	uint64_t vertices_before = 0;
+	uint64_t vertices_after = 0;
+	uint64_t clusters = 0;
+	std::chrono::microseconds time {0};
+    };
+
+    /**
+     * Simulates FIFO cache of `cache_size` entries over `indices`.
+     */
+    static CacheStats analyze(std::span<const uint32_t> indices, size_t vertex_count,
+	    uint32_t cache_size = fifo_size) {
+	CacheStats stats = {.triangles = indices.size() / 3};
+	std::vector<uint32_t> timestamps(vertex_count, 0);
+	std::vector<bool> used(vertex_count, false);
+	uint32_t time = cache_size + 1;
+	for(auto index: indices) {
+	    if(!used[index]) {
+		used[index] = true;
+		stats.vertices++;
+	    }
+	    // Entry is still cached if fewer than `cache_size` misses happened since it was inserted.
+	    if(time - timestamps[index] > cache_size) {
+		timestamps[index] = time++;
+		stats.misses++;
+	    }
+	}
+	return stats;
+    }
+
+    /**
+     * Merges bytewise identical vertices and compacts them to the front of `vertices`.
+     *
+     * @return Number of unique vertices.
+     */
+    template<typename Vertex>
+    static size_t deduplicate(std::span<uint32_t> indices, std::span<Vertex> vertices) {
+	auto bytes = [&](size_t i) {
+	    return std::string_view{reinterpret_cast<const char*>(&vertices[i]), sizeof(Vertex)};
+	};
+	std::vector<uint32_t> remap(vertices.size());
+	std::unordered_map<std::string_view, uint32_t> unique;
+	unique.reserve(vertices.size());
+	std::vector<Vertex> compacted;
+	compacted.reserve(vertices.size());
+	for(size_t i = 0; i < vertices.size(); i++) {
+	    auto [it, added] = unique.try_emplace(bytes(i), compacted.size());
+	    if(added) compacted.push_back(vertices[i]);
+	    remap[i] = it->second;
+	}
+	for(auto& index: indices) index = remap[index];
+	std::copy(compacted.begin(), compacted.end(), vertices.begin());
+	return compacted.size();
+    }
+
+    /**
+     * Reorders triangles for post transform cache with Forsyth's linear speed algorithm:
+     * greedily emits triangle with best score, scored by its vertices' cache positions and remaining valence.
+     */
+    static void optimize_vertex_cache(std::span<uint32_t> indices, size_t vertex_count) {
+	size_t triangle_count = indices.size() / 3;
+	if(triangle_count == 0) return;
+	auto vertex_score = [](int32_t position, uint32_t valence) {
+	    if(valence == 0) return -1.0f;
+	    float score = 0.0f;
+	    // Vertices of last triangle get fixed score, so the next one doesn't simply repeat its edge.
+	    if(position >= 3) score = std::pow(1.0f - (float)(position - 3) / (lru_size - 3), 1.5f);
+	    else if(position >= 0) score = 0.75f;
+	    return score + 2.0f / std::sqrt((float)valence);
+	};
+
+	// Triangles of every vertex, packed by offsets.
+	std::vector<uint32_t> valence(vertex_count, 0);
+	for(auto index: indices) valence[index]++;
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for(size_t i = 0; i < vertex_count; i++) offsets[i + 1] = offsets[i] + valence[i];
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+	for(size_t i = 0; i < indices.size(); i++) adjacency[filled[indices[i]]++] = i / 3;
+
+	std::vector<int32_t> cache_position(vertex_count, -1);
+	std::vector<float> score(vertex_count);
+	for(size_t i = 0; i < vertex_count; i++) score[i] = vertex_score(-1, valence[i]);
+	std::vector<float> triangle_score(triangle_count);
+	for(size_t t = 0; t < triangle_count; t++)
+	    triangle_score[t] = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+	std::vector<bool> emitted(triangle_count, false);
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	std::vector<uint32_t> cache, next_cache;
+	size_t cursor = 0;
+	int64_t best = 0;
+	for(size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+	    // No cached vertex has triangles left, continue with first remaining one.
+	    if(best < 0) {
+		while(emitted[cursor]) cursor++;
+		best = cursor;
+	    }
+	    emitted[best] = true;
+	    uint32_t triangle[3] = {indices[best*3], indices[best*3+1], indices[best*3+2]};
+	    output.insert(output.end(), triangle, triangle + 3);
+
+	    next_cache.assign(triangle, triangle + 3);
+	    for(auto vertex: cache)
+		if(vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) next_cache.push_back(vertex);
+	    for(auto vertex: triangle) {
+		// Emitted triangle no longer counts towards valence of its vertices.
+		auto begin = adjacency.begin() + offsets[vertex];
+		auto end = begin + valence[vertex];
+		*std::find(begin, end, (uint32_t)best) = *(end - 1);
+		valence[vertex]--;
+	    }
+	    for(size_t i = 0; i < next_cache.size(); i++) {
+		auto vertex = next_cache[i];
+		cache_position[vertex] = i < (size_t)lru_size ? (int32_t)i : -1;
+		score[vertex] = vertex_score(cache_position[vertex], valence[vertex]);
+	    }
+	    if(next_cache.size() > (size_t)lru_size) next_cache.resize(lru_size);
+	    std::swap(cache, next_cache);
+
+	    best = -1;
+	    float best_score = -1.0f;
+	    for(auto vertex: cache) {
+		for(uint32_t i = 0; i < valence[vertex]; i++) {
+		    auto t = adjacency[offsets[vertex] + i];
+		    triangle_score[t] = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+		    if(triangle_score[t] > best_score) {
+			best_score = triangle_score[t];
+			best = t;
+		    }
+		}
+	    }
+	}
+	std::copy(output.begin(), output.end(), indices.begin());
+    }
+
+    /**
+     * Reorders clusters of cache optimized triangles so outer, outward facing ones come first and occlude the rest.
+     *
+     * Clusters start at triangles missing cache with all vertices, so their inner order and cache efficiency is kept.
+     *
+     * @return Number of clusters.
+     */
+    template<typename Vertex>
+    static size_t optimize_overdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices) {
+	size_t triangle_count = indices.size() / 3;
+	if(triangle_count == 0) return 0;
+	std::vector<size_t> clusters;
+	{
+	    std::vector<uint32_t> timestamps(vertices.size(), 0);
+	    uint32_t time = fifo_size + 1;
+	    for(size_t t = 0; t < triangle_count; t++) {
+		uint32_t misses = 0;
+		for(size_t i = t*3; i < t*3 + 3; i++) {
+		    if(time - timestamps[indices[i]] > fifo_size) {
+			timestamps[indices[i]] = time++;
+			misses++;
+		    }
+		}
+		if(t == 0 || misses == 3) clusters.push_back(t);
+	    }
+	}
+	clusters.push_back(triangle_count);
+	if(clusters.size() <= 2) return 1;
+
+	glm::vec3 center {0.0f};
+	for(auto& vertex: vertices) center += vertex.position;
+	center /= (float)vertices.size();
+	std::vector<std::pair<float, size_t>> order(clusters.size() - 1);
+	for(size_t c = 0; c + 1 < clusters.size(); c++) {
+	    // Area weighted centroid and normal of the cluster.
+	    glm::vec3 centroid {0.0f}, normal {0.0f};
+	    float area = 0.0f;
+	    for(size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+		auto& a = vertices[indices[t*3]].position;
+		auto& b = vertices[indices[t*3+1]].position;
+		auto& d = vertices[indices[t*3+2]].position;
+		auto cross = glm::cross(b - a, d - a);
+		float triangle_area = glm::length(cross);
+		centroid += (a + b + d) * (triangle_area / 3.0f);
+		normal += cross;
+		area += triangle_area;
+	    }
+	    if(area > 0.0f) centroid /= area;
+	    float length = glm::length(normal);
+	    order[c] = {length > 0.0f ? glm::dot(centroid - center, normal / length) : 0.0f, c};
+	}
+	std::stable_sort(order.begin(), order.end(), [](auto& a, auto& b) { return a.first > b.first; });
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for(auto [_, c]: order)
+	    output.insert(output.end(), indices.begin() + clusters[c]*3, indices.begin() + clusters[c + 1]*3);
+	std::copy(output.begin(), output.end(), indices.begin());
+	return order.size();
+    }
+
+    /**
+     * Reorders vertices in order of their first use by `indices`, so vertex fetches walk memory linearly.
+     * Unreferenced vertices are dropped.
+     *
+     * @return Number of referenced vertices.
+     */
+    template<typename Vertex>
+    static size_t optimize_vertex_fetch(std::span<uint32_t> indices, std::span<Vertex> vertices) {
+	constexpr uint32_t unused = UINT32_MAX;
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for(auto& index: indices) {
+	    if(remap[index] == unused) {
+		remap[index] = ordered.size();
+		ordered.push_back(vertices[index]);
+	    }
+	    index = remap[index];
+	}
+	std::copy(ordered.begin(), ordered.end(), vertices.begin());
+	return ordered.size();
+    }
+
+    /**
+     * Simplifies mesh by clustering vertices into grid of `cell` sized cubes, every cluster collapses into
+     * its member closest to their average and triangles that collapsed are dropped.
+     *
+     * Indices still refer to `vertices`, so simplified mesh shares vertex buffer with the original.
+     * Collapsed vertices move at most by the cell diagonal.
+     *
+     * @return Indices of simplified mesh, empty if nothing is left.
+     */
+    template<typename Vertex>
+    static std::vector<uint32_t> simplify(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+	    float cell) {
+	glm::vec3 min {std::numeric_limits<float>::max()};
+	for(auto index: indices) min = glm::min(min, vertices[index].position);
+	auto key = [&](glm::vec3 position) {
+	    auto grid = glm::uvec3((position - min) / cell);
+	    return (uint64_t)(grid.x & 0x1fffff) | (uint64_t)(grid.y & 0x1fffff) << 21
+		| (uint64_t)(grid.z & 0x1fffff) << 42;
+	};
+	struct Cluster {
+	    glm::vec3 sum {0.0f};
+	    uint32_t count = 0;
+	    uint32_t representative = UINT32_MAX;
+	    float distance = std::numeric_limits<float>::max();
+	};
+	std::unordered_map<uint64_t, Cluster> clusters;
+	std::vector<uint64_t> keys(vertices.size(), 0);
+	std::vector<bool> used(vertices.size(), false);
+	for(auto index: indices) {
+	    if(used[index]) continue;
+	    used[index] = true;
+	    keys[index] = key(vertices[index].position);
+	    auto& cluster = clusters[keys[index]];
+	    cluster.sum += vertices[index].position;
+	    cluster.count++;
+	}
+	for(uint32_t i = 0; i < vertices.size(); i++) {
+	    if(!used[i]) continue;
+	    auto& cluster = clusters[keys[i]];
+	    float distance = glm::length(vertices[i].position - cluster.sum / (float)cluster.count);
+	    if(distance < cluster.distance) {
+		cluster.distance = distance;
+		cluster.representative = i;
+	    }
+	}
+	std::vector<uint32_t> output;
+	for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+	    uint32_t a = clusters[keys[indices[i]]].representative;
+	    uint32_t b = clusters[keys[indices[i + 1]]].representative;
+	    uint32_t c = clusters[keys[indices[i + 2]]].representative;
+	    if(a == b || b == c || a == c) continue;
+	    output.insert(output.end(), {a, b, c});
+	}
+	return output;
+    }
+
+    /**
+     * Greedily splits triangles in index order into meshlets, so cache optimized meshes keep neighbouring triangles
+     * together. Vertex list entries are local to `vertices`, meshlet offsets are relative to the passed lists.
+     */
+    template<typename Vertex>
+    static void build_meshlets(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+	    std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshlet_vertices,
+	    std::vector<uint32_t>& meshlet_triangles) {
+	constexpr uint8_t unused = 0xff;
+	std::vector<uint8_t> local(vertices.size(), unused);
+	Meshlet meshlet = {
+	    .vertex_offset = (uint32_t)meshlet_vertices.size(),
+	    .triangle_offset = (uint32_t)meshlet_triangles.size(),
+	};
+	auto finish = [&] {
+	    if(meshlet.triangle_count == 0) return;
+	    for(uint32_t i = 0; i < meshlet.vertex_count; i++)
+		local[meshlet_vertices[meshlet.vertex_offset + i]] = unused;
+	    compute_bounds(meshlet, meshlet_vertices, meshlet_triangles, vertices);
+	    meshlets.push_back(meshlet);
+	    meshlet = {
+		.vertex_offset = (uint32_t)meshlet_vertices.size(),
+		.triangle_offset = (uint32_t)meshlet_triangles.size(),
+	    };
+	};
+	for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+	    uint32_t added = 0;
+	    for(size_t j = i; j < i + 3; j++)
+		if(local[indices[j]] == unused && std::find(indices.begin() + i, indices.begin() + j, indices[j])
+			== indices.begin() + j) added++;
+	    if(meshlet.vertex_count + added > max_meshlet_vertices
+		    || meshlet.triangle_count == max_meshlet_triangles) finish();
+	    uint32_t triangle = 0;
+	    for(size_t j = i; j < i + 3; j++) {
+		auto& slot = local[indices[j]];
+		if(slot == unused) {
+		    slot = meshlet.vertex_count++;
+		    meshlet_vertices.push_back(indices[j]);
+		}
+		triangle |= (uint32_t)slot << (8 * (j - i));
+	    }
+	    meshlet_triangles.push_back(triangle);
+	    meshlet.triangle_count++;
+	}
+	finish();
+    }
+
+    /**
+     * Computes bounding sphere and normal cone of `meshlet` in the space of `vertices`.
+     */
+    template<typename Vertex>
+    static void compute_bounds(Meshlet& meshlet, const std::vector<uint32_t>& meshlet_vertices,
+	    const std::vector<uint32_t>& meshlet_triangles, std::span<const Vertex> vertices) {
+	auto position = [&](uint32_t local) {
+	    return vertices[meshlet_vertices[meshlet.vertex_offset + local]].position;
+	};
+	glm::vec3 min {std::numeric_limits<float>::max()}, max {std::numeric_limits<float>::lowest()};
+	for(uint32_t i = 0; i < meshlet.vertex_count; i++) {
+	    min = glm::min(min, position(i));
+	    max = glm::max(max, position(i));
+	}
+	auto center = (min + max) * 0.5f;
+	float radius = 0.0f;
+	for(uint32_t i = 0; i < meshlet.vertex_count; i++)
+	    radius = std::max(radius, glm::length(position(i) - center));
+	meshlet.sphere = glm::vec4(center, radius);
+
+	std::vector<glm::vec3> normals;
+	glm::vec3 axis {0.0f};
+	for(uint32_t t = 0; t < meshlet.triangle_count; t++) {
+	    auto packed = meshlet_triangles[meshlet.triangle_offset + t];
+	    auto a = position(packed & 0xff), b = position(packed >> 8 & 0xff), c = position(packed >> 16 & 0xff);
+	    auto normal = glm::cross(b - a, c - a);
+	    float area = glm::length(normal);
+	    // Degenerate triangles are never rasterized, so they don't constrain the cone.
+	    if(area == 0.0f) continue;
+	    normals.push_back(normal / area);
+	    axis += normal;
+	}
+	meshlet.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	float length = glm::length(axis);
+	if(length == 0.0f) return;
+	axis /= length;
+	float min_dot = 1.0f;
+	for(auto& normal: normals) min_dot = std::min(min_dot, glm::dot(axis, normal));
+	// Cone wider than ~84 degrees would almost never cull, keep test disabled.
+	if(min_dot <= 0.1f) return;
+	meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - min_dot * min_dot));
+    }
+
+    /**
+     * True if every triangle of `meshlet` faces away from `camera`, both in the same space as meshlet bounds.
+     * Uses bounding sphere instead of cone apex, so it stays conservative for any camera position.
+     */
+    static bool cone_culled(const Meshlet& meshlet, glm::vec3 camera) {
+	auto direction = glm::vec3(meshlet.sphere) - camera;
+	return glm::dot(direction, glm::vec3(meshlet.cone))
+	    >= meshlet.cone.w * glm::length(direction) + meshlet.sphere.w;
+    }
+
+    /**
+     * Runs all passes on one primitive and accumulates `stats`.
+     *
+     * @return Number of vertices left at the front of `vertices`.
+     */
+    template<typename Vertex>
+    static size_t optimize(std::span<uint32_t> indices, std::span<Vertex> vertices, Stats& stats) {
+	auto start = std::chrono::high_resolution_clock::now();
+	stats.vertices_before += vertices.size();
+	stats.before += analyze(indices, vertices.size());
+	size_t count = deduplicate(indices, vertices);
+	optimize_vertex_cache(indices, count);
+	stats.clusters += optimize_overdraw(indices, std::span<const Vertex>(vertices.first(count)));
+	count = optimize_vertex_fetch(indices, vertices.first(count));
+	stats.vertices_after += count;
+	stats.after += analyze(indices, count);
+	stats.time += std::chrono::duration_cast<std::chrono::microseconds>
+	    (std::chrono::high_resolution_clock::now() - start);
+	return count;
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <vb.h>
+#include "gltf_pbr.h"
+
+/**
+ * Mesh shading of `GLTF` meshlets with `VK_EXT_mesh_shader`.
+ *
+ * Task shader workgroups cull up to 32 meshlets of one draw against view frustum and normal cone,
+ * mesh shader workgroups decode `GLTF::PackedVertex` of surviving meshlets and emit their triangles.
+ * Every draw is its own indirect command with only as many task workgroups as its meshlets need.
+ * Descriptor set of this struct goes to set 2 of pipeline with pbr.task and pbr.mesh, after bindless and view sets.
+ */
+struct MeshShading {
+    vb::Context* ctx;
+    static constexpr uint32_t meshlets_per_task = 32;
+
+    vb::DescriptorPool pool;
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorSet set;
+    // `VkDrawMeshTasksIndirectCommandEXT` of every draw, selected in task shader by `gl_DrawID`.
+    vb::Buffer commands;
+    uint32_t draw_count {0};
+    uint32_t max_draw_count {0};
+    // Task workgroups summed over all draws.
+    uint64_t task_groups {0};
+
+    MeshShading(vb::Context* context): ctx{context}, pool{context}, commands{context} {}
+
+    /**
+     * @param mesh Loaded `GLTF` with packed vertices and meshlets.
+     * @param view Uniform buffer with `View` that the scene is rendered with.
+     */
+    void create(GLTF& mesh, vb::Buffer& view) {
+	assert(mesh.packed_vertices && mesh.meshlets.all_valid());
+	assert(mesh.draw_meshlets.size() == mesh.draw_count);
+	draw_count = mesh.draw_count;
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(ctx->physical_device, &properties);
+	max_draw_count = properties.limits.maxDrawIndirectCount;
+	std::vector<VkDrawMeshTasksIndirectCommandEXT> draw_commands;
+	draw_commands.reserve(draw_count);
+	for(auto meshlets: mesh.draw_meshlets) {
+	    // Draw without meshlets gets zero workgroups and launches nothing.
+	    uint32_t groups = (meshlets + meshlets_per_task - 1) / meshlets_per_task;
+	    draw_commands.push_back({groups, 1, 1});
+	    task_groups += groups;
+	}
+	size_t commands_size = draw_commands.size() * sizeof(VkDrawMeshTasksIndirectCommandEXT);
+	commands.create(commands_size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	assert(commands.all_valid());
+	assert(commands.upload(draw_commands.data(), commands_size));
+
+	VkDescriptorPoolSize sizes[2] = {
+	    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5},
+	};
+	pool.create(sizes, 1);
+	assert(pool.all_valid());
+	auto stages = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+	pool.add_binding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stages, 0);
+	for(uint32_t i = 1; i <= 5; i++) pool.add_binding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stages, i);
+	set_layout = pool.create_layout();
+	assert(set_layout);
+	set = pool.create_set(set_layout);
+	assert(set);
+
+	VkDescriptorBufferInfo infos[6] = {
+	    {view.buffer, 0, VK_WHOLE_SIZE},
+	    {mesh.draws.buffer, 0, VK_WHOLE_SIZE},
+	    {mesh.meshlets.buffer, 0, VK_WHOLE_SIZE},
+	    {mesh.meshlet_vertices.buffer, 0, VK_WHOLE_SIZE},
+	    {mesh.meshlet_triangles.buffer, 0, VK_WHOLE_SIZE},
+	    {mesh.vertices.buffer, 0, VK_WHOLE_SIZE},
+	};
+	VkWriteDescriptorSet writes[6];
+	for(uint32_t i = 0; i < 6; i++) {
+	    writes[i] = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = set,
+		.dstBinding = i,
+		.descriptorCount = 1,
+		.descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = &infos[i],
+	    };
+	}
+	vkUpdateDescriptorSets(ctx->device, 6, writes, 0, nullptr);
+    }
+
+    /**
+     * Records indirect task dispatches of every draw, with pipeline and its sets 0 and 1 already bound.
+     *
+     * @return Number of recorded `vkCmdDrawMeshTasksIndirectEXT` calls.
+     */
+    uint32_t record(VkCommandBuffer cmd, VkPipelineLayout layout) {
+	if(draw_count == 0 || task_groups == 0) return 0;
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 2, 1, &set, 0, nullptr);
+	constexpr uint32_t stride = sizeof(VkDrawMeshTasksIndirectCommandEXT);
+	uint32_t calls = 0;
+	// `gl_DrawID` restarts with every call, so draws past the first call are offset through push constant.
+	for(uint32_t first = 0; first < draw_count; first += max_draw_count) {
+	    auto count = std::min(draw_count - first, max_draw_count);
+	    vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_TASK_BIT_EXT, 0, sizeof(first), &first);
+	    vkCmdDrawMeshTasksIndirectEXT(cmd, commands.buffer, (VkDeviceSize)first * stride, count, stride);
+	    calls++;
+	}
+	return calls;
+    }
+
+    void clean() {
+	commands.clean();
+	pool.clean_layout(set_layout);
+	pool.clean();
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/packing.hpp>
+
+/**
+ * Quantized glTF vertex, 20 bytes instead of 48.
+ *
+ * Position is 16 bit unorm inside bounds of its mesh, with tangent handedness in `w`.
+ * Normal and tangent are octahedral encoded 16 bit snorm, uv is half float.
+ * Decoded in pbr_packed.vert and pbr_indirect_packed.vert.
+ *
+ * Vertex types need `position`, `normal`, `uv_x`, `uv_y` and `tangent` members like `GLTF::Vertex`.
+ */
+struct PackedVertex {
+    uint16_t position[4];
+    uint32_t normal;
+    uint32_t tangent;
+    uint32_t uv;
+
+    template<typename Vertex>
+    static PackedVertex pack(const Vertex& vertex, glm::vec3 offset, glm::vec3 scale) {
+	PackedVertex packed;
+	auto position = glm::clamp((vertex.position - offset) / scale, 0.0f, 1.0f);
+	for(int i = 0; i < 3; i++) packed.position[i] = std::round(position[i] * 65535.0f);
+	packed.position[3] = vertex.tangent.w < 0.0f ? 0 : 65535;
+	packed.normal = glm::packSnorm2x16(oct_encode(vertex.normal));
+	packed.tangent = glm::packSnorm2x16(oct_encode(glm::vec3(vertex.tangent)));
+	packed.uv = glm::packHalf2x16({vertex.uv_x, vertex.uv_y});
+	return packed;
+    }
+
+    template<typename Vertex>
+    Vertex unpack(glm::vec3 offset, glm::vec3 scale) const {
+	auto uv = glm::unpackHalf2x16(this->uv);
+	return {
+	    .position = offset + glm::vec3(position[0], position[1], position[2]) / 65535.0f * scale,
+	    .uv_x = uv.x,
+	    .normal = oct_decode(glm::unpackSnorm2x16(normal)),
+	    .uv_y = uv.y,
+	    .tangent = glm::vec4(oct_decode(glm::unpackSnorm2x16(tangent)), position[3] ? 1.0f : -1.0f),
+	};
+    }
+
+    // Projects direction onto octahedron unfolded into [-1, 1] square. Zero vector maps to +Z.
+    static glm::vec2 oct_encode(glm::vec3 n) {
+	float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if(sum == 0.0f) return glm::vec2(0.0f);
+	n /= sum;
+	glm::vec2 p {n.x, n.y};
+	if(n.z < 0.0f) {
+	    auto sign = glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+	    p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign;
+	}
+	return p;
+    }
+
+    static glm::vec3 oct_decode(glm::vec2 p) {
+	glm::vec3 n {p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y)};
+	float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+    }
+};
+static_assert(sizeof(PackedVertex) == 20);
+
+/**
+ * Largest round trip error of packed attributes.
+ *
+ * Position error is relative to mesh extent on each axis. Quantization alone keeps it under half a step,
+ * `0.5 / 65535`, but float rounding of `offset + position * scale` adds about an ulp of the offset,
+ * which dominates for small meshes far from the origin.
+ * Normal and tangent errors are distances between unit vectors, uv error is relative to uv magnitude.
+ * Half floats can't hold uvs beyond 65504, those are counted in `uv_overflows` instead.
+ */
+struct PackingError {
+    float position = 0.0f;
+    float normal = 0.0f;
+    float tangent = 0.0f;
+    float uv = 0.0f;
+    uint64_t uv_overflows = 0;
+
+    template<typename Vertex>
+    void add(const Vertex& original, const Vertex& unpacked, glm::vec3 scale) {
+	auto error = glm::abs(unpacked.position - original.position) / scale;
+	position = std::max({position, error.x, error.y, error.z});
+	// Zero vectors have no direction to keep.
+	auto direction_error = [](glm::vec3 decoded, glm::vec3 source) {
+	    if(glm::length(source) == 0.0f) return 0.0f;
+	    return glm::length(decoded - glm::normalize(source));
+	};
+	normal = std::max(normal, direction_error(unpacked.normal, original.normal));
+	tangent = std::max(tangent, direction_error(glm::vec3(unpacked.tangent), glm::vec3(original.tangent)));
+	// Half float keeps 11 significant bits, values under 1 / 16384 are denormal and have fixed precision.
+	auto add_uv = [&](float packed, float value) {
+	    if(std::isinf(packed) && !std::isinf(value)) uv_overflows++;
+	    else uv = std::max(uv, std::abs(packed - value) / std::max(std::abs(value), 1.0f / 16384.0f));
+	};
+	add_uv(unpacked.uv_x, original.uv_x);
+	add_uv(unpacked.uv_y, original.uv_y);
+    }
+};
@@ -4,13 +4,6 @@
 #include <vulkan/vulkan_core.h>
 #include <fstream>
 
-struct Frame {
-    VkCommandBuffer cmd;
-    VkSemaphore image_available;
-    VkSemaphore finish_render;
-    VkFence render;
-};
-
 int main(int argc, char** argv) {
     VkPhysicalDeviceShaderObjectFeaturesEXT shader_objects = {
 	.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT,
@@ -23,6 +16,7 @@ int main(int argc, char** argv) {
     assert(vbc.create_instance_window(iwinfo));
     vb::ContextDeviceInfo dinfo = {
 	.required_extensions = {VK_EXT_SHADER_OBJECT_EXTENSION_NAME},
+	.vk12features = {.timelineSemaphore = VK_TRUE},
 	.vk13features = {
 	    .pNext = &shader_objects,
 	    .dynamicRendering = VK_TRUE,
@@ -70,24 +64,12 @@ int main(int argc, char** argv) {
     vertex_shader = shs[0];
     fragment_shader = shs[1];
 
-    auto frames_cmdpool = vb::CommandPool(&vbc);
-    frames_cmdpool.create(graphics_queue->index);
-    assert(frames_cmdpool.all_valid());
-    std::vector<Frame> frames(vbc.swapchain_image_views.size());
-    for(auto& frame: frames) {
-        frame.cmd = frames_cmdpool.allocate();
-        assert(frame.cmd);
-        frame.finish_render = vb::create_semaphore(vbc.device);
-        assert(frame.finish_render);
-        frame.image_available = vb::create_semaphore(vbc.device);
-        assert(frame.image_available);
-        frame.render = vb::create_fence(vbc.device, VK_FENCE_CREATE_SIGNALED_BIT);
-        assert(frame.render);
-    }
+    auto frames = vb::FrameRing(&vbc);
+    frames.create(graphics_queue->index);
+    assert(frames.all_valid());
 
     bool running = true;
     bool resize = false;
-    uint8_t frame_index = 0;
     SDL_Event event;
     while(running) {
 	while(SDL_PollEvent(&event) != 0) {
@@ -105,17 +87,10 @@ int main(int argc, char** argv) {
 	    }
 	}
 
-	auto frame = &frames[frame_index%frames.size()];
-	assert(vkWaitForFences(vbc.device, 1, &frame->render, VK_TRUE, UINT64_MAX)
-		== VK_SUCCESS);
-	auto next = vbc.acquire_next_image(frame->image_available);
+	auto next = frames.begin();
 	if(!next.has_value()) continue;
 	uint32_t image_index = next.value();
-	vkResetFences(vbc.device, 1, &frame->render);
-
- 	vkResetCommandBuffer(frame->cmd, 0);
- 	VkCommandBufferBeginInfo begin {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
- 	assert(vkBeginCommandBuffer(frame->cmd, &begin) == VK_SUCCESS);
+	auto frame = &frames.current();
 
 	VkViewport viewport {0.0f, 0.0f, (float)vbc.swapchain_extent.width, (float)vbc.swapchain_extent.height};
 	VkRect2D scissor {{0,0}, vbc.swapchain_extent};
@@ -177,40 +152,11 @@ int main(int argc, char** argv) {
 	vb::transition_image(frame->cmd, vbc.swapchain_images[image_index],
 	    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
-	assert(vkEndCommandBuffer(frame->cmd) == VK_SUCCESS);
- 	VkPipelineStageFlags wait[1] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
- 	VkSubmitInfo submit = {
- 	    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
- 	    .waitSemaphoreCount = 1,
- 	    .pWaitSemaphores = &frame->image_available,
- 	    .pWaitDstStageMask = wait,
- 	    .commandBufferCount = 1,
- 	    .pCommandBuffers = &frame->cmd,
- 	    .signalSemaphoreCount = 1,
- 	    .pSignalSemaphores = &frame->finish_render,
- 	};
- 	assert(vkQueueSubmit(graphics_queue->queue, 1, &submit, frame->render) == VK_SUCCESS);
- 
- 	VkPresentInfoKHR present = {
- 	    .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
- 	    .waitSemaphoreCount = 1,
- 	    .pWaitSemaphores = &frame->finish_render,
- 	    .swapchainCount = 1,
- 	    .pSwapchains = &vbc.swapchain,
- 	    .pImageIndices = &image_index,
- 	};
- 	vkQueuePresentKHR(graphics_queue->queue, &present);
-
-	frame_index++;
+	assert(frames.end(graphics_queue->queue));
     }
     vkDeviceWaitIdle(vbc.device);
 
     vkDestroyShaderEXT(vbc.device, vertex_shader, nullptr);
     vkDestroyShaderEXT(vbc.device, fragment_shader, nullptr);
-    for(auto& frame: frames) {
-	vkDestroySemaphore(vbc.device, frame.image_available, nullptr);
-	vkDestroySemaphore(vbc.device, frame.finish_render, nullptr);
-	vkDestroyFence(vbc.device, frame.render, nullptr);
-    }
-    frames_cmdpool.clean();
+    frames.clean();
 }
@@ -1 +1,5 @@
-glslc $1 -o $1.spv
+# Mesh shading needs SPIR-V 1.4.
+case $1 in
+    *.task|*.mesh) glslc --target-spv=spv1.4 $1 -o $1.spv ;;
+    *) glslc $1 -o $1.spv ;;
+esac
@@ -0,0 +1,39 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec3 inWPos;
+layout(location = 1) in vec2 inUV;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in vec4 inTangent;
+layout(location = 4) flat in uint inMaterial;
+
+layout (location = 0) out vec4 outColor;
+
+struct Material {
+    uint color;
+    uint rough_metal;
+    uint normal;
+    uint pad;
+};
+
+// Every texture of the scene lives in one array, materials select theirs by index.
+layout(std430, set = 0, binding = 0) readonly buffer Materials {
+    Material materials[];
+} materials;
+
+layout(set = 0, binding = 1) uniform sampler2D textures[];
+
+#include "pbr.glsl"
+
+// Draws of different materials can share a subgroup, so the index isn't uniform.
+vec4 sample_texture(uint index, vec2 uv) {
+    return texture(textures[nonuniformEXT(index)], uv);
+}
+
+void main() {
+    Material material = materials.materials[inMaterial];
+    vec4 color = sample_texture(material.color, inUV);
+    if(color.a < 1.0) discard;
+    outColor = shade(color, sample_texture(material.rough_metal, inUV));
+}
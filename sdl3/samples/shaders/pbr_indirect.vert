@@ -0,0 +1,51 @@
+#version 450
+
+layout(location = 0) in vec3 inPos;
+layout(location = 1) in float inUvX;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in float inUvY;
+layout(location = 4) in vec4 inTangent;
+
+layout(location = 0) out vec3 outWPos;
+layout(location = 1) out vec2 outUV;
+layout(location = 2) out vec3 outNormal;
+layout(location = 3) out vec4 outTangent;
+layout(location = 4) flat out uint outMaterial;
+
+layout(set = 1, binding = 0) uniform View {
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} view;
+
+struct Draw {
+    mat4 model;
+    mat4 inverse_model;
+    uint material;
+    uint first_index;
+    uint index_count;
+    uint batch;
+    vec4 sphere;
+    vec4 position_offset;
+    vec4 position_scale;
+    uvec4 lod_first;
+    uvec4 lod_count;
+    vec4 lod_error;
+    uint first_meshlet;
+    uint meshlet_count;
+};
+
+// Indirect commands store their own index in firstInstance, so gl_InstanceIndex selects the draw.
+layout(std430, set = 1, binding = 2) readonly buffer Draws {
+    Draw draws[];
+} draws;
+
+void main() {
+    mat4 model = draws.draws[gl_InstanceIndex].model;
+    outWPos = vec3(model * vec4(inPos, 1.0));
+    outUV = vec2(inUvX, inUvY);
+    outNormal = mat3(model) * inNormal;
+    outTangent = inTangent;
+    outMaterial = draws.draws[gl_InstanceIndex].material;
+    gl_Position = view.projection * view.view * vec4(outWPos, 1.0);
+}
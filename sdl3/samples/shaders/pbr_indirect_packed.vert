@@ -0,0 +1,60 @@
+#version 450
+
+// GLTF::PackedVertex: position in mesh bounds with tangent handedness in w,
+// octahedral normal and tangent, half float uv.
+layout(location = 0) in vec4 inPos;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inTangent;
+layout(location = 3) in vec2 inUV;
+
+layout(location = 0) out vec3 outWPos;
+layout(location = 1) out vec2 outUV;
+layout(location = 2) out vec3 outNormal;
+layout(location = 3) out vec4 outTangent;
+layout(location = 4) flat out uint outMaterial;
+
+layout(set = 1, binding = 0) uniform View {
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} view;
+
+struct Draw {
+    mat4 model;
+    mat4 inverse_model;
+    uint material;
+    uint first_index;
+    uint index_count;
+    uint batch;
+    vec4 sphere;
+    vec4 position_offset;
+    vec4 position_scale;
+    uvec4 lod_first;
+    uvec4 lod_count;
+    vec4 lod_error;
+    uint first_meshlet;
+    uint meshlet_count;
+};
+
+// Indirect commands store their own index in firstInstance, so gl_InstanceIndex selects the draw.
+layout(std430, set = 1, binding = 2) readonly buffer Draws {
+    Draw draws[];
+} draws;
+
+vec3 oct_decode(vec2 p) {
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+void main() {
+    Draw draw = draws.draws[gl_InstanceIndex];
+    vec3 position = draw.position_offset.xyz + inPos.xyz * draw.position_scale.xyz;
+    outWPos = vec3(draw.model * vec4(position, 1.0));
+    outUV = inUV;
+    outNormal = mat3(draw.model) * oct_decode(inNormal);
+    outTangent = vec4(oct_decode(inTangent), inPos.w * 2.0 - 1.0);
+    outMaterial = draw.material;
+    gl_Position = view.projection * view.view * vec4(outWPos, 1.0);
+}
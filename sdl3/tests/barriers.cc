@@ -0,0 +1,102 @@
+#include <chrono>
+#include <format>
+#include <memory>
+#include <vector>
+#include "headless.h"
+
+constexpr uint32_t image_count = 32;
+constexpr uint32_t size = 256;
+constexpr uint32_t rounds = 64;
+constexpr uint32_t runs = 3;
+
+static const VkImageSubresourceRange color_range = {
+    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .levelCount = 1,
+    .layerCount = 1,
+};
+
+// Clears every image and moves it to sampled layout and back, `rounds` times, with `transition` recording
+// layout changes of all images.
+template<typename Fn>
+static void record_rounds(VkCommandBuffer cmd, std::vector<std::unique_ptr<vb::Image>>& images, Fn&& transition) {
+    const VkClearColorValue clear = {.float32 = {0.25f, 0.5f, 0.75f, 1.0f}};
+    transition(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    for(uint32_t round = 0; round < rounds; round++) {
+	for(auto& image: images)
+	    vkCmdClearColorImage(cmd, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear, 1, &color_range);
+	transition(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	transition(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    }
+}
+
+// Times transitions recorded as one full pipeline barrier per image, like `vb::transition_image`,
+// against one `vb::Barriers` batch per round with stages derived from layouts.
+static void batched_against_per_image(Headless& headless) {
+    auto& vbc = headless.vbc;
+    std::vector<std::unique_ptr<vb::Image>> images;
+    for(uint32_t i = 0; i < image_count; i++) {
+	images.push_back(std::make_unique<vb::Image>(&vbc));
+	images.back()->create({size, size, 1}, false, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	CHECK(images.back()->all_valid());
+    }
+
+    double legacy_ms = 1e9, batched_ms = 1e9, legacy_record_ms = 1e9, batched_record_ms = 1e9;
+    vb::Barriers barriers;
+    for(uint32_t run = 0; run < runs; run++) {
+	legacy_ms = std::min(legacy_ms, headless.gpu_ms([&](VkCommandBuffer cmd) {
+	    auto start = std::chrono::high_resolution_clock::now();
+	    record_rounds(cmd, images, [&](VkImageLayout old_layout, VkImageLayout new_layout) {
+		for(auto& image: images) vb::transition_image(cmd, image->image, old_layout, new_layout);
+	    });
+	    auto end = std::chrono::high_resolution_clock::now();
+	    legacy_record_ms = std::min(legacy_record_ms,
+		    std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0);
+	}));
+
+	barriers.stats = {};
+	batched_ms = std::min(batched_ms, headless.gpu_ms([&](VkCommandBuffer cmd) {
+	    auto start = std::chrono::high_resolution_clock::now();
+	    record_rounds(cmd, images, [&](VkImageLayout old_layout, VkImageLayout new_layout) {
+		// Nothing used the images before the first transition.
+		vb::Access previous = old_layout == VK_IMAGE_LAYOUT_UNDEFINED
+		    ? vb::Access{VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE} : vb::layout_access(old_layout);
+		for(auto& image: images) barriers.image(image->image, old_layout, new_layout, previous);
+		barriers.record(cmd);
+	    });
+	    auto end = std::chrono::high_resolution_clock::now();
+	    batched_record_ms = std::min(batched_record_ms,
+		    std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0);
+	}));
+	CHECK(barriers.stats.calls == 1 + 2 * rounds);
+	CHECK(barriers.stats.barriers == (1 + 2 * rounds) * image_count);
+    }
+    CHECK(legacy_ms >= 0.0 && batched_ms >= 0.0);
+    vb::log(std::format("{} images, {} rounds, best of {}: barrier per image {:.3f}ms ({:.3f}ms recording), "
+		"batched {:.3f}ms ({:.3f}ms recording)", image_count, rounds, runs,
+		legacy_ms, legacy_record_ms, batched_ms, batched_record_ms));
+    for(auto& image: images) image->clean();
+}
+
+// Undefined layout waits for all commands unless caller names the last users of the image.
+static void undefined_source_scope() {
+    auto image = (VkImage)(uintptr_t)1;
+    vb::Barriers barriers;
+    barriers.image(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    barriers.image(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+	    {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT});
+    CHECK(barriers.image_barriers.size() == 2);
+    CHECK(barriers.image_barriers[0].srcStageMask == VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+    CHECK(barriers.image_barriers[1].srcStageMask == VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT);
+    // Reads don't have to be made available.
+    CHECK(barriers.image_barriers[1].srcAccessMask == VK_ACCESS_2_NONE);
+    CHECK(barriers.image_barriers[1].subresourceRange.aspectMask == VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+int main() {
+    undefined_source_scope();
+    Headless headless;
+    if(!headless.valid) return test_failures ? 1 : test_skipped;
+    batched_against_per_image(headless);
+    return test_failures ? 1 : 0;
+}
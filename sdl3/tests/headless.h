@@ -0,0 +1,82 @@
+#pragma once
+#include <functional>
+#include <vb.h>
+#include "test.h"
+
+// Returned when there's no Vulkan device to run on, so CTest reports the test as skipped.
+constexpr int test_skipped = 77;
+
+/**
+ * Context without surface or swapchain for tests and benchmarks of vb on any Vulkan device.
+ *
+ * SDL runs on its offscreen video driver unless `SDL_VIDEO_DRIVER` is set, and CPU devices like lavapipe are picked
+ * when present, so results don't depend on display or GPU of the machine.
+ */
+struct Headless {
+    vb::Context vbc;
+    vb::QueueIndex* queue = nullptr;
+    vb::CommandPool cmdpool {&vbc};
+    vb::StagingRing staging_ring {&vbc};
+    bool valid = false;
+
+    Headless(vb::ContextDeviceInfo device_info = {}, VkDeviceSize staging_size = 8 * 1024 * 1024) {
+	SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+	vb::ContextInstanceWindowInfo window_info = {
+	    .title = "vb tests",
+	    .width = 64,
+	    .height = 64,
+	    .window_flags = SDL_WINDOW_HIDDEN,
+	    .vulkan_api = VK_API_VERSION_1_3,
+	};
+	device_info.preferred_device_type = VK_PHYSICAL_DEVICE_TYPE_CPU;
+	device_info.vk12features.timelineSemaphore = VK_TRUE;
+	device_info.vk13features.synchronization2 = VK_TRUE;
+	if(!vbc.init() || !vbc.create_instance_window(window_info)) return;
+	if(!vbc.create_device(device_info) || !vbc.init_vma()) return;
+	queue = vbc.find_queue(vb::Queue::Graphics);
+	if(!queue) return;
+	cmdpool.create(queue->index);
+	if(!cmdpool.all_valid()) return;
+	if(!vbc.init_command_submitter(cmdpool.allocate(), queue->queue, queue->index)) return;
+	staging_ring.create(staging_size);
+	if(!staging_ring.all_valid()) return;
+	vbc.set_staging_ring(&staging_ring);
+	valid = true;
+    }
+
+    /**
+     * Records `fn` between two timestamps and submits it, waiting for it to finish.
+     *
+     * @return GPU time between the timestamps in milliseconds, negative if it couldn't be measured.
+     */
+    double gpu_ms(std::function<void(VkCommandBuffer cmd)>&& fn) {
+	VkQueryPoolCreateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+	    .queryType = VK_QUERY_TYPE_TIMESTAMP,
+	    .queryCount = 2,
+	};
+	VkQueryPool pool;
+	if(vkCreateQueryPool(vbc.device, &info, nullptr, &pool) != VK_SUCCESS) return -1.0;
+	bool submitted = vbc.submit_command_to_queue([&](VkCommandBuffer cmd) {
+	    vkCmdResetQueryPool(cmd, pool, 0, 2);
+	    vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, pool, 0);
+	    fn(cmd);
+	    vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, pool, 1);
+	});
+	uint64_t timestamps[2] = {};
+	bool measured = submitted && vkGetQueryPoolResults(vbc.device, pool, 0, 2, sizeof(timestamps), timestamps,
+		sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS;
+	vkDestroyQueryPool(vbc.device, pool, nullptr);
+	if(!measured) return -1.0;
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vbc.physical_device, &properties);
+	return (timestamps[1] - timestamps[0]) * (double)properties.limits.timestampPeriod / 1000000.0;
+    }
+
+    ~Headless() {
+	if(!vbc.device) return;
+	vkDeviceWaitIdle(vbc.device);
+	if(staging_ring.all_valid()) staging_ring.clean();
+	if(cmdpool.all_valid()) cmdpool.clean();
+    }
+};
@@ -0,0 +1,177 @@
+#include <array>
+#include <random>
+#include "mesh_optimizer.h"
+#include "test.h"
+
+struct Vertex {
+    glm::vec3 position;
+    float pad = 0.0f;
+};
+
+using Triangle = std::array<float, 9>;
+
+// Grid of `n` by `n` quads in z = 0 plane facing +Z, every triangle has its own vertices and order is shuffled.
+static void make_grid(int n, std::vector<uint32_t>& indices, std::vector<Vertex>& vertices) {
+    std::vector<std::array<glm::vec3, 3>> triangles;
+    for(int y = 0; y < n; y++) {
+	for(int x = 0; x < n; x++) {
+	    auto a = glm::vec3(x, y, 0), b = glm::vec3(x + 1, y, 0);
+	    auto c = glm::vec3(x, y + 1, 0), d = glm::vec3(x + 1, y + 1, 0);
+	    triangles.push_back({a, b, c});
+	    triangles.push_back({b, d, c});
+	}
+    }
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1));
+    for(auto& triangle: triangles) {
+	for(auto& position: triangle) {
+	    indices.push_back(vertices.size());
+	    vertices.push_back({position});
+	}
+    }
+}
+
+// Sorted triangles by positions, each rotated to start at its smallest vertex so winding is kept.
+static std::vector<Triangle> triangle_set(std::span<const uint32_t> indices, std::span<const Vertex> vertices) {
+    std::vector<Triangle> triangles;
+    for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+	std::array<Triangle, 3> rotations;
+	for(int r = 0; r < 3; r++)
+	    for(int k = 0; k < 3; k++)
+		for(int c = 0; c < 3; c++)
+		    rotations[r][k*3 + c] = vertices[indices[i + (r + k) % 3]].position[c];
+	triangles.push_back(*std::min_element(rotations.begin(), rotations.end()));
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+// Passes reorder triangles and vertices but render the same mesh, with better cache efficiency.
+static void optimize() {
+    std::vector<uint32_t> indices;
+    std::vector<Vertex> vertices;
+    make_grid(32, indices, vertices);
+    auto before = triangle_set(indices, vertices);
+
+    MeshOptimizer::Stats stats;
+    size_t count = MeshOptimizer::optimize(std::span(indices), std::span(vertices), stats);
+    CHECK(count == 33 * 33);
+    for(auto index: indices) CHECK(index < count);
+    CHECK(triangle_set(indices, std::span<const Vertex>(vertices).first(count)) == before);
+    CHECK(stats.after.acmr() < stats.before.acmr());
+    CHECK(stats.after.acmr() < 1.0f);
+    CHECK(stats.after.atvr() < 1.5f);
+    CHECK(stats.clusters >= 1);
+}
+
+// Meshlets respect both limits and together hold every input triangle.
+static void meshlets() {
+    std::vector<uint32_t> indices;
+    std::vector<Vertex> vertices;
+    make_grid(32, indices, vertices);
+    MeshOptimizer::Stats stats;
+    size_t count = MeshOptimizer::optimize(std::span(indices), std::span(vertices), stats);
+    std::span<const Vertex> optimized = std::span<const Vertex>(vertices).first(count);
+
+    std::vector<MeshOptimizer::Meshlet> meshlets;
+    std::vector<uint32_t> meshlet_vertices, meshlet_triangles;
+    MeshOptimizer::build_meshlets(indices, optimized, meshlets, meshlet_vertices, meshlet_triangles);
+    CHECK(!meshlets.empty());
+
+    std::vector<uint32_t> rebuilt;
+    for(auto& meshlet: meshlets) {
+	CHECK(meshlet.vertex_count <= MeshOptimizer::max_meshlet_vertices);
+	CHECK(meshlet.triangle_count <= MeshOptimizer::max_meshlet_triangles);
+	CHECK(meshlet.triangle_count > 0);
+	for(uint32_t t = 0; t < meshlet.triangle_count; t++) {
+	    auto packed = meshlet_triangles[meshlet.triangle_offset + t];
+	    for(int k = 0; k < 3; k++) {
+		uint32_t local = packed >> (8 * k) & 0xff;
+		CHECK(local < meshlet.vertex_count);
+		rebuilt.push_back(meshlet_vertices[meshlet.vertex_offset + local]);
+	    }
+	}
+	// Every vertex lies inside the bounding sphere.
+	for(uint32_t i = 0; i < meshlet.vertex_count; i++) {
+	    auto position = optimized[meshlet_vertices[meshlet.vertex_offset + i]].position;
+	    CHECK(glm::length(position - glm::vec3(meshlet.sphere)) <= meshlet.sphere.w * 1.0001f);
+	}
+    }
+    CHECK(triangle_set(rebuilt, optimized) == triangle_set(indices, optimized));
+}
+
+// Coarser grid than the mesh drops collapsed triangles, finer one keeps all of them.
+static void simplify() {
+    std::vector<uint32_t> indices;
+    std::vector<Vertex> vertices;
+    make_grid(32, indices, vertices);
+    MeshOptimizer::Stats stats;
+    size_t count = MeshOptimizer::optimize(std::span(indices), std::span(vertices), stats);
+    std::span<const Vertex> optimized = std::span<const Vertex>(vertices).first(count);
+
+    auto coarse = MeshOptimizer::simplify(std::span<const uint32_t>(indices), optimized, 4.0f);
+    CHECK(coarse.size() % 3 == 0);
+    CHECK(!coarse.empty());
+    CHECK(coarse.size() < indices.size() / 4);
+    for(auto index: coarse) CHECK(index < count);
+
+    auto fine = MeshOptimizer::simplify(std::span<const uint32_t>(indices), optimized, 0.5f);
+    CHECK(fine.size() == indices.size());
+
+    auto collapsed = MeshOptimizer::simplify(std::span<const uint32_t>(indices), optimized, 100.0f);
+    CHECK(collapsed.empty());
+}
+
+// Culled meshlets only have triangles facing away from the camera, also when mesh is scaled non-uniformly
+// and camera is moved into mesh space like pbr.task does.
+static void cones() {
+    std::vector<uint32_t> indices;
+    std::vector<Vertex> vertices;
+    make_grid(32, indices, vertices);
+    // Rolling hills, so meshlets have cones of different axes and widths.
+    for(auto& vertex: vertices)
+	vertex.position.z = 0.5f * std::sin(vertex.position.x * 0.3f) * std::cos(vertex.position.y * 0.2f);
+    MeshOptimizer::Stats stats;
+    size_t count = MeshOptimizer::optimize(std::span(indices), std::span(vertices), stats);
+    std::span<const Vertex> optimized = std::span<const Vertex>(vertices).first(count);
+    std::vector<MeshOptimizer::Meshlet> meshlets;
+    std::vector<uint32_t> meshlet_vertices, meshlet_triangles;
+    MeshOptimizer::build_meshlets(indices, optimized, meshlets, meshlet_vertices, meshlet_triangles);
+
+    auto culled_count = [&](glm::vec3 camera) {
+	return std::count_if(meshlets.begin(), meshlets.end(),
+	    [&](auto& meshlet) { return MeshOptimizer::cone_culled(meshlet, camera); });
+    };
+    CHECK(culled_count({16.0f, 16.0f, 100.0f}) == 0);
+    CHECK(culled_count({16.0f, 16.0f, -100.0f}) > 0);
+
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> distribution(-64.0f, 64.0f);
+    for(glm::vec3 scale: {glm::vec3(1.0f), glm::vec3(1.0f, 1.0f, 8.0f), glm::vec3(0.1f, 4.0f, 1.0f)}) {
+	uint64_t culled = 0, wrong = 0;
+	for(int i = 0; i < 256; i++) {
+	    glm::vec3 camera {distribution(random), distribution(random), distribution(random)};
+	    for(auto& meshlet: meshlets) {
+		if(!MeshOptimizer::cone_culled(meshlet, camera / scale)) continue;
+		culled++;
+		for(uint32_t t = 0; t < meshlet.triangle_count; t++) {
+		    auto packed = meshlet_triangles[meshlet.triangle_offset + t];
+		    auto position = [&](uint32_t local) {
+			return optimized[meshlet_vertices[meshlet.vertex_offset + (local & 0xff)]].position * scale;
+		    };
+		    auto a = position(packed), b = position(packed >> 8), c = position(packed >> 16);
+		    if(glm::dot(glm::cross(b - a, c - a), a - camera) < 0.0f) wrong++;
+		}
+	    }
+	}
+	CHECK(culled > 0);
+	CHECK(wrong == 0);
+    }
+}
+
+int main() {
+    optimize();
+    meshlets();
+    simplify();
+    cones();
+    return test_failures ? 1 : 0;
+}
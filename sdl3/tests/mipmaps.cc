@@ -0,0 +1,116 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <vector>
+#include "headless.h"
+
+constexpr uint32_t size = 4096;
+constexpr uint32_t runs = 3;
+constexpr const char* spd_path = "../samples/shaders/spd.comp.spv";
+
+// Copies the 1x1 last level, which averages the whole image, into host visible memory.
+static uint32_t last_level(Headless& headless, vb::Image& image) {
+    auto& vbc = headless.vbc;
+    vb::Buffer readback {&vbc};
+    readback.create(sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+    if(!readback.all_valid()) return 0;
+    const uint32_t level = image.mip_level - 1;
+    CHECK(vbc.submit_command_to_queue([&](VkCommandBuffer cmd) {
+	VkImageMemoryBarrier barrier = {
+	    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+	    .srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
+	    .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+	    .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .image = image.image,
+	    .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1},
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+	VkBufferImageCopy copy = {
+	    .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1},
+	    .imageExtent = {1, 1, 1},
+	};
+	vkCmdCopyImageToBuffer(cmd, image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &copy);
+    }));
+    vmaInvalidateAllocation(vbc.allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+    uint32_t texel;
+    memcpy(&texel, readback.info.pMappedData, sizeof(texel));
+    readback.clean();
+    return texel;
+}
+
+// Creates image with level 0 uploaded and the rest left in transfer destination layout for `generate_mipmaps`.
+static void create_image(vb::Image& image, const std::vector<uint32_t>& pixels, vb::MipGenerator* generator) {
+    image.set_mip_generator(generator);
+    image.set_defer_mipmaps(true);
+    image.create((void*)pixels.data(), {size, size, 1}, true, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM);
+}
+
+// Times mip chain of 4K image written by single pass downsampling dispatch against per level blits.
+static void spd_against_blits(Headless& headless, vb::MipGenerator& generator) {
+    auto& vbc = headless.vbc;
+    std::vector<uint32_t> pixels(size * size);
+    for(uint32_t y = 0; y < size; y++)
+	for(uint32_t x = 0; x < size; x++)
+	    pixels[y * size + x] = (x & 0xff) | (y & 0xff) << 8 | ((x ^ y) & 0xff) << 16 | 0xffu << 24;
+
+    double spd_ms = 1e9, blit_ms = 1e9;
+    uint32_t spd_texel = 0, blit_texel = 0;
+    for(uint32_t run = 0; run < runs; run++) {
+	vb::Image spd {&vbc};
+	create_image(spd, pixels, &generator);
+	CHECK(spd.all_valid());
+	CHECK(spd.storage_mipmaps);
+	spd_ms = std::min(spd_ms, headless.gpu_ms([&](VkCommandBuffer cmd) { spd.generate_mipmaps(cmd); }));
+	spd_texel = last_level(headless, spd);
+	spd.clean();
+	generator.reset();
+
+	vb::Image blit {&vbc};
+	create_image(blit, pixels, nullptr);
+	CHECK(blit.all_valid());
+	blit_ms = std::min(blit_ms, headless.gpu_ms([&](VkCommandBuffer cmd) { blit.generate_mipmaps(cmd); }));
+	blit_texel = last_level(headless, blit);
+	blit.clean();
+    }
+    CHECK(generator.stats.dispatches == runs);
+    CHECK(generator.stats.fallbacks == 0);
+    // Both average the same texels, only rounding of intermediate levels differs.
+    for(uint32_t channel = 0; channel < 32; channel += 8)
+	CHECK(std::abs((int)(spd_texel >> channel & 0xff) - (int)(blit_texel >> channel & 0xff)) <= 2);
+    vb::log(std::format("Mip chain of {0}x{0} image, best of {1}: compute {2:.3f}ms, blits {3:.3f}ms",
+		size, runs, spd_ms, blit_ms));
+}
+
+// Generator asked for no images still gets a usable descriptor pool.
+static void zero_images(Headless& headless) {
+    vb::MipGenerator generator {&headless.vbc};
+    generator.create(spd_path, 0);
+    CHECK(generator.all_valid());
+    CHECK(generator.max_images == 1);
+    generator.clean();
+}
+
+int main() {
+    Headless headless;
+    if(!headless.valid) return test_skipped;
+    vb::MipGenerator generator {&headless.vbc};
+    generator.create(spd_path);
+    if(!generator.all_valid()) {
+	vb::log(std::format("{} is missing, compile it with samples/shaders/compile.sh", spd_path));
+	return test_skipped;
+    }
+    if(!generator.storage_supported) {
+	vb::log("Device can't store to VK_FORMAT_R8G8B8A8_UNORM images");
+	generator.clean();
+	return test_skipped;
+    }
+    spd_against_blits(headless, generator);
+    generator.clean();
+    zero_images(headless);
+    return test_failures ? 1 : 0;
+}
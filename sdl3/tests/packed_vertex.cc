@@ -0,0 +1,138 @@
+#include <cfloat>
+#include <vector>
+#include <numbers>
+#include "packed_vertex.h"
+#include "test.h"
+
+// Same layout as `GLTF::Vertex`, without pulling Vulkan and fastgltf in.
+struct Vertex {
+    glm::vec3 position;
+    float uv_x;
+    glm::vec3 normal;
+    float uv_y;
+    glm::vec4 tangent;
+};
+
+// Half step of 16 bit unorm, one step of 16 bit snorm in octahedral space and half ulp of half float.
+constexpr float position_bound = 0.5f / 65535.0f;
+constexpr float direction_bound = 1e-4f;
+constexpr float uv_bound = 1.0f / 2048.0f;
+
+static Vertex make_vertex(glm::vec3 position, glm::vec3 normal = {0.0f, 0.0f, 1.0f},
+	glm::vec4 tangent = {1.0f, 0.0f, 0.0f, 1.0f}, glm::vec2 uv = glm::vec2(0.0f)) {
+    return {position, uv.x, normal, uv.y, tangent};
+}
+
+static Vertex round_trip(const Vertex& vertex, glm::vec3 offset = glm::vec3(0.0f), glm::vec3 scale = glm::vec3(1.0f)) {
+    return PackedVertex::pack(vertex, offset, scale).unpack<Vertex>(offset, scale);
+}
+
+static PackingError measure(const std::vector<Vertex>& vertices,
+	glm::vec3 offset = glm::vec3(0.0f), glm::vec3 scale = glm::vec3(1.0f)) {
+    PackingError error;
+    for(auto& vertex: vertices) error.add(vertex, round_trip(vertex, offset, scale), scale);
+    return error;
+}
+
+// Directions over the whole sphere, the -Z hemisphere is folded over octahedron edges.
+static void directions() {
+    std::vector<Vertex> vertices;
+    for(int i = 0; i <= 64; i++) {
+	for(int j = 0; j < 128; j++) {
+	    float theta = std::numbers::pi_v<float> * i / 64;
+	    float phi = 2.0f * std::numbers::pi_v<float> * j / 128;
+	    glm::vec3 n {std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)};
+	    vertices.push_back(make_vertex(glm::vec3(0.0f), n, glm::vec4(-n, 1.0f)));
+	}
+    }
+    auto error = measure(vertices);
+    CHECK(error.normal <= direction_bound);
+    CHECK(error.tangent <= direction_bound);
+
+    auto below = round_trip(make_vertex(glm::vec3(0.0f), glm::normalize(glm::vec3(0.3f, -0.2f, -0.9f))));
+    CHECK(below.normal.z < 0.0f);
+    auto pole = round_trip(make_vertex(glm::vec3(0.0f), {0.0f, 0.0f, -1.0f}));
+    CHECK(glm::length(pole.normal - glm::vec3(0.0f, 0.0f, -1.0f)) <= direction_bound);
+}
+
+// Zero vectors decode to +Z, unnormalized ones to their direction.
+static void unnormalized() {
+    auto zero = round_trip(make_vertex(glm::vec3(0.0f), glm::vec3(0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+    CHECK(zero.normal == glm::vec3(0.0f, 0.0f, 1.0f));
+    CHECK(glm::vec3(zero.tangent) == glm::vec3(0.0f, 0.0f, 1.0f));
+
+    std::vector<Vertex> vertices = {
+	make_vertex(glm::vec3(0.0f), {5.0f, -3.0f, 2.0f}, {0.0f, 40.0f, -7.0f, 1.0f}),
+	make_vertex(glm::vec3(0.0f), {1e-3f, 2e-3f, -1e-3f}, {-1e-4f, 0.0f, 1e-4f, 1.0f}),
+    };
+    auto error = measure(vertices);
+    CHECK(error.normal <= direction_bound);
+    CHECK(error.tangent <= direction_bound);
+    for(auto& vertex: vertices) CHECK(std::abs(glm::length(round_trip(vertex).normal) - 1.0f) <= 1e-6f);
+}
+
+// Handedness is kept in position `w`, only its sign survives.
+static void handedness() {
+    auto left = round_trip(make_vertex(glm::vec3(0.0f), {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f, -1.0f}));
+    CHECK(left.tangent.w == -1.0f);
+    auto scaled = round_trip(make_vertex(glm::vec3(0.0f), {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f, -0.5f}));
+    CHECK(scaled.tangent.w == -1.0f);
+    auto right = round_trip(make_vertex(glm::vec3(0.0f), {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f}));
+    CHECK(right.tangent.w == 1.0f);
+    CHECK(glm::length(glm::vec3(left.tangent) - glm::vec3(1.0f, 0.0f, 0.0f)) <= direction_bound);
+}
+
+// Half floats hold uvs up to 65504 with 11 significant bits, larger ones overflow to infinity.
+static void uvs() {
+    std::vector<Vertex> vertices;
+    for(float uv: {0.0f, 1e-5f, -3e-5f, 0.5f, 1.0f, -3.75f, 1000.3f, 12345.6f, -65504.0f, 65504.0f})
+	vertices.push_back(make_vertex(glm::vec3(0.0f), {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f}, glm::vec2(uv, -uv)));
+    auto error = measure(vertices);
+    CHECK(error.uv <= uv_bound);
+    CHECK(error.uv_overflows == 0);
+
+    auto overflow = measure({make_vertex(glm::vec3(0.0f), {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f},
+		glm::vec2(70000.0f, -1e6f))});
+    CHECK(overflow.uv_overflows == 2);
+    CHECK(overflow.uv == 0.0f);
+}
+
+// Quantization error is half a step of mesh extent, float rounding adds about an ulp of the offset.
+static void positions() {
+    auto grid = [](glm::vec3 offset, glm::vec3 scale) {
+	std::vector<Vertex> vertices;
+	for(int x = 0; x <= 16; x++)
+	    for(int y = 0; y <= 16; y++)
+		for(int z = 0; z <= 16; z++)
+		    vertices.push_back(make_vertex(offset + glm::vec3(x * 0.0617f, y * 0.0413f, z * 0.0593f) * scale));
+	return vertices;
+    };
+    auto rounding = [](glm::vec3 offset, glm::vec3 scale) {
+	auto bound = 2.0f * FLT_EPSILON * (glm::abs(offset) + scale) / scale;
+	return std::max({bound.x, bound.y, bound.z});
+    };
+
+    glm::vec3 scale {1.0f, 2.0f, 0.5f};
+    auto origin = measure(grid(glm::vec3(0.0f), scale), glm::vec3(0.0f), scale);
+    CHECK(origin.position <= position_bound + rounding(glm::vec3(0.0f), scale));
+
+    // Mesh far from the origin, once a step nears an ulp of the offset rounding exceeds quantization.
+    glm::vec3 offset {10000.0f, -5000.0f, 20000.0f};
+    scale = glm::vec3(100.0f, 0.01f, 3.0f);
+    auto far = measure(grid(offset, scale), offset, scale);
+    CHECK(far.position > position_bound);
+    CHECK(far.position <= position_bound + rounding(offset, scale));
+
+    // Positions outside of bounds are clamped to them.
+    auto outside = round_trip(make_vertex(glm::vec3(-1.0f, 2.0f, 0.25f)));
+    CHECK(glm::length(outside.position - glm::vec3(0.0f, 1.0f, 0.25f)) <= position_bound);
+}
+
+int main() {
+    directions();
+    unnormalized();
+    handedness();
+    uvs();
+    positions();
+    return test_failures ? 1 : 0;
+}
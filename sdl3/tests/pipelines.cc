@@ -0,0 +1,155 @@
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <memory>
+#include <vector>
+#include "headless.h"
+
+constexpr uint32_t variant_count = 128;
+constexpr const char* vert_path = "../samples/shaders/triangle.vert.spv";
+constexpr const char* frag_path = "../samples/shaders/triangle.frag.spv";
+constexpr const char* cache_path = "test_pipeline_cache.bin";
+
+struct Shaders {
+    VkShaderModule vert = VK_NULL_HANDLE;
+    VkShaderModule frag = VK_NULL_HANDLE;
+};
+
+static double ms_since(std::chrono::high_resolution_clock::time_point start) {
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+}
+
+// Variant `index` of the triangle pipeline, each with different cull mode, front face, depth comparison or blending.
+static void configure(vb::GraphicsPipeline& pipeline, Shaders& shaders, uint32_t index) {
+    pipeline.add_shader(shaders.vert, VK_SHADER_STAGE_VERTEX_BIT);
+    pipeline.add_shader(shaders.frag, VK_SHADER_STAGE_FRAGMENT_BIT);
+    pipeline.set_cull_mode((VkCullModeFlags)(index & 3));
+    pipeline.set_front_face((VkFrontFace)(index >> 2 & 1));
+    pipeline.enable_depth_test();
+    pipeline.set_depth_comparison((VkCompareOp)(index >> 3 & 7));
+    if(index >> 6 & 1) pipeline.enable_blend();
+}
+
+static const VkFormat color_format = VK_FORMAT_R8G8B8A8_UNORM;
+static const VkPipelineRenderingCreateInfo rendering = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+    .colorAttachmentCount = 1,
+    .pColorAttachmentFormats = &color_format,
+    .depthAttachmentFormat = VK_FORMAT_D32_SFLOAT,
+};
+
+// Creates every variant one at a time against context's pipeline cache.
+// @return Milliseconds spent in `GraphicsPipeline::create`.
+static double create_variants(Headless& headless, Shaders& shaders) {
+    double ms = 0.0;
+    for(uint32_t i = 0; i < variant_count; i++) {
+	vb::GraphicsPipeline pipeline {&headless.vbc};
+	configure(pipeline, shaders, i);
+	auto start = std::chrono::high_resolution_clock::now();
+	pipeline.create((void*)&rendering);
+	ms += ms_since(start);
+	CHECK(pipeline.all_valid());
+	pipeline.clean();
+    }
+    return ms;
+}
+
+// Same variants created with empty cache, saved, and created again from the saved file like on next launch.
+static void cold_against_warm(Headless& headless, Shaders& shaders) {
+    auto& vbc = headless.vbc;
+    remove(cache_path);
+
+    vb::PipelineCache cold {&vbc};
+    cold.create(cache_path);
+    CHECK(cold.all_valid());
+    CHECK(cold.stats.loaded_bytes == 0);
+    vbc.set_pipeline_cache(&cold);
+    auto cold_ms = create_variants(headless, shaders);
+    CHECK(cold.save());
+    CHECK(cold.stats.saved_bytes > 0);
+    vbc.set_pipeline_cache(nullptr);
+    cold.clean();
+
+    vb::PipelineCache warm {&vbc};
+    warm.create(cache_path);
+    CHECK(warm.all_valid());
+    CHECK(warm.stats.loaded_bytes == cold.stats.saved_bytes);
+    vbc.set_pipeline_cache(&warm);
+    auto warm_ms = create_variants(headless, shaders);
+    vbc.set_pipeline_cache(nullptr);
+    // Feedback is optional for drivers, so hits are only checked when they're reported.
+    if(warm.feedback_supported && warm.stats.hits + warm.stats.misses == variant_count)
+	CHECK(warm.stats.hits > 0);
+    vb::log(std::format("{} pipelines: cold cache {:.2f}ms ({} hits, {} misses), warm cache of {} bytes {:.2f}ms ({} hits, {} misses)",
+		variant_count, cold_ms, cold.stats.hits.load(), cold.stats.misses.load(),
+		warm.stats.loaded_bytes, warm_ms, warm.stats.hits.load(), warm.stats.misses.load()));
+    warm.clean();
+
+    // Truncated file is ignored instead of handed to the driver.
+    FILE* file = fopen(cache_path, "r+b");
+    CHECK(file);
+    if(file) {
+	const uint32_t header_size = 4;
+	fwrite(&header_size, sizeof(header_size), 1, file);
+	fclose(file);
+    }
+    vb::PipelineCache broken {&vbc};
+    broken.create(cache_path);
+    CHECK(broken.all_valid());
+    CHECK(broken.stats.loaded_bytes == 0);
+    broken.clean();
+    remove(cache_path);
+}
+
+// Same variants created one by one and by `PipelineBatch` on all cores, both without cache so every one is compiled.
+static void batch_against_serial(Headless& headless, Shaders& shaders) {
+    auto& vbc = headless.vbc;
+    auto serial_ms = create_variants(headless, shaders);
+
+    vb::ThreadPool pool;
+    pool.create();
+    std::vector<std::unique_ptr<vb::GraphicsPipeline>> pipelines;
+    vb::PipelineBatch batch {&vbc};
+    for(uint32_t i = 0; i < variant_count; i++) {
+	pipelines.push_back(std::make_unique<vb::GraphicsPipeline>(&vbc));
+	configure(*pipelines.back(), shaders, i);
+	batch.add(*pipelines.back(), (void*)&rendering);
+    }
+    CHECK(batch.create(pool));
+    CHECK(batch.stats.pipelines == variant_count);
+    // Variants differ only in fixed function state, so they all share one layout.
+    CHECK(batch.stats.layouts == 1);
+    for(auto& pipeline: pipelines) {
+	CHECK(pipeline->all_valid());
+	pipeline->clean();
+    }
+    vb::log(std::format("{} pipelines: one by one {:.2f}ms, batch on {} threads {:.2f}ms ({:.2f}ms of work, {:.3f}ms per pipeline, slowest {:.3f}ms)",
+		variant_count, serial_ms, pool.size(), batch.stats.wall_ns / 1e6, batch.stats.creation_ns / 1e6,
+		batch.stats.creation_ns / 1e6 / variant_count, batch.stats.slowest_ns / 1e6));
+    batch.clean();
+    pool.clean();
+}
+
+int main() {
+    vb::ContextDeviceInfo device_info = {};
+    device_info.vk13features.dynamicRendering = VK_TRUE;
+    Headless headless {device_info};
+    if(!headless.valid) return test_skipped;
+    auto& vbc = headless.vbc;
+    Shaders shaders = {
+	.vert = vb::create_shader_module(vbc.device, vert_path),
+	.frag = vb::create_shader_module(vbc.device, frag_path),
+    };
+    if(!shaders.vert || !shaders.frag) {
+	vb::log(std::format("{} or {} is missing, compile them with samples/shaders/compile.sh", vert_path, frag_path));
+	if(shaders.vert) vkDestroyShaderModule(vbc.device, shaders.vert, nullptr);
+	if(shaders.frag) vkDestroyShaderModule(vbc.device, shaders.frag, nullptr);
+	return test_skipped;
+    }
+    batch_against_serial(headless, shaders);
+    cold_against_warm(headless, shaders);
+    vkDestroyShaderModule(vbc.device, shaders.vert, nullptr);
+    vkDestroyShaderModule(vbc.device, shaders.frag, nullptr);
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdio>
+
+// Failed checks are reported and counted instead of aborting, so a run lists all of them.
+inline int test_failures = 0;
+
+#define CHECK(condition) do { \
+	if(!(condition)) { \
+	    std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+	    test_failures++; \
+	} \
+    } while(0)
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <vector>
+#include "headless.h"
+
+constexpr uint32_t upload_count = 256;
+constexpr VkDeviceSize upload_size = 64 * 1024;
+
+static double ms_since(std::chrono::high_resolution_clock::time_point start) {
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+}
+
+// Host visible destination, so uploaded bytes can be compared after the copies finish.
+static vb::Buffer readback_buffer(vb::Context& vbc) {
+    vb::Buffer buffer {&vbc};
+    buffer.create(upload_count * upload_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+    return buffer;
+}
+
+static bool uploaded(vb::Context& vbc, vb::Buffer& buffer, const std::vector<uint32_t>& data) {
+    vmaInvalidateAllocation(vbc.allocator, buffer.allocation, 0, VK_WHOLE_SIZE);
+    return memcmp(buffer.info.pMappedData, data.data(), data.size() * sizeof(uint32_t)) == 0;
+}
+
+// Same uploads with one blocking submit each and batched by `UploadQueue`, through a staging ring smaller than all of them.
+static void batching(Headless& headless) {
+    auto& vbc = headless.vbc;
+    std::vector<uint32_t> data(upload_count * upload_size / sizeof(uint32_t));
+    for(size_t i = 0; i < data.size(); i++) data[i] = i * 2654435761u;
+
+    auto blocking = readback_buffer(vbc);
+    CHECK(blocking.all_valid());
+    auto start = std::chrono::high_resolution_clock::now();
+    for(uint32_t i = 0; i < upload_count; i++)
+	CHECK(blocking.upload((const char*)data.data() + i * upload_size, upload_size, i * upload_size));
+    auto blocking_ms = ms_since(start);
+    CHECK(uploaded(vbc, blocking, data));
+    blocking.clean();
+
+    auto batched = readback_buffer(vbc);
+    CHECK(batched.all_valid());
+    vb::UploadQueue uploads {&vbc};
+    uploads.create(headless.queue->index, headless.queue->queue);
+    CHECK(uploads.all_valid());
+    start = std::chrono::high_resolution_clock::now();
+    for(uint32_t i = 0; i < upload_count; i++)
+	CHECK(uploads.upload(batched.buffer, (const char*)data.data() + i * upload_size, upload_size, i * upload_size));
+    CHECK(uploads.finish());
+    auto batched_ms = ms_since(start);
+    CHECK(uploaded(vbc, batched, data));
+    // Every ticket handed out was signaled, nothing is left waiting on the ring.
+    CHECK(uploads.completed_ticket == uploads.last_ticket);
+    CHECK(headless.staging_ring.in_flight() == 0);
+    CHECK(uploads.stats.submits < upload_count);
+    vb::log(std::format("{} uploads of {} KiB: blocking {} submits {:.2f}ms, upload queue {} submits {:.2f}ms, {} ring stalls",
+		upload_count, upload_size / 1024, upload_count, blocking_ms,
+		uploads.stats.submits, batched_ms, headless.staging_ring.stats.stalls.load()));
+    uploads.clean();
+    batched.clean();
+}
+
+// Single family devices go through release and acquire barriers too when it's forced, so both paths run on lavapipe.
+static void ownership_transfer(Headless& headless) {
+    auto& vbc = headless.vbc;
+    vbc.force_ownership_transfer = true;
+    vb::CommandPool transfer_cmdpool {&vbc};
+    transfer_cmdpool.create(headless.queue->index);
+    CHECK(transfer_cmdpool.all_valid());
+    CHECK(vbc.init_transfer_submitter(transfer_cmdpool.allocate(), headless.queue->queue, headless.queue->index));
+    CHECK(vbc.upload_ownership().enabled);
+    std::vector<uint32_t> data(upload_count * upload_size / sizeof(uint32_t));
+    for(size_t i = 0; i < data.size(); i++) data[i] = ~(uint32_t)i;
+
+    auto blocking = readback_buffer(vbc);
+    CHECK(blocking.upload(data.data(), data.size() * sizeof(uint32_t)));
+    CHECK(uploaded(vbc, blocking, data));
+    blocking.clean();
+
+    auto batched = readback_buffer(vbc);
+    vb::UploadQueue uploads {&vbc};
+    uploads.create(headless.queue->index, headless.queue->queue);
+    CHECK(uploads.set_owner(headless.queue->index, headless.queue->queue));
+    CHECK(uploads.ownership().enabled);
+    for(uint32_t i = 0; i < upload_count; i++)
+	CHECK(uploads.upload(batched.buffer, (const char*)data.data() + i * upload_size, upload_size, i * upload_size));
+    CHECK(uploads.finish());
+    CHECK(uploaded(vbc, batched, data));
+    // Owner's submit signals the finished value, so it ran after the upload one.
+    CHECK(uploads.timeline.value() == uploads.last_ticket * 2);
+    uploads.clean();
+    batched.clean();
+
+    vkDeviceWaitIdle(vbc.device);
+    transfer_cmdpool.clean();
+    vbc.force_ownership_transfer = false;
+}
+
+// Submit failing like on lost device, swapped in through volk's function pointer.
+static VKAPI_ATTR VkResult VKAPI_CALL failing_submit(VkQueue, uint32_t, const VkSubmitInfo*, VkFence) {
+    return VK_ERROR_DEVICE_LOST;
+}
+
+// Batch that never reached the queue isn't reported as finished, and its staging memory is released.
+static void failed_submit(Headless& headless) {
+    auto& vbc = headless.vbc;
+    auto buffer = readback_buffer(vbc);
+    CHECK(buffer.all_valid());
+    vb::UploadQueue uploads {&vbc};
+    uploads.create(headless.queue->index, headless.queue->queue);
+    CHECK(uploads.all_valid());
+    std::vector<uint32_t> data(upload_size / sizeof(uint32_t), 7);
+    CHECK(uploads.upload(buffer.buffer, data.data(), upload_size));
+    auto submit = vkQueueSubmit;
+    vkQueueSubmit = failing_submit;
+    CHECK(!uploads.finish());
+    vkQueueSubmit = submit;
+    CHECK(uploads.stats.submits == 0);
+    CHECK(headless.staging_ring.in_flight() == 0);
+    // Failed batch is dropped, so nothing is left to fail afterwards.
+    CHECK(uploads.finish());
+    uploads.clean();
+    buffer.clean();
+}
+
+int main() {
+    Headless headless;
+    if(!headless.valid) return test_skipped;
+    batching(headless);
+    ownership_transfer(headless);
+    failed_submit(headless);
+    return test_failures ? 1 : 0;
+}
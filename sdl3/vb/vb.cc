@@ -7,11 +7,16 @@
 #define VMA_IMPLEMENTATION
 #include <vk_mem_alloc.h>
 
+#include <bit>
+#include <chrono>
 #include <set>
 #include <format>
 #include <fstream>
 #include <SDL3/SDL_vulkan.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <math.h>
 #include <vb.h>
 
@@ -43,6 +48,10 @@ namespace vb {
 
     Context::~Context() {
 	if(command_submitter.has_value()) vkDestroyFence(device, command_submitter->fence, nullptr);
+	if(transfer_submitter.has_value()) {
+	    vkDestroyFence(device, transfer_submitter->fence, nullptr);
+	    vkDestroySemaphore(device, transfer_submitter->semaphore, nullptr);
+	}
 	if(allocator != VK_NULL_HANDLE) vmaDestroyAllocator(allocator);
 	if(swapchain != VK_NULL_HANDLE) destroy_swapchain();
 	if(device != VK_NULL_HANDLE) vkDestroyDevice(device, nullptr);
@@ -107,6 +116,7 @@ namespace vb {
 	    .pApplicationName = info.title.c_str(),
     	    .apiVersion = info.vulkan_api,
 	};
+	api_version = info.vulkan_api;
 	VkInstanceCreateInfo inst_info = {
 	    .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
 	    .pNext = info.pNext,
@@ -147,6 +157,7 @@ namespace vb {
        	VkPhysicalDeviceProperties properties;
     	vkGetPhysicalDeviceProperties(physical_device, &properties);
     	log(std::format("Picked {} as GPU", properties.deviceName));
+	api_version = std::min(api_version, properties.apiVersion);
 	std::vector<std::string> available_extensions;
 	{
 	    uint32_t count = 0;
@@ -170,27 +181,39 @@ namespace vb {
 
 	std::vector<QueueIndex> queue_idx;
 	for(auto& requested: info.queues_to_request) {
+	    std::optional<uint32_t> picked;
+	    int picked_extra = INT32_MAX;
 	    for(uint32_t i = 0; i < queue_family_count; i++) {
 		if(requested == Queue::Present) {
 	    	    VkBool32 present = false;
 		    vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, &present);
 	    	    if(present) {
-			QueueIndex nqueue {
-			    .type = Queue::Present,
-			    .index = i,
-			};
-			queue_idx.push_back(nqueue);
-		    }
-	    	} else {
-		    if(queue_families[i].queueFlags & QueueIndex::queue_to_flag(requested)) {
-			QueueIndex nqueue {
-			    .type = requested,
-			    .index = i,
-			};
-			queue_idx.push_back(nqueue);
+			picked = i;
+			break;
 		    }
+		    continue;
+	    	}
+		VkQueueFlags flags = queue_families[i].queueFlags;
+		// Graphics and compute families support transfers without reporting it.
+		if(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+		    flags |= VK_QUEUE_TRANSFER_BIT;
+		VkQueueFlags wanted = QueueIndex::queue_to_flag(requested);
+		if(!(flags & wanted)) continue;
+		// Prefer the family with least other capabilities, so dedicated transfer
+		// and async compute queues can overlap with graphics work.
+		int extra = std::popcount(flags & ~wanted & (VK_QUEUE_GRAPHICS_BIT
+			    | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT));
+		if(extra < picked_extra) {
+		    picked = i;
+		    picked_extra = extra;
 		}
 	    }
+	    if(!picked.has_value()) continue;
+	    QueueIndex nqueue {
+		.type = requested,
+		.index = *picked,
+	    };
+	    queue_idx.push_back(nqueue);
     	}
 
 	if(queue_idx.size() != info.queues_to_request.size()) return false;
@@ -209,6 +232,7 @@ namespace vb {
     	}
     	VkPhysicalDeviceVulkan13Features vk13features = info.vk13features;
 	vk13features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	vk13features.pNext = info.pNext;
     	VkPhysicalDeviceVulkan12Features vk12features = info.vk12features;
     	vk12features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
     	vk12features.pNext = &vk13features;
@@ -216,6 +240,16 @@ namespace vb {
     	vk11features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
     	vk11features.pNext = &vk12features;
 	VkPhysicalDeviceFeatures vk10features = info.vk10features;
+	{
+	    // Struct is nothing but VkBool32s, so optional features are merged member by member.
+	    VkPhysicalDeviceFeatures supported;
+	    vkGetPhysicalDeviceFeatures(physical_device, &supported);
+	    auto requested = (VkBool32*)&vk10features;
+	    auto optional = (const VkBool32*)&info.optional_vk10features;
+	    auto available = (const VkBool32*)&supported;
+	    for(size_t i = 0; i < sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32); i++)
+		if(optional[i] && available[i]) requested[i] = VK_TRUE;
+	}
     	VkPhysicalDeviceFeatures2 features = {
     	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
     	    .pNext = &vk11features,
@@ -234,6 +268,7 @@ namespace vb {
     	if(vkCreateDevice(physical_device, &dinfo, nullptr, &device) != VK_SUCCESS)
 	    return false;
 	volkLoadDevice(device);
+	device_extensions.assign(request_extensions.begin(), request_extensions.end());
 	for(auto& queue: queue_idx)
 	    vkGetDeviceQueue(device, queue.index, 0, &queue.queue);
 	queues = queue_idx;
@@ -285,8 +320,11 @@ namespace vb {
     	if(surface_capabilities.maxImageCount > 0
 		&& image_count > surface_capabilities.maxImageCount)
     	    image_count = surface_capabilities.maxImageCount;
+	// Only queues that render to or present swapchain images need to share them.
 	std::set<uint32_t> unique_indices;
-	for(auto& queue: queues) unique_indices.insert(queue.index);
+	for(auto& queue: queues)
+	    if(queue.type == Queue::Graphics || queue.type == Queue::Present)
+		unique_indices.insert(queue.index);
 	std::vector<uint32_t> indices {unique_indices.begin(), unique_indices.end()};
     	VkSwapchainCreateInfoKHR swp_info = {
     	    .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -364,32 +402,106 @@ namespace vb {
 	return true;
     }
 
-    bool Context::submit_command_to_queue(std::function<void(VkCommandBuffer cmd)>&& fn) {
-	vkResetFences(device, 1, &command_submitter->fence);
-	vkResetCommandBuffer(command_submitter->buffer, 0);
+    bool Context::submit(CommandSubmitter& submitter, std::function<void(VkCommandBuffer cmd)>& fn,
+	    VkSemaphore wait_semaphore, VkSemaphore signal_semaphore, bool wait) {
+	vkResetFences(device, 1, &submitter.fence);
+	vkResetCommandBuffer(submitter.buffer, 0);
 	VkCommandBufferBeginInfo begin = {
 	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 	    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 	};
-	if(vkBeginCommandBuffer(command_submitter->buffer, &begin) != VK_SUCCESS)
+	if(vkBeginCommandBuffer(submitter.buffer, &begin) != VK_SUCCESS)
 	    return false;
-	fn(command_submitter->buffer);
-	if(vkEndCommandBuffer(command_submitter->buffer) != VK_SUCCESS) return false;
+	fn(submitter.buffer);
+	if(vkEndCommandBuffer(submitter.buffer) != VK_SUCCESS) return false;
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 	VkSubmitInfo submit = {
 	    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+	    .waitSemaphoreCount = wait_semaphore ? 1u : 0u,
+	    .pWaitSemaphores = &wait_semaphore,
+	    .pWaitDstStageMask = &wait_stage,
 	    .commandBufferCount = 1,
-	    .pCommandBuffers = &command_submitter->buffer,
+	    .pCommandBuffers = &submitter.buffer,
+	    .signalSemaphoreCount = signal_semaphore ? 1u : 0u,
+	    .pSignalSemaphores = &signal_semaphore,
+	};
+ 	if(vkQueueSubmit(submitter.queue, 1, &submit, submitter.fence) != VK_SUCCESS) return false;
+	if(wait) vkWaitForFences(device, 1, &submitter.fence, 1, UINT64_MAX);
+	return true;
+    }
+
+    bool Context::submit_command_to_queue(std::function<void(VkCommandBuffer cmd)>&& fn) {
+	return submit(*command_submitter, fn, VK_NULL_HANDLE, VK_NULL_HANDLE, true);
+    }
+
+    bool Context::init_transfer_submitter(VkCommandBuffer cmd, VkQueue queue, uint32_t queue_index) {
+	CommandSubmitter cmdsub = {
+	    .queue = queue,
+	    .index = queue_index,
+	    .fence = create_fence(device),
+	    .buffer = cmd,
+	    .semaphore = create_semaphore(device),
+	};
+	if(cmdsub.fence == VK_NULL_HANDLE || cmdsub.semaphore == VK_NULL_HANDLE) {
+	    vkDestroyFence(device, cmdsub.fence, nullptr);
+	    vkDestroySemaphore(device, cmdsub.semaphore, nullptr);
+	    return false;
+	}
+	transfer_submitter = cmdsub;
+	return true;
+    }
+
+    OwnershipTransfer Context::upload_ownership() {
+	if(!transfer_submitter.has_value() || !command_submitter.has_value()) return {};
+	return {
+	    .src_family = transfer_submitter->index,
+	    .dst_family = command_submitter->index,
+	    .enabled = force_ownership_transfer
+		|| transfer_submitter->index != command_submitter->index,
 	};
- 	if(vkQueueSubmit(command_submitter->queue, 1, &submit,
-		    command_submitter->fence) != VK_SUCCESS) return false;
-	vkWaitForFences(device, 1, &command_submitter->fence, 1, UINT64_MAX);
+    }
+
+    bool Context::submit_upload_to_queue(
+	    std::function<void(VkCommandBuffer cmd, const OwnershipTransfer& ownership)>&& transfer,
+	    std::function<void(VkCommandBuffer cmd, const OwnershipTransfer& ownership)>&& acquire) {
+	if(!command_submitter.has_value()) return false;
+	auto ownership = upload_ownership();
+	std::function<void(VkCommandBuffer cmd)> record_transfer = [&](VkCommandBuffer cmd) {
+	    transfer(cmd, ownership);
+	};
+	if(!ownership.enabled) {
+	    std::function<void(VkCommandBuffer cmd)> record = [&](VkCommandBuffer cmd) {
+		transfer(cmd, ownership);
+		if(acquire) acquire(cmd, ownership);
+	    };
+	    return submit(*command_submitter, record, VK_NULL_HANDLE, VK_NULL_HANDLE, true);
+	}
+	if(!acquire) return submit(*transfer_submitter, record_transfer,
+		VK_NULL_HANDLE, VK_NULL_HANDLE, true);
+	std::function<void(VkCommandBuffer cmd)> record_acquire = [&](VkCommandBuffer cmd) {
+	    acquire(cmd, ownership);
+	};
+	if(!transfer_submitter->semaphore) return false;
+	if(!submit(*transfer_submitter, record_transfer, VK_NULL_HANDLE,
+		    transfer_submitter->semaphore, false)) return false;
+	if(!submit(*command_submitter, record_acquire, transfer_submitter->semaphore,
+		    VK_NULL_HANDLE, true)) {
+	    // Transfer is already queued, so caller's staging memory stays in use until it finishes. Its semaphore
+	    // is left signaled without a waiter, signaling it again would be invalid, so it's replaced.
+	    vkWaitForFences(device, 1, &transfer_submitter->fence, 1, UINT64_MAX);
+	    vkDestroySemaphore(device, transfer_submitter->semaphore, nullptr);
+	    transfer_submitter->semaphore = create_semaphore(device);
+	    if(!transfer_submitter->semaphore) log("Failed to recreate transfer VkSemaphore");
+	    return false;
+	}
+	vkWaitForFences(device, 1, &transfer_submitter->fence, 1, UINT64_MAX);
 	return true;
     }
 
     QueueIndex* Context::find_queue(const Queue& type) {
 	QueueIndex* queue = nullptr;
 	for(auto& q: queues) {
-    	    if(q.type == vb::Queue::Graphics) {
+    	    if(q.type == type) {
     	        queue = &q;
     	        break;
     	    }
@@ -500,7 +612,7 @@ namespace vb {
 	    .subresourceRange = {
 		.aspectMask = aspect_mask,
 		.levelCount = VK_REMAINING_MIP_LEVELS,
-		.layerCount = 1,
+		.layerCount = VK_REMAINING_ARRAY_LAYERS,
 	    },
 	};
 	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 
@@ -508,6 +620,219 @@ namespace vb {
 	    1, &barrier);
     }
 
+    Access layout_access(VkImageLayout layout) {
+	switch(layout) {
+	    // Contents are discarded, but previous users of the image still have to finish before it's written again.
+	    case VK_IMAGE_LAYOUT_UNDEFINED: case VK_IMAGE_LAYOUT_PREINITIALIZED:
+		return {VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_NONE};
+	    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+		return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE};
+	    case VK_IMAGE_LAYOUT_GENERAL:
+		return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		    VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT};
+	    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT};
+	    case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL: case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT};
+	    case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL: case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+		return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT
+		    | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT};
+	    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+		return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		    VK_ACCESS_2_SHADER_SAMPLED_READ_BIT};
+	    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+		return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT};
+	    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+		return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+	    default:
+		return {VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		    VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT};
+	}
+    }
+
+    Barriers& Barriers::image(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+	    VkImageAspectFlags aspect, VkPipelineStageFlags2 wait_stage) {
+	auto src = layout_access(old_layout);
+	src.stage |= wait_stage;
+	return this->image(image, old_layout, new_layout, src, aspect);
+    }
+
+    Barriers& Barriers::image(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+	    Access previous, VkImageAspectFlags aspect) {
+	auto depth_aspect = [](VkImageLayout layout) -> VkImageAspectFlags {
+	    switch(layout) {
+		case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL: case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL:
+		    return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+		    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		default: return 0;
+	    }
+	};
+	if(!aspect) aspect = depth_aspect(new_layout) | depth_aspect(old_layout);
+	if(!aspect) aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	auto src = previous;
+	// Only writes have to be made available, reads in source access do nothing.
+	src.access &= VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+	    | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT
+	    | VK_ACCESS_2_MEMORY_WRITE_BIT;
+	return this->image(image, old_layout, new_layout, src, layout_access(new_layout), {
+	    .aspectMask = aspect,
+	    .levelCount = VK_REMAINING_MIP_LEVELS,
+	    .layerCount = VK_REMAINING_ARRAY_LAYERS,
+	});
+    }
+
+    Barriers& Barriers::image(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+	    Access src, Access dst, const VkImageSubresourceRange& range) {
+	image_barriers.push_back({
+	    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+	    .srcStageMask = src.stage,
+	    .srcAccessMask = src.access,
+	    .dstStageMask = dst.stage,
+	    .dstAccessMask = dst.access,
+	    .oldLayout = old_layout,
+	    .newLayout = new_layout,
+	    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .image = image,
+	    .subresourceRange = range,
+	});
+	return *this;
+    }
+
+    Barriers& Barriers::buffer(VkBuffer buffer, Access src, Access dst,
+	    VkDeviceSize offset, VkDeviceSize size) {
+	buffer_barriers.push_back({
+	    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+	    .srcStageMask = src.stage,
+	    .srcAccessMask = src.access,
+	    .dstStageMask = dst.stage,
+	    .dstAccessMask = dst.access,
+	    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .buffer = buffer,
+	    .offset = offset,
+	    .size = size,
+	});
+	return *this;
+    }
+
+    Barriers& Barriers::memory(Access src, Access dst) {
+	memory_barriers.push_back({
+	    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+	    .srcStageMask = src.stage,
+	    .srcAccessMask = src.access,
+	    .dstStageMask = dst.stage,
+	    .dstAccessMask = dst.access,
+	});
+	return *this;
+    }
+
+    void Barriers::record(VkCommandBuffer cmd) {
+	auto count = memory_barriers.size() + buffer_barriers.size() + image_barriers.size();
+	if(!count) return;
+	VkDependencyInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+	    .memoryBarrierCount = (uint32_t)memory_barriers.size(),
+	    .pMemoryBarriers = memory_barriers.data(),
+	    .bufferMemoryBarrierCount = (uint32_t)buffer_barriers.size(),
+	    .pBufferMemoryBarriers = buffer_barriers.data(),
+	    .imageMemoryBarrierCount = (uint32_t)image_barriers.size(),
+	    .pImageMemoryBarriers = image_barriers.data(),
+	};
+	vkCmdPipelineBarrier2(cmd, &info);
+	stats.calls++;
+	stats.barriers += count;
+	memory_barriers.clear();
+	buffer_barriers.clear();
+	image_barriers.clear();
+    }
+
+    void OwnershipTransfer::release(VkCommandBuffer cmd, VkImage image,
+	    VkImageLayout old_layout, VkImageLayout new_layout,
+	    VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) const {
+	VkImageMemoryBarrier barrier = {
+	    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+	    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+	    .dstAccessMask = enabled ? 0 : dst_access,
+	    .oldLayout = old_layout,
+	    .newLayout = new_layout,
+	    .srcQueueFamilyIndex = enabled ? src_family : VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = enabled ? dst_family : VK_QUEUE_FAMILY_IGNORED,
+	    .image = image,
+	    .subresourceRange = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.levelCount = VK_REMAINING_MIP_LEVELS,
+		.layerCount = VK_REMAINING_ARRAY_LAYERS,
+	    },
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    enabled ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : dst_stage, 0, 0, nullptr, 0, nullptr,
+	    1, &barrier);
+    }
+
+    void OwnershipTransfer::acquire(VkCommandBuffer cmd, VkImage image,
+	    VkImageLayout old_layout, VkImageLayout new_layout,
+	    VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) const {
+	if(!enabled) return;
+	VkImageMemoryBarrier barrier = {
+	    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+	    .dstAccessMask = dst_access,
+	    // Within one family it's a plain barrier and the layout was already changed on release.
+	    .oldLayout = src_family == dst_family ? new_layout : old_layout,
+	    .newLayout = new_layout,
+	    .srcQueueFamilyIndex = src_family,
+	    .dstQueueFamilyIndex = dst_family,
+	    .image = image,
+	    .subresourceRange = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.levelCount = VK_REMAINING_MIP_LEVELS,
+		.layerCount = VK_REMAINING_ARRAY_LAYERS,
+	    },
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage,
+	    0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    void OwnershipTransfer::release(VkCommandBuffer cmd, VkBuffer buffer,
+	    VkDeviceSize offset, VkDeviceSize size,
+	    VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) const {
+	VkBufferMemoryBarrier barrier = {
+	    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+	    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+	    .dstAccessMask = enabled ? 0 : dst_access,
+	    .srcQueueFamilyIndex = enabled ? src_family : VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = enabled ? dst_family : VK_QUEUE_FAMILY_IGNORED,
+	    .buffer = buffer,
+	    .offset = offset,
+	    .size = size,
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    enabled ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : dst_stage, 0, 0, nullptr, 1, &barrier,
+	    0, nullptr);
+    }
+
+    void OwnershipTransfer::acquire(VkCommandBuffer cmd, VkBuffer buffer,
+	    VkDeviceSize offset, VkDeviceSize size,
+	    VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) const {
+	if(!enabled) return;
+	VkBufferMemoryBarrier barrier = {
+	    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+	    .dstAccessMask = dst_access,
+	    .srcQueueFamilyIndex = src_family,
+	    .dstQueueFamilyIndex = dst_family,
+	    .buffer = buffer,
+	    .offset = offset,
+	    .size = size,
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage,
+	    0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
     void blit_image(VkCommandBuffer cmd, VkImage source, VkImage dest,
 	    VkExtent3D src_extent, VkExtent3D dst_extent, uint32_t mip_level,
 	    VkImageAspectFlags aspect_mask) {
@@ -536,15 +861,41 @@ namespace vb {
 	    VK_FILTER_LINEAR);
     }
 
+    MappedFile::MappedFile(const char* path) {
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return;
+	struct stat st;
+	if(fstat(fd, &st) == 0 && st.st_size > 0) {
+	    auto mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	    if(mapped != MAP_FAILED) {
+		data = (const char*)mapped;
+		size = st.st_size;
+	    }
+	}
+	close(fd);
+    }
+
+    MappedFile::~MappedFile() {
+	if(data) munmap((void*)data, size);
+    }
+
+    bool is_spirv(std::span<const char> code) {
+	const uint32_t magic = 0x07230203;
+	if(code.size() < 20 || code.size() % 4 || (uintptr_t)code.data() % 4) return false;
+	return *(const uint32_t*)code.data() == magic;
+    }
+
     VkShaderModule create_shader_module(VkDevice device, const char* path) {
-	std::ifstream file {path, std::ios::binary};
-	if(!file.is_open()) return VK_NULL_HANDLE;
-    	std::vector<char> buffer(std::istreambuf_iterator<char>(file), {});
-    	file.close();
+	MappedFile file {path};
+	if(!is_spirv(file.bytes())) return VK_NULL_HANDLE;
+	return create_shader_module(device, file.bytes());
+    }
+
+    VkShaderModule create_shader_module(VkDevice device, std::span<const char> code) {
         VkShaderModuleCreateInfo info = {
 	    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-	    .codeSize = buffer.size() * sizeof(char),
-	    .pCode = (uint32_t*)buffer.data(),
+	    .codeSize = code.size() * sizeof(char),
+	    .pCode = (const uint32_t*)code.data(),
         };
         VkShaderModule shader;
         if(vkCreateShaderModule(device, &info, NULL, &shader) != VK_SUCCESS)
@@ -552,6 +903,12 @@ namespace vb {
         return shader;
     }
 
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+	auto bytes = (const uint8_t*)data;
+	for(size_t i = 0; i < size; i++) seed = (seed ^ bytes[i]) * 1099511628211ull;
+	return seed;
+    }
+
     VkCommandPool create_cmd_pool(VkDevice device, uint32_t queue_family_index,
 	    VkCommandPoolCreateFlags flags) {
 	VkCommandPoolCreateInfo info = {
@@ -592,16 +949,27 @@ namespace vb {
 	pool = create_cmd_pool(ctx->device, queue_index, flags);
     }
 
-    [[nodiscard]] VkCommandBuffer CommandPool::allocate() {
+    [[nodiscard]] VkCommandBuffer CommandPool::allocate(VkCommandBufferLevel level) {
+	VkCommandBuffer buffer = VK_NULL_HANDLE;
+	allocate({&buffer, 1}, level);
+	return buffer;
+    }
+
+    bool CommandPool::allocate(std::span<VkCommandBuffer> buffers, VkCommandBufferLevel level) {
+	if(buffers.empty()) return true;
 	VkCommandBufferAllocateInfo info = {
 	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 	    .commandPool = pool,
-	    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-	    .commandBufferCount = 1,
+	    .level = level,
+	    .commandBufferCount = (uint32_t)buffers.size(),
 	};
-	VkCommandBuffer buffer = VK_NULL_HANDLE;
-	vkAllocateCommandBuffers(ctx->device, &info, &buffer);
-	return buffer;
+	if(vkAllocateCommandBuffers(ctx->device, &info, buffers.data()) == VK_SUCCESS) return true;
+	for(auto& buffer: buffers) buffer = VK_NULL_HANDLE;
+	return false;
+    }
+
+    bool CommandPool::reset(VkCommandPoolResetFlags flags) {
+	return vkResetCommandPool(ctx->device, pool, flags) == VK_SUCCESS;
     }
 
     void CommandPool::clean() {
@@ -609,6 +977,57 @@ namespace vb {
 	pool = VK_NULL_HANDLE;
     }
 
+    void ThreadPool::create(uint32_t threads) {
+	if(!threads) threads = std::max(std::thread::hardware_concurrency(), 1u);
+	stopping = false;
+	for(uint32_t i = 1; i < threads; i++) workers.emplace_back([this, i]() { work(i); });
+    }
+
+    void ThreadPool::run(uint32_t count, std::function<void(uint32_t index, uint32_t worker)>&& fn) {
+	if(!count) return;
+	if(workers.empty()) {
+	    for(uint32_t i = 0; i < count; i++) fn(i, 0);
+	    return;
+	}
+	{
+	    std::lock_guard lock {mutex};
+	    job = std::move(fn);
+	    this->count = count;
+	    next = 0;
+	    active = workers.size();
+	    generation++;
+	}
+	wake.notify_all();
+	for(uint32_t i = next++; i < count; i = next++) job(i, 0);
+	std::unique_lock lock {mutex};
+	done.wait(lock, [&]() { return active == 0; });
+	job = nullptr;
+    }
+
+    void ThreadPool::work(uint32_t worker) {
+	uint64_t seen = 0;
+	std::unique_lock lock {mutex};
+	while(true) {
+	    wake.wait(lock, [&]() { return stopping || generation != seen; });
+	    if(stopping) return;
+	    seen = generation;
+	    lock.unlock();
+	    for(uint32_t i = next++; i < count; i = next++) job(i, worker);
+	    lock.lock();
+	    if(--active == 0) done.notify_one();
+	}
+    }
+
+    void ThreadPool::clean() {
+	{
+	    std::lock_guard lock {mutex};
+	    stopping = true;
+	}
+	wake.notify_all();
+	for(auto& worker: workers) worker.join();
+	workers.clear();
+    }
+
     void DescriptorPool::add_binding(VkDescriptorType type,
 	    VkShaderStageFlags stage, uint32_t binding, uint32_t count) {
 	bindings.push_back({
@@ -632,23 +1051,27 @@ namespace vb {
 	    return;
     }
 
-    VkDescriptorSet DescriptorPool::create_set(VkDescriptorSetLayout layout,
-	    uint32_t count, void* pNext) {
+    VkDescriptorSet DescriptorPool::create_set(VkDescriptorSetLayout layout, void* pNext) {
+	VkDescriptorSet set;
+	if(!create_sets({&layout, 1}, &set, pNext)) return VK_NULL_HANDLE;
+	return set;
+    }
+
+    bool DescriptorPool::create_sets(std::span<const VkDescriptorSetLayout> layouts,
+	    VkDescriptorSet* sets, void* pNext) {
 	VkDescriptorSetAllocateInfo info = {
 	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 	    .pNext = pNext,
 	    .descriptorPool = pool,
-	    .descriptorSetCount = count,
-	    .pSetLayouts = &layout,
+	    .descriptorSetCount = (uint32_t)layouts.size(),
+	    .pSetLayouts = layouts.data(),
 	};
-	VkDescriptorSet set;
-	if(vkAllocateDescriptorSets(ctx->device, &info, &set) != VK_SUCCESS)
-	    return VK_NULL_HANDLE;
-	return set;
+	return vkAllocateDescriptorSets(ctx->device, &info, sets) == VK_SUCCESS;
     }
 
     VkDescriptorSetLayout DescriptorPool::create_layout(VkDescriptorSetLayoutCreateFlags flags,
 	    void* pNext) {
+	if(ctx->layout_cache) return ctx->layout_cache->set_layout(bindings, flags, pNext);
 	VkDescriptorSetLayoutCreateInfo info {
 	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 	    .pNext = pNext,
@@ -667,7 +1090,8 @@ namespace vb {
     }
 
     void DescriptorPool::clean_layout(VkDescriptorSetLayout& layout) {
-	vkDestroyDescriptorSetLayout(ctx->device, layout, nullptr);
+	if(!ctx->layout_cache || !ctx->layout_cache->owns_set_layout(layout))
+	    vkDestroyDescriptorSetLayout(ctx->device, layout, nullptr);
 	layout = VK_NULL_HANDLE;
     }
 
@@ -677,6 +1101,347 @@ namespace vb {
 	clean_bindings();
     }
 
+    void DescriptorAllocator::create(std::span<const Ratio> ratios, uint32_t sets_per_pool,
+	    VkDescriptorPoolCreateFlags flags) {
+	this->ratios.assign(ratios.begin(), ratios.end());
+	this->sets_per_pool = std::max(sets_per_pool, 1u);
+	this->flags = flags;
+	auto pool = create_pool(this->sets_per_pool);
+	if(pool) ready.push_back(pool);
+    }
+
+    VkDescriptorPool DescriptorAllocator::create_pool(uint32_t sets) {
+	std::vector<VkDescriptorPoolSize> sizes;
+	for(auto& ratio: ratios)
+	    sizes.push_back({ratio.type, std::max((uint32_t)(ratio.ratio * sets), 1u)});
+	VkDescriptorPoolCreateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+	    .flags = flags,
+	    .maxSets = sets,
+	    .poolSizeCount = (uint32_t)sizes.size(),
+	    .pPoolSizes = sizes.data(),
+	};
+	VkDescriptorPool pool;
+	if(vkCreateDescriptorPool(ctx->device, &info, nullptr, &pool) != VK_SUCCESS)
+	    return VK_NULL_HANDLE;
+	capacity += sets;
+	stats.pools++;
+	return pool;
+    }
+
+    VkDescriptorPool DescriptorAllocator::get_pool(uint32_t min_sets) {
+	if(!ready.empty()) return ready.back();
+	// Every chained pool is twice as big, so bursts settle after few of them.
+	sets_per_pool = std::max(std::min(sets_per_pool * 2, max_sets_per_pool), min_sets);
+	auto pool = create_pool(sets_per_pool);
+	if(pool) ready.push_back(pool);
+	return pool;
+    }
+
+    VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, void* pNext) {
+	VkDescriptorSet set;
+	if(!allocate({&layout, 1}, &set, pNext)) return VK_NULL_HANDLE;
+	return set;
+    }
+
+    bool DescriptorAllocator::allocate(std::span<const VkDescriptorSetLayout> layouts,
+	    VkDescriptorSet* sets, void* pNext) {
+	if(layouts.empty()) return true;
+	auto count = (uint32_t)layouts.size();
+	VkDescriptorSetAllocateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+	    .pNext = pNext,
+	    .descriptorPool = get_pool(count),
+	    .descriptorSetCount = count,
+	    .pSetLayouts = layouts.data(),
+	};
+	if(!info.descriptorPool) return false;
+	auto result = vkAllocateDescriptorSets(ctx->device, &info, sets);
+	if(result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+	    full.push_back(ready.back());
+	    ready.pop_back();
+	    stats.exhausted++;
+	    info.descriptorPool = get_pool(count);
+	    if(!info.descriptorPool) return false;
+	    result = vkAllocateDescriptorSets(ctx->device, &info, sets);
+	}
+	if(result != VK_SUCCESS) return false;
+	used_sets += count;
+	stats.sets += count;
+	stats.peak_sets = std::max(stats.peak_sets, used_sets);
+	return true;
+    }
+
+    void DescriptorAllocator::reset() {
+	if(full.empty()) {
+	    for(auto pool: ready) vkResetDescriptorPool(ctx->device, pool, 0);
+	} else {
+	    // Pools were chained since last reset, replace them with one that fits the whole peak.
+	    auto sets = std::min(std::max(sets_per_pool, stats.peak_sets), max_sets_per_pool);
+	    clean();
+	    sets_per_pool = sets;
+	    auto pool = create_pool(sets_per_pool);
+	    if(pool) ready.push_back(pool);
+	}
+	used_sets = 0;
+	stats.peak_sets = 0;
+    }
+
+    float DescriptorAllocator::utilization() const {
+	return capacity ? (float)used_sets / capacity : 0.0f;
+    }
+
+    void DescriptorAllocator::clean() {
+	for(auto pool: ready) vkDestroyDescriptorPool(ctx->device, pool, nullptr);
+	for(auto pool: full) vkDestroyDescriptorPool(ctx->device, pool, nullptr);
+	ready.clear();
+	full.clear();
+	capacity = 0;
+    }
+
+    bool submit(VkQueue queue, std::span<const VkCommandBuffer> cmds,
+	    std::span<const SemaphoreWait> waits, std::span<const SemaphoreSignal> signals, VkFence fence) {
+	std::vector<VkSemaphore> wait_semaphores;
+	std::vector<uint64_t> wait_values;
+	std::vector<VkPipelineStageFlags> wait_stages;
+	for(auto& wait: waits) {
+	    wait_semaphores.push_back(wait.semaphore);
+	    wait_values.push_back(wait.value);
+	    wait_stages.push_back(wait.stage);
+	}
+	std::vector<VkSemaphore> signal_semaphores;
+	std::vector<uint64_t> signal_values;
+	for(auto& signal: signals) {
+	    signal_semaphores.push_back(signal.semaphore);
+	    signal_values.push_back(signal.value);
+	}
+	VkTimelineSemaphoreSubmitInfo timeline = {
+	    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+	    .waitSemaphoreValueCount = (uint32_t)wait_values.size(),
+	    .pWaitSemaphoreValues = wait_values.data(),
+	    .signalSemaphoreValueCount = (uint32_t)signal_values.size(),
+	    .pSignalSemaphoreValues = signal_values.data(),
+	};
+	VkSubmitInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+	    .pNext = &timeline,
+	    .waitSemaphoreCount = (uint32_t)wait_semaphores.size(),
+	    .pWaitSemaphores = wait_semaphores.data(),
+	    .pWaitDstStageMask = wait_stages.data(),
+	    .commandBufferCount = (uint32_t)cmds.size(),
+	    .pCommandBuffers = cmds.data(),
+	    .signalSemaphoreCount = (uint32_t)signal_semaphores.size(),
+	    .pSignalSemaphores = signal_semaphores.data(),
+	};
+	return vkQueueSubmit(queue, 1, &info, fence) == VK_SUCCESS;
+    }
+
+    void Timeline::create(uint64_t initial) {
+	VkSemaphoreTypeCreateInfo type = {
+	    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+	    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+	    .initialValue = initial,
+	};
+	VkSemaphoreCreateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	    .pNext = &type,
+	};
+	if(vkCreateSemaphore(ctx->device, &info, nullptr, &semaphore) != VK_SUCCESS) {
+	    semaphore = VK_NULL_HANDLE;
+	    return;
+	}
+	last = initial;
+	completed = initial;
+    }
+
+    uint64_t Timeline::value() {
+	uint64_t value = completed;
+	if(vkGetSemaphoreCounterValue(ctx->device, semaphore, &value) == VK_SUCCESS)
+	    completed = std::max(completed, value);
+	return value;
+    }
+
+    bool Timeline::is_complete(uint64_t value) {
+	return value <= completed || value <= this->value();
+    }
+
+    bool Timeline::wait(uint64_t value, uint64_t timeout) {
+	if(value <= completed) return true;
+	VkSemaphoreWaitInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+	    .semaphoreCount = 1,
+	    .pSemaphores = &semaphore,
+	    .pValues = &value,
+	};
+	stats.waits++;
+	if(vkWaitSemaphores(ctx->device, &info, timeout) != VK_SUCCESS) return false;
+	completed = std::max(completed, value);
+	return true;
+    }
+
+    bool Timeline::signal(uint64_t value) {
+	VkSemaphoreSignalInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+	    .semaphore = semaphore,
+	    .value = value,
+	};
+	last = std::max(last, value);
+	return vkSignalSemaphore(ctx->device, &info) == VK_SUCCESS;
+    }
+
+    void Timeline::clean() {
+	vkDestroySemaphore(ctx->device, semaphore, nullptr);
+	semaphore = VK_NULL_HANDLE;
+    }
+
+    void FrameRing::create(uint32_t queue_index, uint32_t frames_in_flight,
+	    std::span<const DescriptorAllocator::Ratio> ratios) {
+	timeline.create();
+	if(!timeline.all_valid()) return;
+	for(uint32_t i = 0; i < std::max(frames_in_flight, 1u); i++) {
+	    Frame frame = {.descriptors = {ctx}};
+	    // Command buffers are never reset one by one, whole pool is reset when frame begins.
+	    frame.pool = create_cmd_pool(ctx->device, queue_index, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+	    if(!frame.pool) return clean();
+	    VkCommandBufferAllocateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = frame.pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	    };
+	    vkAllocateCommandBuffers(ctx->device, &info, &frame.cmd);
+	    frame.image_available = create_semaphore(ctx->device);
+	    if(!ratios.empty()) frame.descriptors.create(ratios);
+	    frames.push_back(std::move(frame));
+	    if(!frames.back().cmd || !frames.back().image_available
+		    || (!ratios.empty() && !frames.back().descriptors.all_valid()))
+		return clean();
+	}
+	if(!create_present_semaphores()) return clean();
+    }
+
+    bool FrameRing::create_present_semaphores() {
+	while(render_finished.size() < ctx->swapchain_images.size()) {
+	    auto semaphore = create_semaphore(ctx->device);
+	    if(!semaphore) return false;
+	    render_finished.push_back(semaphore);
+	}
+	return true;
+    }
+
+    std::optional<uint32_t> FrameRing::begin() {
+	auto& frame = current();
+	if(!timeline.wait(frame.value)) return std::nullopt;
+	for(auto& deletion: frame.deletions) deletion();
+	frame.deletions.clear();
+	if(frame.descriptors.all_valid()) frame.descriptors.reset();
+	auto next = ctx->acquire_next_image(frame.image_available);
+	// Recreated swapchain can have more images than before.
+	if(!next.has_value() || !create_present_semaphores()) return std::nullopt;
+	image_index = next.value();
+	vkResetCommandPool(ctx->device, frame.pool, 0);
+	VkCommandBufferBeginInfo begin = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if(vkBeginCommandBuffer(frame.cmd, &begin) != VK_SUCCESS) return std::nullopt;
+	return image_index;
+    }
+
+    bool FrameRing::end(VkQueue queue, VkPipelineStageFlags wait_stage,
+	    std::span<const SemaphoreWait> waits) {
+	auto& frame = current();
+	if(vkEndCommandBuffer(frame.cmd) != VK_SUCCESS) return false;
+	std::vector<SemaphoreWait> all_waits = {{frame.image_available, 0, wait_stage}};
+	all_waits.insert(all_waits.end(), waits.begin(), waits.end());
+	auto value = timeline.next();
+	SemaphoreSignal signals[] = {
+	    {render_finished[image_index], 0},
+	    timeline.signal_info(value),
+	};
+	if(!submit(queue, {&frame.cmd, 1}, all_waits, signals)) return false;
+	frame.value = value;
+	VkPresentInfoKHR present = {
+	    .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+	    .waitSemaphoreCount = 1,
+	    .pWaitSemaphores = &render_finished[image_index],
+	    .swapchainCount = 1,
+	    .pSwapchains = &ctx->swapchain,
+	    .pImageIndices = &image_index,
+	};
+	// Out of date swapchain is handled by next acquire.
+	vkQueuePresentKHR(queue, &present);
+	frame_number++;
+	return true;
+    }
+
+    void FrameRing::clean() {
+	for(auto& frame: frames) {
+	    for(auto& deletion: frame.deletions) deletion();
+	    frame.descriptors.clean();
+	    vkDestroyCommandPool(ctx->device, frame.pool, nullptr);
+	    vkDestroySemaphore(ctx->device, frame.image_available, nullptr);
+	}
+	frames.clear();
+	for(auto semaphore: render_finished) vkDestroySemaphore(ctx->device, semaphore, nullptr);
+	render_finished.clear();
+	timeline.clean();
+    }
+
+    void ThreadCommandPools::create(uint32_t queue_index, uint32_t workers, uint32_t frames_in_flight) {
+	for(uint32_t i = 0; i < std::max(frames_in_flight, 1u); i++) {
+	    auto& pools = frames.emplace_back();
+	    for(uint32_t j = 0; j < std::max(workers, 1u); j++) {
+		auto& worker = pools.emplace_back(Worker{.pool = {ctx}});
+		// Like frames' pools, buffers are only ever reset all at once.
+		worker.pool.create(queue_index, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		if(!worker.pool.all_valid()) return clean();
+	    }
+	}
+    }
+
+    bool ThreadCommandPools::begin(uint32_t frame) {
+	this->frame = frame % frames.size();
+	for(auto& worker: frames[this->frame]) {
+	    if(!worker.pool.reset()) return false;
+	    worker.used = 0;
+	}
+	return true;
+    }
+
+    VkCommandBuffer ThreadCommandPools::secondary(uint32_t worker,
+	    const VkCommandBufferInheritanceRenderingInfo& rendering) {
+	auto& slot = frames[frame][worker];
+	if(slot.used == slot.buffers.size()) {
+	    // Grow in batches, after a few frames every worker has as many buffers as it ever records.
+	    auto count = std::max<size_t>(slot.buffers.size(), 4);
+	    slot.buffers.resize(slot.buffers.size() + count);
+	    if(!slot.pool.allocate({slot.buffers.data() + slot.used, count}, VK_COMMAND_BUFFER_LEVEL_SECONDARY)) {
+		slot.buffers.resize(slot.used);
+		return VK_NULL_HANDLE;
+	    }
+	}
+	auto cmd = slot.buffers[slot.used];
+	VkCommandBufferInheritanceInfo inheritance = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+	    .pNext = &rendering,
+	};
+	VkCommandBufferBeginInfo begin = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+	    .pInheritanceInfo = &inheritance,
+	};
+	if(vkBeginCommandBuffer(cmd, &begin) != VK_SUCCESS) return VK_NULL_HANDLE;
+	slot.used++;
+	return cmd;
+    }
+
+    void ThreadCommandPools::clean() {
+	for(auto& pools: frames)
+	    for(auto& worker: pools) worker.pool.clean();
+	frames.clear();
+    }
+
     void Buffer::create(const size_t size, VkBufferCreateFlags usage, VmaMemoryUsage mem_usage) {
 	VkBufferCreateInfo buffer_info = {
 	    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -692,18 +1457,511 @@ namespace vb {
 	    &buffer, &allocation, &info) != VK_SUCCESS) return;
     }
 
+    bool Buffer::upload(const void* data, VkDeviceSize size, VkDeviceSize offset) {
+	if(!ctx->command_submitter.has_value()) return false;
+	// Ownership of the whole range is handed over with the last copy.
+	auto submit_copy = [&](VkBuffer source, VkDeviceSize source_offset, VkDeviceSize done,
+		VkDeviceSize chunk) {
+	    VkBufferCopy copy = {
+		.srcOffset = source_offset,
+		.dstOffset = offset + done,
+		.size = chunk,
+	    };
+	    bool last = done + chunk == size;
+	    auto transfer = [&](VkCommandBuffer cmd, const OwnershipTransfer& ownership) {
+		vkCmdCopyBuffer(cmd, source, buffer, 1, &copy);
+		if(last) ownership.release(cmd, buffer, offset, size,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+	    };
+	    if(!last) return ctx->submit_upload_to_queue(transfer);
+	    return ctx->submit_upload_to_queue(transfer,
+		    [&](VkCommandBuffer cmd, const OwnershipTransfer& ownership) {
+		ownership.acquire(cmd, buffer, offset, size,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+	    });
+	};
+	auto ring = ctx->staging_ring;
+	VkDeviceSize done = 0;
+	// Blocking upload releases the ring right after submitting, so it can only use it while nothing else is in flight.
+	if(ring && ring->all_valid()) {
+	    while(done < size) {
+		auto staging = ring->allocate(std::min(ring->capacity / 2, size - done), 16, true);
+		if(!staging.has_value()) break;
+		ring->write(*staging, (const char*)data + done);
+		bool submitted = submit_copy(staging->buffer, staging->offset, done, staging->size);
+		ring->release(staging->end);
+		if(!submitted) return false;
+		done += staging->size;
+	    }
+	}
+	if(done == size) return true;
+	auto staging_buffer = Buffer(ctx);
+	staging_buffer.create(size - done, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VMA_MEMORY_USAGE_CPU_TO_GPU);
+	if(!staging_buffer.all_valid()) return false;
+	memcpy(staging_buffer.info.pMappedData, (const char*)data + done, size - done);
+	bool submitted = submit_copy(staging_buffer.buffer, 0, done, size - done);
+	staging_buffer.clean();
+	return submitted;
+    }
+
     void Buffer::clean() {
 	vmaDestroyBuffer(ctx->allocator, buffer, allocation);
 	buffer = VK_NULL_HANDLE;
 	allocation = VK_NULL_HANDLE;
     }
 
-    void Image::create(VkExtent3D extent, bool mipmap, VkSampleCountFlagBits samples,
-	    VkFormat format, VkImageUsageFlags usage) {
-    	this->format = format;
-    	this->extent = extent;
-    	VkImageCreateInfo image_info = {
-    	    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    void DescriptorHeap::query_properties() {
+	if(properties.descriptorBufferOffsetAlignment) return;
+	VkPhysicalDeviceProperties2 device_properties = {
+	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+	    .pNext = &properties,
+	};
+	vkGetPhysicalDeviceProperties2(ctx->physical_device, &device_properties);
+    }
+
+    void DescriptorHeap::create(VkDeviceSize capacity, bool samplers) {
+	query_properties();
+	usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
+	if(samplers) usage |= VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
+	buffer.create(capacity, usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_CPU_TO_GPU);
+	if(!buffer.all_valid()) return;
+	VkBufferDeviceAddressInfo address_info = {
+	    .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+	    .buffer = buffer.buffer,
+	};
+	address = vkGetBufferDeviceAddress(ctx->device, &address_info);
+	this->capacity = capacity;
+	used = 0;
+    }
+
+    VkDeviceSize DescriptorHeap::set_size(VkDescriptorSetLayout layout) {
+	query_properties();
+	VkDeviceSize size = 0;
+	vkGetDescriptorSetLayoutSizeEXT(ctx->device, layout, &size);
+	const VkDeviceSize alignment = properties.descriptorBufferOffsetAlignment;
+	return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    size_t DescriptorHeap::descriptor_size(VkDescriptorType type) {
+	switch(type) {
+	    case VK_DESCRIPTOR_TYPE_SAMPLER: return properties.samplerDescriptorSize;
+	    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		return properties.combinedImageSamplerDescriptorSize;
+	    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: return properties.sampledImageDescriptorSize;
+	    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: return properties.storageImageDescriptorSize;
+	    case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		return properties.uniformTexelBufferDescriptorSize;
+	    case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+		return properties.storageTexelBufferDescriptorSize;
+	    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: return properties.uniformBufferDescriptorSize;
+	    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: return properties.storageBufferDescriptorSize;
+	    default: return 0;
+	}
+    }
+
+    std::optional<DescriptorHeap::Set> DescriptorHeap::allocate(VkDescriptorSetLayout layout,
+	    uint32_t versions) {
+	if(versions == 0) return std::nullopt;
+	Set set = {
+	    .layout = layout,
+	    .offset = used,
+	    .size = set_size(layout),
+	    .versions = versions,
+	};
+	// Offsets stay aligned, because every set size is rounded up to the alignment.
+	if(set.size == 0 || set.offset + set.size * versions > capacity) return std::nullopt;
+	used += set.size * versions;
+	return set;
+    }
+
+    void DescriptorHeap::write(const Set& set, uint32_t version, uint32_t binding,
+	    const VkDescriptorGetInfoEXT& info, uint32_t array_index) {
+	VkDeviceSize binding_offset = 0;
+	vkGetDescriptorSetLayoutBindingOffsetEXT(ctx->device, set.layout, binding, &binding_offset);
+	const size_t size = descriptor_size(info.type);
+	const VkDeviceSize data_offset = offset(set, version) + binding_offset + array_index * size;
+	vkGetDescriptorEXT(ctx->device, &info, size, (char*)buffer.info.pMappedData + data_offset);
+	vmaFlushAllocation(ctx->allocator, buffer.allocation, data_offset, size);
+    }
+
+    void DescriptorHeap::write_image(const Set& set, uint32_t version, uint32_t binding,
+	    VkDescriptorType type, const VkDescriptorImageInfo& image, uint32_t array_index) {
+	VkDescriptorGetInfoEXT info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+	    .type = type,
+	};
+	switch(type) {
+	    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: info.data.pCombinedImageSampler = &image; break;
+	    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: info.data.pSampledImage = &image; break;
+	    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: info.data.pStorageImage = &image; break;
+	    default: return;
+	}
+	write(set, version, binding, info, array_index);
+    }
+
+    void DescriptorHeap::write_buffer(const Set& set, uint32_t version, uint32_t binding,
+	    VkDescriptorType type, VkDeviceAddress buffer_address, VkDeviceSize range, uint32_t array_index) {
+	VkDescriptorAddressInfoEXT address_info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT,
+	    .address = buffer_address,
+	    .range = range,
+	};
+	VkDescriptorGetInfoEXT info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+	    .type = type,
+	};
+	switch(type) {
+	    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: info.data.pUniformBuffer = &address_info; break;
+	    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: info.data.pStorageBuffer = &address_info; break;
+	    default: return;
+	}
+	write(set, version, binding, info, array_index);
+    }
+
+    void DescriptorHeap::bind(VkCommandBuffer cmd) {
+	VkDescriptorBufferBindingInfoEXT info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT,
+	    .address = address,
+	    .usage = usage,
+	};
+	vkCmdBindDescriptorBuffersEXT(cmd, 1, &info);
+    }
+
+    void DescriptorHeap::bind_set(VkCommandBuffer cmd, VkPipelineBindPoint bind_point,
+	    VkPipelineLayout layout, uint32_t first_set, const Set& set, uint32_t version) {
+	const uint32_t index = 0;
+	const VkDeviceSize set_offset = offset(set, version);
+	vkCmdSetDescriptorBufferOffsetsEXT(cmd, bind_point, layout, first_set, 1, &index, &set_offset);
+    }
+
+    void DescriptorHeap::clean() {
+	if(buffer.all_valid()) buffer.clean();
+	address = 0;
+	capacity = 0;
+	used = 0;
+    }
+
+    void StagingRing::create(VkDeviceSize capacity) {
+	capacity = (capacity + 255) & ~(VkDeviceSize)255;
+	buffer.create(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	if(!buffer.all_valid()) return;
+	this->capacity = capacity;
+	head = 0;
+	tail = 0;
+    }
+
+    std::optional<StagingRing::Allocation> StagingRing::allocate(VkDeviceSize size,
+	    VkDeviceSize alignment, bool exclusive) {
+	if(!size || size > capacity || alignment > 256) return std::nullopt;
+	uint64_t current = head.load(std::memory_order_relaxed);
+	uint64_t begin, end;
+	do {
+	    // Tail never passes head, so if they're equal when head is swapped nothing else was in flight.
+	    if(exclusive && current != tail.load(std::memory_order_acquire)) return std::nullopt;
+	    begin = (current + alignment - 1) & ~(alignment - 1);
+	    // Allocation can't straddle the end of the buffer, skip to the beginning instead.
+	    if(begin % capacity + size > capacity) begin = (begin / capacity + 1) * capacity;
+	    end = begin + size;
+	    if(end - tail.load(std::memory_order_acquire) > capacity) return std::nullopt;
+	} while(!head.compare_exchange_weak(current, end,
+		    std::memory_order_acq_rel, std::memory_order_relaxed));
+	stats.allocations++;
+	stats.bytes += size;
+	VkDeviceSize offset = begin % capacity;
+	return Allocation{
+	    .buffer = buffer.buffer,
+	    .offset = offset,
+	    .size = size,
+	    .data = (char*)buffer.info.pMappedData + offset,
+	    .end = end,
+	};
+    }
+
+    void StagingRing::write(const Allocation& allocation, const void* data) {
+	memcpy(allocation.data, data, allocation.size);
+	vmaFlushAllocation(ctx->allocator, buffer.allocation, allocation.offset, allocation.size);
+    }
+
+    void StagingRing::release(uint64_t position) {
+	uint64_t current = tail.load(std::memory_order_relaxed);
+	while(position > current && !tail.compare_exchange_weak(current, position,
+		    std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void StagingRing::clean() {
+	buffer.clean();
+	capacity = 0;
+	head = 0;
+	tail = 0;
+    }
+
+    void UploadQueue::create(uint32_t queue_index, VkQueue queue, uint32_t ring_size) {
+	this->queue_index = queue_index;
+	this->queue = queue;
+	this->ring_size = ring_size;
+	timeline.create();
+	if(!timeline.all_valid()) return;
+	pool = create_cmd_pool(ctx->device, queue_index,
+		VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	if(!pool) return;
+	VkCommandBufferAllocateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+	    .commandPool = pool,
+	    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+	    .commandBufferCount = 1,
+	};
+	slots.reserve(ring_size);
+	for(uint32_t i = 0; i < ring_size; i++) {
+	    Slot slot;
+	    if(vkAllocateCommandBuffers(ctx->device, &info, &slot.cmd) != VK_SUCCESS) return;
+	    slots.push_back(slot);
+	}
+    }
+
+    bool UploadQueue::set_owner(uint32_t queue_index, VkQueue queue) {
+	owner_index = queue_index;
+	owner_queue = queue;
+	if(queue_index == this->queue_index && !ctx->force_ownership_transfer) return true;
+	owner_pool = create_cmd_pool(ctx->device, queue_index,
+		VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	if(!owner_pool) {
+	    log(std::format("Failed to create command pool of upload owner family {}", queue_index));
+	    return false;
+	}
+	VkCommandBufferAllocateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+	    .commandPool = owner_pool,
+	    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+	    .commandBufferCount = 1,
+	};
+	for(auto& slot: slots) {
+	    if(vkAllocateCommandBuffers(ctx->device, &info, &slot.acquire_cmd) == VK_SUCCESS) continue;
+	    // Batches would otherwise record into some command buffers that don't exist.
+	    vkDestroyCommandPool(ctx->device, owner_pool, nullptr);
+	    owner_pool = VK_NULL_HANDLE;
+	    for(auto& other: slots) other.acquire_cmd = VK_NULL_HANDLE;
+	    log(std::format("Failed to allocate command buffers of upload owner family {}", queue_index));
+	    return false;
+	}
+	return true;
+    }
+
+    UploadQueue::Slot* UploadQueue::open_slot() {
+	if(slots.empty()) return nullptr;
+	auto slot = &slots[current];
+	if(slot->recording) return slot;
+	if(slot->ticket > completed_ticket) {
+	    stats.waits++;
+	    if(!timeline.wait(slot->ticket * 2)) return nullptr;
+	    retire(slot->ticket);
+	}
+	vkResetCommandBuffer(slot->cmd, 0);
+	VkCommandBufferBeginInfo begin = {
+	    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if(vkBeginCommandBuffer(slot->cmd, &begin) != VK_SUCCESS) return nullptr;
+	if(owner_pool) {
+	    vkResetCommandBuffer(slot->acquire_cmd, 0);
+	    if(vkBeginCommandBuffer(slot->acquire_cmd, &begin) != VK_SUCCESS) return nullptr;
+	}
+	slot->recording = true;
+	return slot;
+    }
+
+    void UploadQueue::retire(uint64_t ticket) {
+	// Batches are submitted to the same queue, so all older ones are finished as well.
+	if(ticket > completed_ticket) completed_ticket = ticket;
+	for(auto& slot: slots) {
+	    if(slot.recording || slot.ticket > completed_ticket) continue;
+	    for(auto& buffer: slot.staging_buffers) buffer.clean();
+	    slot.staging_buffers.clear();
+	    slot.staging_size = 0;
+	    if(slot.staging_mark && ctx->staging_ring) ctx->staging_ring->release(slot.staging_mark);
+	    slot.staging_mark = 0;
+	}
+    }
+
+    void UploadQueue::record(std::function<void(VkCommandBuffer cmd)>&& fn) {
+	auto slot = open_slot();
+	if(!slot) return;
+	fn(slot->cmd);
+	stats.jobs++;
+    }
+
+    void UploadQueue::record_acquire(std::function<void(VkCommandBuffer cmd)>&& fn) {
+	auto slot = open_slot();
+	if(!slot) return;
+	fn(owner_pool ? slot->acquire_cmd : slot->cmd);
+    }
+
+    void UploadQueue::keep(Buffer staging) {
+	auto slot = open_slot();
+	if(!slot) {
+	    staging.clean();
+	    return;
+	}
+	slot->staging_size += staging.info.size;
+	slot->staging_buffers.push_back(staging);
+	if(slot->staging_size >= flush_threshold) flush();
+    }
+
+    std::optional<StagingRing::Allocation> UploadQueue::allocate_staging(VkDeviceSize size,
+	    VkDeviceSize alignment) {
+	auto ring = ctx->staging_ring;
+	if(!ring || !ring->all_valid() || size > ring->capacity) return std::nullopt;
+	for(;;) {
+	    auto slot = open_slot();
+	    if(!slot) return std::nullopt;
+	    auto allocation = ring->allocate(size, alignment);
+	    if(allocation.has_value()) {
+		slot->staging_mark = std::max(slot->staging_mark, allocation->end);
+		return allocation;
+	    }
+	    ring->stats.stalls++;
+	    flush();
+	    if(completed_ticket == last_ticket) return std::nullopt;
+	    if(!wait(completed_ticket + 1)) return std::nullopt;
+	}
+    }
+
+    bool UploadQueue::upload(VkBuffer destination, const void* data, VkDeviceSize size,
+	    VkDeviceSize offset) {
+	if(!all_valid()) return false;
+	auto ring = ctx->staging_ring;
+	VkDeviceSize done = 0;
+	if(ring && ring->all_valid()) {
+	    while(done < size) {
+		auto staging = allocate_staging(std::min(ring->capacity / 2, size - done));
+		if(!staging.has_value()) break;
+		ring->write(*staging, (const char*)data + done);
+		VkBufferCopy copy = {
+		    .srcOffset = staging->offset,
+		    .dstOffset = offset + done,
+		    .size = staging->size,
+		};
+		record([&](VkCommandBuffer cmd) {
+		    vkCmdCopyBuffer(cmd, staging->buffer, destination, 1, &copy);
+		});
+		done += staging->size;
+	    }
+	}
+	auto ownership = this->ownership();
+	auto transfer_ownership = [&]() {
+	    record([&](VkCommandBuffer cmd) {
+		ownership.release(cmd, destination, offset, size,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+	    });
+	    record_acquire([&](VkCommandBuffer cmd) {
+		ownership.acquire(cmd, destination, offset, size,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+	    });
+	};
+	if(done == size) {
+	    transfer_ownership();
+	    return true;
+	}
+	auto staging_buffer = Buffer(ctx);
+	staging_buffer.create(size - done, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VMA_MEMORY_USAGE_CPU_TO_GPU);
+	if(!staging_buffer.all_valid()) return false;
+	memcpy(staging_buffer.info.pMappedData, (const char*)data + done, size - done);
+	VkBufferCopy copy = {
+	    .dstOffset = offset + done,
+	    .size = size - done,
+	};
+	record([&](VkCommandBuffer cmd) {
+	    vkCmdCopyBuffer(cmd, staging_buffer.buffer, destination, 1, &copy);
+	});
+	transfer_ownership();
+	keep(staging_buffer);
+	return true;
+    }
+
+    uint64_t UploadQueue::flush() {
+	if(slots.empty()) return 0;
+	auto& slot = slots[current];
+	if(!slot.recording) return last_ticket;
+	slot.recording = false;
+	// Nothing of the batch reached the queue. Its staging may share ring space with batches still in flight,
+	// so it's released together with the last submitted one instead of right away.
+	auto abandon = [&]() -> uint64_t {
+	    slot.ticket = last_ticket;
+	    retire(completed_ticket);
+	    return 0;
+	};
+	auto submitted = [&]() {
+	    slot.ticket = ++last_ticket;
+	    stats.submits++;
+	    current = (current + 1) % slots.size();
+	};
+	if(vkEndCommandBuffer(slot.cmd) != VK_SUCCESS) return abandon();
+	auto ticket = last_ticket + 1;
+	auto finished = timeline.signal_info(ticket * 2);
+	if(owner_pool) {
+	    // Owner's submit waits for the upload one on the timeline, so its signal covers both.
+	    if(vkEndCommandBuffer(slot.acquire_cmd) != VK_SUCCESS) return abandon();
+	    auto uploaded = timeline.signal_info(ticket * 2 - 1);
+	    if(!submit(queue, {&slot.cmd, 1}, {}, {&uploaded, 1})) return abandon();
+	    auto wait = timeline.wait_info(ticket * 2 - 1, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+	    if(!submit(owner_queue, {&slot.acquire_cmd, 1}, {&wait, 1}, {&finished, 1})) {
+		// Upload is already queued and signals `2 * ticket - 1`, so the ticket is used up either way.
+		// It's completed from CPU once the upload finishes, so waits on it don't hang.
+		submitted();
+		if(!timeline.wait(ticket * 2 - 1) || !timeline.signal(ticket * 2))
+		    log(std::format("Upload batch {} couldn't be completed", ticket));
+		log(std::format("Ownership of upload batch {} wasn't acquired", ticket));
+		return 0;
+	    }
+	} else if(!submit(queue, {&slot.cmd, 1}, {}, {&finished, 1})) return abandon();
+	submitted();
+	return slot.ticket;
+    }
+
+    bool UploadQueue::is_complete(uint64_t ticket) {
+	if(ticket <= completed_ticket) return true;
+	if(ticket > last_ticket || !timeline.is_complete(ticket * 2)) return false;
+	retire(ticket);
+	return true;
+    }
+
+    bool UploadQueue::wait(uint64_t ticket, uint64_t timeout) {
+	if(ticket <= completed_ticket) return true;
+	if(ticket > last_ticket) return false;
+	stats.waits++;
+	if(!timeline.wait(ticket * 2, timeout)) return false;
+	retire(ticket);
+	return true;
+    }
+
+    bool UploadQueue::finish() {
+	// Failed submit returns 0 just like queue that never submitted anything, only open batch tells them apart.
+	bool pending = !slots.empty() && slots[current].recording;
+	auto ticket = flush();
+	if(pending && ticket == 0) return false;
+	return wait(ticket);
+    }
+
+    void UploadQueue::clean() {
+	finish();
+	for(auto& slot: slots)
+	    for(auto& buffer: slot.staging_buffers) buffer.clean();
+	slots.clear();
+	timeline.clean();
+	vkDestroyCommandPool(ctx->device, pool, nullptr);
+	vkDestroyCommandPool(ctx->device, owner_pool, nullptr);
+	pool = VK_NULL_HANDLE;
+	owner_pool = VK_NULL_HANDLE;
+    }
+
+    void Image::create(VkExtent3D extent, bool mipmap, VkSampleCountFlagBits samples,
+	    VkFormat format, VkImageUsageFlags usage) {
+    	this->format = format;
+    	this->extent = extent;
+    	VkImageCreateInfo image_info = {
+    	    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 	    .imageType = VK_IMAGE_TYPE_2D,
 	    .format = format,
 	    .extent = extent,
@@ -717,6 +1975,12 @@ namespace vb {
 	    image_info.mipLevels = (uint32_t)(floorf(log2(std::max(extent.width, extent.height))))+1;
 	    mip_level = image_info.mipLevels;
 	}
+	storage_mipmaps = mipmap && mip_generator && mip_generator->supports(format, mip_level);
+	if(storage_mipmaps) {
+	    // Levels are written through UNORM storage views, sRGB formats can't be stored to.
+	    image_info.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+	    image_info.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
     	VmaAllocationCreateInfo allocation_info = {
     	    .usage = VMA_MEMORY_USAGE_GPU_ONLY,
 	    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
@@ -727,8 +1991,13 @@ namespace vb {
 
 	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
 	if(format == VK_FORMAT_D32_SFLOAT) aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	VkImageViewUsageCreateInfo view_usage = {
+	    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+	    .usage = usage,
+	};
     	VkImageViewCreateInfo info = {
     	    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+	    .pNext = storage_mipmaps ? &view_usage : nullptr,
     	    .image = image,
     	    .viewType = VK_IMAGE_VIEW_TYPE_2D,
     	    .format = format,
@@ -742,99 +2011,222 @@ namespace vb {
 	    return;
     }
 
+    void Image::record_begin_upload(VkCommandBuffer cmd) {
+	transition_image(cmd, image,
+	    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    }
+
+    void Image::record_copy(VkCommandBuffer cmd, VkBuffer source, VkDeviceSize offset,
+	    uint32_t first_row, uint32_t rows) {
+	VkBufferImageCopy copy = {
+	    .bufferOffset = offset,
+	    .imageSubresource = {
+	        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+	        .layerCount = 1,
+	    },
+	    .imageOffset = {0, (int32_t)first_row, 0},
+	    .imageExtent = {extent.width, rows, 1},
+	};
+	vkCmdCopyBufferToImage(cmd, source, image,
+	    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+    }
+
+    void Image::record_copy_level(VkCommandBuffer cmd, VkBuffer source, VkDeviceSize offset,
+	    uint32_t level) {
+	// Tightly packed rows, so block compressed levels are copied with the same region.
+	VkBufferImageCopy copy = {
+	    .bufferOffset = offset,
+	    .imageSubresource = {
+	        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.mipLevel = level,
+	        .layerCount = 1,
+	    },
+	    .imageExtent = {std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u), 1},
+	};
+	vkCmdCopyBufferToImage(cmd, source, image,
+	    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+    }
+
+    void Image::record_release(VkCommandBuffer cmd, const OwnershipTransfer& ownership,
+	    bool mipmap) {
+	if(mipmap) ownership.release(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+	else ownership.release(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    void Image::record_acquire(VkCommandBuffer cmd, const OwnershipTransfer& ownership,
+	    bool mipmap) {
+	// Blits need graphics queue, so mipmaps are generated after acquiring the image.
+	if(mipmap) {
+	    ownership.acquire(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		    VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+	    if(!defer_mipmaps) generate_mipmaps(cmd);
+	} else ownership.acquire(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    void Image::generate_mipmaps(VkCommandBuffer cmd) {
+	if(storage_mipmaps && mip_generator->record(cmd, *this)) return;
+	if(mip_generator) mip_generator->stats.fallbacks++;
+	record_blit_mipmaps(cmd);
+    }
+
+    void Image::record_blit_mipmaps(VkCommandBuffer cmd) {
+	int32_t mip_width = extent.width;
+	int32_t mip_height = extent.height;
+	VkImageMemoryBarrier barrier = {
+	    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+	    .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+	    .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+	    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .image = image,
+	    .subresourceRange = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.levelCount = 1,
+		.layerCount = 1,
+	    },
+	};
+	for(uint32_t i = 1; i < mip_level; i++) {
+	    barrier.subresourceRange.baseMipLevel = i - 1;
+	    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+		VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+		1, &barrier);
+	    VkImageBlit blit = {
+		.srcSubresource = {
+		    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		    .mipLevel = i - 1,
+		    .layerCount = 1,
+		},
+		.srcOffsets = {{}, {mip_width, mip_height, 1}},
+		.dstSubresource = {
+		    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		    .mipLevel = i,
+		    .layerCount = 1,
+		},
+		.dstOffsets = {{}, {
+		    mip_width > 1 ? mip_width/2 : 1,
+		    mip_height > 1 ? mip_height/2 : 1, 1}},
+	    };
+	    vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		    image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		    1, &blit, VK_FILTER_LINEAR);
+	    if(mip_width > 1) mip_width /= 2;
+	    if(mip_height > 1) mip_height /= 2;
+	    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+		1, &barrier);
+	}
+	barrier.subresourceRange.baseMipLevel = mip_level - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+	    1, &barrier);
+    }
+
     void Image::create(void* data, VkExtent3D extent, bool mipmap, VkSampleCountFlagBits samples,
 	    VkFormat format, VkImageUsageFlags usage) {
 	if(!ctx->command_submitter.has_value()) return;
-	size_t data_size = extent.depth * extent.width * extent.height * 4;
-	auto staging_buffer = Buffer(ctx);
-	staging_buffer.create(data_size,
-	    VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	memcpy(staging_buffer.info.pMappedData, data, data_size);
 	create(extent, mipmap, samples, format, usage);
 	if(!all_valid()) return;
-	ctx->submit_command_to_queue([&](VkCommandBuffer cmd) {
-	    transition_image(cmd, image,
-		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	    VkBufferImageCopy copy = {
-	        .imageSubresource = {
-	            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-	            .layerCount = 1,
-	        },
-	        .imageExtent = extent,
+	auto submit_copy = [&](VkBuffer source, VkDeviceSize source_offset, uint32_t row,
+		uint32_t rows) {
+	    bool last = row + rows == extent.height;
+	    auto transfer = [&](VkCommandBuffer cmd, const OwnershipTransfer& ownership) {
+		if(row == 0) record_begin_upload(cmd);
+		record_copy(cmd, source, source_offset, row, rows);
+		if(last) record_release(cmd, ownership, mipmap);
 	    };
-	    vkCmdCopyBufferToImage(cmd, staging_buffer.buffer, image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
-	    
-	    if(mipmap) {
-		int32_t mip_width = extent.width;
-	    	int32_t mip_height = extent.height;
-		VkImageMemoryBarrier barrier = {
-		    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		    .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
-		    .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-		    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		    .image = image,
-		    .subresourceRange = {
-			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.levelCount = 1,
-			.layerCount = 1,
-		    },
-		};
-		for(uint32_t i = 1; i < mip_level; i++) {
-		    barrier.subresourceRange.baseMipLevel = i - 1;
-		    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
-		    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, 
-			VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
-			1, &barrier);
-		    VkImageBlit blit = {
-			.srcSubresource = {
-			    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			    .mipLevel = i - 1,
-			    .layerCount = 1,
-			},
-			.srcOffsets = {{}, {mip_width, mip_height, 1}},
-			.dstSubresource = {
-			    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			    .mipLevel = i,
-			    .layerCount = 1,
-			},
-			.dstOffsets = {{}, {
-			    mip_width > 1 ? mip_width/2 : 1,
-			    mip_height > 1 ? mip_height/2 : 1, 1}},
-		    };
-		    vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			    image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			    1, &blit, VK_FILTER_LINEAR);
-		    if(mip_width > 1) mip_width /= 2;
-		    if(mip_height > 1) mip_height /= 2;
-		    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, 
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
-			1, &barrier);
-		}
-		barrier.subresourceRange.baseMipLevel = mip_level - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, 
-    		    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
-	    	    1, &barrier);
-	    } else {
-		transition_image(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	    if(!last) return ctx->submit_upload_to_queue(transfer);
+	    return ctx->submit_upload_to_queue(transfer,
+		    [&](VkCommandBuffer cmd, const OwnershipTransfer& ownership) {
+		record_acquire(cmd, ownership, mipmap);
+	    });
+	};
+	const VkDeviceSize row_size = extent.width * 4;
+	auto ring = ctx->staging_ring;
+	uint32_t row = 0;
+	// Like `Buffer::upload`, every chunk is released right after its submit, so it needs the ring to itself.
+	if(ring && ring->all_valid() && row_size <= ring->capacity / 2) {
+	    const uint32_t chunk_rows = ring->capacity / 2 / row_size;
+	    while(row < extent.height) {
+		const uint32_t rows = std::min(chunk_rows, extent.height - row);
+		auto staging = ring->allocate(rows * row_size, 16, true);
+		if(!staging.has_value()) break;
+		ring->write(*staging, (char*)data + row * row_size);
+		bool submitted = submit_copy(staging->buffer, staging->offset, row, rows);
+		ring->release(staging->end);
+		if(!submitted) return;
+		row += rows;
 	    }
-	});
+	}
+	if(row == extent.height) return;
+	auto staging_buffer = Buffer(ctx);
+	staging_buffer.create((extent.height - row) * row_size,
+	    VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	if(!staging_buffer.all_valid()) return;
+	memcpy(staging_buffer.info.pMappedData, (char*)data + row * row_size,
+		(extent.height - row) * row_size);
+	submit_copy(staging_buffer.buffer, 0, row, extent.height - row);
 	staging_buffer.clean();
     }
 
+    void Image::create(UploadQueue& queue, void* data, VkExtent3D extent, bool mipmap,
+	    VkSampleCountFlagBits samples, VkFormat format, VkImageUsageFlags usage) {
+	if(!queue.all_valid()) return;
+	create(extent, mipmap, samples, format, usage);
+	if(!all_valid()) return;
+	const VkDeviceSize row_size = extent.width * 4;
+	auto ring = ctx->staging_ring;
+	uint32_t row = 0;
+	queue.record([&](VkCommandBuffer cmd) { record_begin_upload(cmd); });
+	if(ring && ring->all_valid() && row_size <= ring->capacity / 2) {
+	    const uint32_t chunk_rows = ring->capacity / 2 / row_size;
+	    while(row < extent.height) {
+		const uint32_t rows = std::min(chunk_rows, extent.height - row);
+		auto staging = queue.allocate_staging(rows * row_size);
+		if(!staging.has_value()) break;
+		ring->write(*staging, (char*)data + row * row_size);
+		queue.record([&](VkCommandBuffer cmd) {
+		    record_copy(cmd, staging->buffer, staging->offset, row, rows);
+		});
+		row += rows;
+	    }
+	}
+	if(row < extent.height) {
+	    auto staging_buffer = Buffer(ctx);
+	    staging_buffer.create((extent.height - row) * row_size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	    if(staging_buffer.all_valid()) {
+		memcpy(staging_buffer.info.pMappedData, (char*)data + row * row_size,
+			(extent.height - row) * row_size);
+		queue.record([&](VkCommandBuffer cmd) {
+		    record_copy(cmd, staging_buffer.buffer, 0, row, extent.height - row);
+		});
+		queue.keep(staging_buffer);
+	    }
+	}
+	auto ownership = queue.ownership();
+	queue.record([&](VkCommandBuffer cmd) { record_release(cmd, ownership, mipmap); });
+	queue.record_acquire([&](VkCommandBuffer cmd) { record_acquire(cmd, ownership, mipmap); });
+    }
+
     void Image::create(const char* path, bool mipmap, VkSampleCountFlagBits samples,
 	    VkFormat format, VkImageUsageFlags usage) {
 	int w, h, c;
@@ -845,6 +2237,125 @@ namespace vb {
 	stbi_image_free(data);
     }
 
+    struct Ktx2 {
+	VkFormat format;
+	VkExtent3D extent;
+	struct Level {
+	    VkDeviceSize offset;
+	    VkDeviceSize size;
+	};
+	std::vector<Level> levels;
+    };
+
+    std::optional<Ktx2> read_ktx2(const uint8_t* data, size_t size) {
+	static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+	// Identifier, 9 header fields and index of data format, key/value and supercompression data.
+	const size_t level_index = 80;
+	if(size < level_index || memcmp(data, identifier, sizeof(identifier))) {
+	    log("Not a KTX2 file");
+	    return std::nullopt;
+	}
+	uint32_t header[9];
+	memcpy(header, data + sizeof(identifier), sizeof(header));
+	auto [format, type_size, width, height, depth, layers, faces, level_count, supercompression] = header;
+	if(format == VK_FORMAT_UNDEFINED) {
+	    log("KTX2 with Basis Universal data is not supported");
+	    return std::nullopt;
+	}
+	if(supercompression) {
+	    log(std::format("KTX2 supercompression scheme {} is not supported", supercompression));
+	    return std::nullopt;
+	}
+	if(!height || depth > 1 || layers > 1 || faces != 1) {
+	    log("Only 2D KTX2 images without layers and faces are supported");
+	    return std::nullopt;
+	}
+	// Level count of 0 asks for mipmaps generated at runtime, only level 0 is stored then.
+	level_count = std::max(level_count, 1u);
+	if(level_count > 32 || level_index + level_count * 24 > size) return std::nullopt;
+	Ktx2 ktx2 = {(VkFormat)format, {width, height, 1}};
+	for(uint32_t i = 0; i < level_count; i++) {
+	    uint64_t level[3];
+	    memcpy(level, data + level_index + i * 24, sizeof(level));
+	    if(level[0] > size || level[1] > size - level[0]) return std::nullopt;
+	    ktx2.levels.push_back({level[0], level[1]});
+	}
+	return ktx2;
+    }
+
+    bool create_ktx2_image(Image& image, const Ktx2& ktx2, VkImageUsageFlags usage) {
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(image.ctx->physical_device, ktx2.format, &properties);
+	if(!(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+	    log(std::format("KTX2 format {} is not supported by device", (int)ktx2.format));
+	    return false;
+	}
+	image.mip_level = ktx2.levels.size();
+	image.create(ktx2.extent, false, VK_SAMPLE_COUNT_1_BIT, ktx2.format, usage);
+	return image.all_valid();
+    }
+
+    void Image::create_ktx2(const void* data, size_t size, VkImageUsageFlags usage) {
+	if(!ctx->command_submitter.has_value()) return;
+	auto ktx2 = read_ktx2((const uint8_t*)data, size);
+	if(!ktx2.has_value() || !create_ktx2_image(*this, *ktx2, usage)) return;
+	// Level offsets are aligned to texel blocks within the file, so it's staged whole.
+	auto staging_buffer = Buffer(ctx);
+	staging_buffer.create(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	if(!staging_buffer.all_valid()) return;
+	memcpy(staging_buffer.info.pMappedData, data, size);
+	ctx->submit_upload_to_queue([&](VkCommandBuffer cmd, const OwnershipTransfer& ownership) {
+	    record_begin_upload(cmd);
+	    for(uint32_t i = 0; i < mip_level; i++)
+		record_copy_level(cmd, staging_buffer.buffer, ktx2->levels[i].offset, i);
+	    record_release(cmd, ownership, false);
+	}, [&](VkCommandBuffer cmd, const OwnershipTransfer& ownership) {
+	    record_acquire(cmd, ownership, false);
+	});
+	staging_buffer.clean();
+    }
+
+    void Image::create_ktx2(UploadQueue& queue, const void* data, size_t size,
+	    VkImageUsageFlags usage) {
+	if(!queue.all_valid()) return;
+	auto ktx2 = read_ktx2((const uint8_t*)data, size);
+	if(!ktx2.has_value() || !create_ktx2_image(*this, *ktx2, usage)) return;
+	auto ring = ctx->staging_ring;
+	queue.record([&](VkCommandBuffer cmd) { record_begin_upload(cmd); });
+	for(uint32_t i = 0; i < mip_level; i++) {
+	    const auto& level = ktx2->levels[i];
+	    const char* source = (const char*)data + level.offset;
+	    std::optional<StagingRing::Allocation> staging;
+	    if(ring && ring->all_valid() && level.size <= ring->capacity / 2)
+		staging = queue.allocate_staging(level.size);
+	    if(staging.has_value()) {
+		ring->write(*staging, source);
+		queue.record([&](VkCommandBuffer cmd) {
+		    record_copy_level(cmd, staging->buffer, staging->offset, i);
+		});
+		continue;
+	    }
+	    auto staging_buffer = Buffer(ctx);
+	    staging_buffer.create(level.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		    VMA_MEMORY_USAGE_CPU_TO_GPU);
+	    if(!staging_buffer.all_valid()) continue;
+	    memcpy(staging_buffer.info.pMappedData, source, level.size);
+	    queue.record([&](VkCommandBuffer cmd) {
+		record_copy_level(cmd, staging_buffer.buffer, 0, i);
+	    });
+	    queue.keep(staging_buffer);
+	}
+	auto ownership = queue.ownership();
+	queue.record([&](VkCommandBuffer cmd) { record_release(cmd, ownership, false); });
+	queue.record_acquire([&](VkCommandBuffer cmd) { record_acquire(cmd, ownership, false); });
+    }
+
+    void Image::create_ktx2(const char* path, VkImageUsageFlags usage) {
+	MappedFile file {path};
+	if(!file.data) return;
+	create_ktx2(file.data, file.size, usage);
+    }
+
     void Image::clean() {
 	vkDestroyImageView(ctx->device, image_view, nullptr);
 	vmaDestroyImage(ctx->allocator, image, allocation);
@@ -853,6 +2364,227 @@ namespace vb {
 	allocation = VK_NULL_HANDLE;
     }
 
+    void MipGenerator::create(const char* path, uint32_t max_images) {
+	// Pool with no sets is invalid, so there's always room for at least one dispatch.
+	max_images = std::max(max_images, 1u);
+	this->max_images = max_images;
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(ctx->physical_device, VK_FORMAT_R8G8B8A8_UNORM,
+		&properties);
+	storage_supported = properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+	shader = create_shader_module(ctx->device, path);
+	if(!shader) return;
+
+	VkDescriptorSetLayoutBinding bindings[max_levels + 1];
+	for(uint32_t i = 0; i <= max_levels; i++) {
+	    bindings[i] = {
+		.binding = i,
+		.descriptorType = i < max_levels
+		    ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	    };
+	}
+	VkDescriptorSetLayoutCreateInfo set_info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+	    .bindingCount = max_levels + 1,
+	    .pBindings = bindings,
+	};
+	if(vkCreateDescriptorSetLayout(ctx->device, &set_info, nullptr, &set_layout) != VK_SUCCESS)
+	    return;
+	VkPushConstantRange push_constant = {
+	    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	    .size = 3 * sizeof(uint32_t),
+	};
+	VkPipelineLayoutCreateInfo layout_info = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+	    .setLayoutCount = 1,
+	    .pSetLayouts = &set_layout,
+	    .pushConstantRangeCount = 1,
+	    .pPushConstantRanges = &push_constant,
+	};
+	if(vkCreatePipelineLayout(ctx->device, &layout_info, nullptr, &layout) != VK_SUCCESS)
+	    return;
+	VkComputePipelineCreateInfo pipeline_info = {
+	    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+	    .stage = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+		.module = shader,
+		.pName = "main",
+	    },
+	    .layout = layout,
+	};
+	PipelineCache::Feedback feedback;
+	auto cache = ctx->pipeline_cache;
+	if(cache) pipeline_info.pNext = cache->chain(feedback, nullptr);
+	if(vkCreateComputePipelines(ctx->device, ctx->pipeline_cache_handle(), 1, &pipeline_info,
+		    nullptr, &pipeline) != VK_SUCCESS) return;
+	if(cache) cache->record(feedback);
+
+	VkDescriptorPoolSize sizes[] = {
+	    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, max_images * max_levels},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, max_images},
+	};
+	VkDescriptorPoolCreateInfo pool_info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+	    .maxSets = max_images,
+	    .poolSizeCount = 2,
+	    .pPoolSizes = sizes,
+	};
+	if(vkCreateDescriptorPool(ctx->device, &pool_info, nullptr, &pool) != VK_SUCCESS) return;
+	counters.create(max_images * counter_stride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    }
+
+    bool MipGenerator::supports(VkFormat format, uint32_t levels) {
+	return all_valid() && storage_supported && levels <= max_levels
+	    && (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB);
+    }
+
+    bool MipGenerator::record(VkCommandBuffer cmd, Image& image) {
+	if(used >= max_images || !supports(image.format, image.mip_level)) return false;
+	VkDescriptorSetAllocateInfo allocate_info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+	    .descriptorPool = pool,
+	    .descriptorSetCount = 1,
+	    .pSetLayouts = &set_layout,
+	};
+	VkDescriptorSet set;
+	if(vkAllocateDescriptorSets(ctx->device, &allocate_info, &set) != VK_SUCCESS) return false;
+
+	// Bindings past image's last level point to it as well, the shader never touches them.
+	VkDescriptorImageInfo image_infos[max_levels];
+	for(uint32_t i = 0; i < max_levels; i++) {
+	    if(i < image.mip_level) {
+		VkImageViewCreateInfo info = {
+		    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		    .image = image.image,
+		    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+		    .format = VK_FORMAT_R8G8B8A8_UNORM,
+		    .subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = i,
+			.levelCount = 1,
+			.layerCount = 1,
+		    },
+		};
+		VkImageView view;
+		if(vkCreateImageView(ctx->device, &info, nullptr, &view) != VK_SUCCESS) return false;
+		views.push_back(view);
+	    }
+	    image_infos[i] = {
+		.imageView = views.back(),
+		.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+	    };
+	}
+	const VkDeviceSize counter_offset = used * counter_stride;
+	VkDescriptorBufferInfo counter_info = {
+	    .buffer = counters.buffer,
+	    .offset = counter_offset,
+	    .range = sizeof(uint32_t),
+	};
+	VkWriteDescriptorSet writes[] = {
+	    {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = set,
+		.dstBinding = 0,
+		.descriptorCount = max_levels,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		.pImageInfo = image_infos,
+	    },
+	    {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = set,
+		.dstBinding = max_levels,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = &counter_info,
+	    },
+	};
+	vkUpdateDescriptorSets(ctx->device, 2, writes, 0, nullptr);
+
+	vkCmdFillBuffer(cmd, counters.buffer, counter_offset, sizeof(uint32_t), 0);
+	VkBufferMemoryBarrier counter_barrier = {
+	    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+	    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+	    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .buffer = counters.buffer,
+	    .offset = counter_offset,
+	    .size = sizeof(uint32_t),
+	};
+	VkImageMemoryBarrier image_barrier = {
+	    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+	    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+	    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	    .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	    .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+	    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .image = image.image,
+	    .subresourceRange = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.levelCount = VK_REMAINING_MIP_LEVELS,
+		.layerCount = 1,
+	    },
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &counter_barrier,
+	    1, &image_barrier);
+
+	const uint32_t groups_x = (image.extent.width + 63) / 64;
+	const uint32_t groups_y = (image.extent.height + 63) / 64;
+	struct {
+	    uint32_t levels;
+	    uint32_t workgroups;
+	    uint32_t srgb;
+	} constants = {
+	    image.mip_level,
+	    groups_x * groups_y,
+	    image.format == VK_FORMAT_R8G8B8A8_SRGB,
+	};
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+	vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+		&constants);
+	vkCmdDispatch(cmd, groups_x, groups_y, 1);
+
+	image_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	image_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	image_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+	    1, &image_barrier);
+	used++;
+	stats.dispatches++;
+	return true;
+    }
+
+    void MipGenerator::reset() {
+	for(auto& view: views) vkDestroyImageView(ctx->device, view, nullptr);
+	views.clear();
+	if(pool) vkResetDescriptorPool(ctx->device, pool, 0);
+	used = 0;
+    }
+
+    void MipGenerator::clean() {
+	reset();
+	vkDestroyDescriptorPool(ctx->device, pool, nullptr);
+	vkDestroyPipeline(ctx->device, pipeline, nullptr);
+	vkDestroyPipelineLayout(ctx->device, layout, nullptr);
+	vkDestroyDescriptorSetLayout(ctx->device, set_layout, nullptr);
+	vkDestroyShaderModule(ctx->device, shader, nullptr);
+	if(counters.all_valid()) counters.clean();
+	pool = VK_NULL_HANDLE;
+	pipeline = VK_NULL_HANDLE;
+	layout = VK_NULL_HANDLE;
+	set_layout = VK_NULL_HANDLE;
+	shader = VK_NULL_HANDLE;
+    }
+
     void GraphicsPipeline::add_shader(VkShaderModule& shader_module, VkShaderStageFlagBits stage) {
 	VkPipelineShaderStageCreateInfo info = {
 	    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -862,11 +2594,110 @@ namespace vb {
 	};
 	shader_stages.push_back(info);
 	shader_modules.push_back(shader_module);
+	shader_code.emplace_back();
     }
 
     void GraphicsPipeline::add_shader(const char* path, VkShaderStageFlagBits stage) {
-	auto module = create_shader_module(ctx->device, path);
+	MappedFile file {path};
+	auto module = is_spirv(file.bytes())
+	    ? create_shader_module(ctx->device, file.bytes()) : VK_NULL_HANDLE;
 	add_shader(module, stage);
+	if(module) shader_code.back().assign(file.data, file.data + file.size);
+    }
+
+    bool GraphicsPipeline::add_shader(ShaderCache& cache, const char* path,
+	    VkShaderStageFlagBits stage) {
+	auto shader = cache.load(path);
+	if(!shader) return false;
+	VkPipelineShaderStageCreateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+	    .stage = stage,
+	    .pName = "main",
+	};
+	ShaderCache::set_stage(info, shader);
+	shader_stages.push_back(info);
+	shader_code.emplace_back((const char*)shader->code.data(), (const char*)(shader->code.data() + shader->code.size()));
+	return true;
+    }
+
+    std::vector<char> GraphicsPipeline::key(const void* pNext, VkPipelineCreateFlags flags) const {
+	// Serialized field by field, as padding of Vulkan structures isn't guaranteed to be zeroed.
+	std::vector<char> bytes;
+	auto add_bytes = [&](const void* data, size_t size) {
+	    bytes.insert(bytes.end(), (const char*)data, (const char*)data + size);
+	};
+	auto add = [&](const auto& value) { add_bytes(&value, sizeof(value)); };
+	auto add_array = [&](const auto* values, uint32_t count) {
+	    add(count);
+	    if(count) add_bytes(values, sizeof(*values) * count);
+	};
+	add(flags);
+	for(size_t i = 0; i < shader_stages.size(); i++) {
+	    add(shader_stages[i].stage);
+	    add_array(shader_code[i].data(), shader_code[i].size());
+	    add_array(shader_stages[i].pName, strlen(shader_stages[i].pName));
+	}
+	add_array(vertex_input.pVertexBindingDescriptions, vertex_input.vertexBindingDescriptionCount);
+	add_array(vertex_input.pVertexAttributeDescriptions, vertex_input.vertexAttributeDescriptionCount);
+	add(input_assembly.topology);
+	add(input_assembly.primitiveRestartEnable);
+	add(tessellation.patchControlPoints);
+	add(viewport.viewportCount);
+	add(viewport.scissorCount);
+	add(rasterization.depthClampEnable);
+	add(rasterization.rasterizerDiscardEnable);
+	add(rasterization.polygonMode);
+	add(rasterization.cullMode);
+	add(rasterization.frontFace);
+	add(rasterization.depthBiasEnable);
+	add(rasterization.depthBiasConstantFactor);
+	add(rasterization.depthBiasClamp);
+	add(rasterization.depthBiasSlopeFactor);
+	add(rasterization.lineWidth);
+	add(multisample.rasterizationSamples);
+	add(multisample.sampleShadingEnable);
+	add(multisample.minSampleShading);
+	add(multisample.alphaToCoverageEnable);
+	add(multisample.alphaToOneEnable);
+	add(depth_stencil.depthTestEnable);
+	add(depth_stencil.depthWriteEnable);
+	add(depth_stencil.depthCompareOp);
+	add(depth_stencil.depthBoundsTestEnable);
+	add(depth_stencil.stencilTestEnable);
+	add(depth_stencil.front);
+	add(depth_stencil.back);
+	add(depth_stencil.minDepthBounds);
+	add(depth_stencil.maxDepthBounds);
+	add(color_blend.logicOpEnable);
+	add(color_blend.logicOp);
+	add_array(color_blend.pAttachments, color_blend.attachmentCount);
+	add(color_blend.blendConstants);
+	add_array(dynamic_states.data(), dynamic_states.size());
+	add_array(descriptor_set_layouts.data(), descriptor_set_layouts.size());
+	add_array(push_constants.data(), push_constants.size());
+	add(render_pass);
+	add(subpass_index);
+	for(auto next = (const VkBaseInStructure*)pNext; next; next = next->pNext) {
+	    add(next->sType);
+	    if(next->sType == VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO) {
+		auto rendering = (const VkPipelineRenderingCreateInfo*)next;
+		add(rendering->viewMask);
+		add_array(rendering->pColorAttachmentFormats, rendering->colorAttachmentCount);
+		add(rendering->depthAttachmentFormat);
+		add(rendering->stencilAttachmentFormat);
+	    } else add(next);
+	}
+	return bytes;
+    }
+
+    uint64_t GraphicsPipeline::hash(const void* pNext, VkPipelineCreateFlags flags) const {
+	auto bytes = key(pNext, flags);
+	return hash_bytes(bytes.data(), bytes.size());
+    }
+
+    bool GraphicsPipeline::shareable() const {
+	for(auto& code: shader_code) if(code.empty()) return false;
+	return true;
     }
 
     void GraphicsPipeline::add_push_constant(const uint32_t size,
@@ -876,11 +2707,13 @@ namespace vb {
     }
 
     void GraphicsPipeline::create(void* pNext, VkPipelineCreateFlags flags) {
-        VkPipelineDynamicStateCreateInfo dynamic_state = {
-	    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-	    .dynamicStateCount = (uint32_t)dynamic_states.size(),
-	    .pDynamicStates = dynamic_states.data(),
-        };
+	if(ctx->layout_cache) {
+	    layout = ctx->layout_cache->pipeline_layout(descriptor_set_layouts, push_constants);
+	    if(!layout) return;
+	    owns_layout = false;
+	    create_pipeline(pNext, flags);
+	    return;
+	}
 	VkPipelineLayoutCreateInfo pipeline_layout = {
 	    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 	    .setLayoutCount = (uint32_t)descriptor_set_layouts.size(),
@@ -892,6 +2725,16 @@ namespace vb {
 	};
 	if(vkCreatePipelineLayout(ctx->device, &pipeline_layout, nullptr, &layout) != VK_SUCCESS)
 	    return;
+	owns_layout = true;
+	create_pipeline(pNext, flags);
+    }
+
+    void GraphicsPipeline::create_pipeline(void* pNext, VkPipelineCreateFlags flags) {
+	VkPipelineDynamicStateCreateInfo dynamic_state = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+	    .dynamicStateCount = (uint32_t)dynamic_states.size(),
+	    .pDynamicStates = dynamic_states.data(),
+	};
         VkGraphicsPipelineCreateInfo info = {
 	   .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
 	   .pNext = pNext,
@@ -911,13 +2754,164 @@ namespace vb {
 	   .renderPass = render_pass,
 	   .subpass = subpass_index,
         };
-        if(vkCreateGraphicsPipelines(ctx->device, VK_NULL_HANDLE, 1, &info,
+	PipelineCache::Feedback feedback;
+	auto cache = ctx->pipeline_cache;
+	if(cache) info.pNext = cache->chain(feedback, pNext);
+	if(vkCreateGraphicsPipelines(ctx->device, ctx->pipeline_cache_handle(), 1, &info,
 		    NULL, &pipeline) != VK_SUCCESS) return;
+	if(cache) cache->record(feedback);
+    }
+
+    void ShaderCache::create(bool maintenance5) {
+	inline_modules = maintenance5 && ctx->has_device_extension(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+    }
+
+    const ShaderCache::Shader* ShaderCache::load(const char* path) {
+	{
+	    std::lock_guard lock {mutex};
+	    auto known = paths.find(path);
+	    if(known != paths.end()) {
+		stats.hits++;
+		return known->second;
+	    }
+	}
+	MappedFile file {path};
+	if(!is_spirv(file.bytes())) {
+	    log(std::format("{} is not a SPIR-V file", path));
+	    return nullptr;
+	}
+	auto hash = hash_bytes(file.data, file.size);
+	std::lock_guard lock {mutex};
+	stats.mapped_bytes += file.size;
+	auto [begin, end] = shaders.equal_range(hash);
+	for(auto it = begin; it != end; it++) {
+	    auto& code = it->second.code;
+	    if(code.size() * 4 == file.size && !memcmp(code.data(), file.data, file.size)) {
+		stats.hits++;
+		paths.emplace(path, &it->second);
+		return &it->second;
+	    }
+	}
+	// Mapping doesn't outlive this call, while hits compare against the code and inline create info has to live
+	// until pipelines are created.
+	Shader shader = {.hash = hash};
+	shader.code.resize(file.size / 4);
+	memcpy(shader.code.data(), file.data, file.size);
+	if(!inline_modules) {
+	    shader.module = create_shader_module(ctx->device, file.bytes());
+	    if(!shader.module) return nullptr;
+	}
+	stats.misses++;
+	auto& stored = shaders.emplace(hash, std::move(shader))->second;
+	stored.info = {
+	    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+	    .codeSize = stored.code.size() * 4,
+	    .pCode = stored.code.data(),
+	};
+	paths.emplace(path, &stored);
+	return &stored;
+    }
+
+    void ShaderCache::set_stage(VkPipelineShaderStageCreateInfo& stage, const Shader* shader) {
+	if(!shader) return;
+	stage.module = shader->module;
+	stage.pNext = shader->module ? nullptr : &shader->info;
+    }
+
+    void ShaderCache::clean() {
+	std::lock_guard lock {mutex};
+	for(auto& [hash, shader]: shaders) vkDestroyShaderModule(ctx->device, shader.module, nullptr);
+	shaders.clear();
+	paths.clear();
+    }
+
+    bool Context::has_device_extension(const char* name) {
+	for(auto& extension: device_extensions) if(extension == name) return true;
+	return false;
+    }
+
+    VkPipelineCache Context::pipeline_cache_handle() {
+	return pipeline_cache ? pipeline_cache->cache : VK_NULL_HANDLE;
+    }
+
+    void PipelineCache::create(const char* path) {
+	this->path = path;
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(ctx->physical_device, &properties);
+	feedback_supported = ctx->api_version >= VK_API_VERSION_1_3;
+	MappedFile file {path};
+	auto data = file.bytes();
+	VkPipelineCacheHeaderVersionOne header;
+	if(data.size() >= sizeof(header)) {
+	    memcpy(&header, data.data(), sizeof(header));
+	    if(header.headerSize < sizeof(header) || header.headerSize > data.size()) {
+		log(std::format("Pipeline cache {} has broken header", path));
+		data = {};
+	    } else if(header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		    || header.vendorID != properties.vendorID
+		    || header.deviceID != properties.deviceID
+		    || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE)) {
+		log(std::format("Pipeline cache {} was created for another device or driver", path));
+		data = {};
+	    }
+	} else data = {};
+	VkPipelineCacheCreateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+	    .initialDataSize = data.size(),
+	    .pInitialData = data.data(),
+	};
+	if(vkCreatePipelineCache(ctx->device, &info, nullptr, &cache) != VK_SUCCESS) return;
+	stats.loaded_bytes = data.size();
+    }
+
+    bool PipelineCache::save() {
+	if(!cache) return false;
+	size_t size = 0;
+	if(vkGetPipelineCacheData(ctx->device, cache, &size, nullptr) != VK_SUCCESS) return false;
+	std::vector<char> data(size);
+	if(vkGetPipelineCacheData(ctx->device, cache, &size, data.data()) != VK_SUCCESS) return false;
+	auto temp_path = path + ".tmp";
+	{
+	    std::ofstream file {temp_path, std::ios::binary | std::ios::trunc};
+	    if(!file.is_open()) return false;
+	    file.write(data.data(), size);
+	    file.close();
+	    if(file.fail()) {
+		remove(temp_path.c_str());
+		return false;
+	    }
+	}
+	if(rename(temp_path.c_str(), path.c_str())) return false;
+	stats.saved_bytes = size;
+	return true;
+    }
+
+    const void* PipelineCache::chain(Feedback& feedback, const void* pNext) {
+	if(!feedback_supported) return pNext;
+	feedback.info.pNext = pNext;
+	feedback.info.pPipelineCreationFeedback = &feedback.pipeline;
+	return &feedback.info;
+    }
+
+    void PipelineCache::record(const Feedback& feedback) {
+	if(!(feedback.pipeline.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) return;
+	if(feedback.pipeline.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)
+	    stats.hits++;
+	else stats.misses++;
+	stats.creation_ns += feedback.pipeline.duration;
+    }
+
+    void PipelineCache::clean() {
+	vkDestroyPipelineCache(ctx->device, cache, nullptr);
+	cache = VK_NULL_HANDLE;
     }
 
     void GraphicsPipeline::clean() {
-	vkDestroyPipeline(ctx->device, pipeline, nullptr);
-	vkDestroyPipelineLayout(ctx->device, layout, nullptr);
+	if(registry) registry->release(*this);
+	else {
+	    vkDestroyPipeline(ctx->device, pipeline, nullptr);
+	    if(owns_layout) vkDestroyPipelineLayout(ctx->device, layout, nullptr);
+	}
 	pipeline = VK_NULL_HANDLE;
 	layout = VK_NULL_HANDLE;
     }
@@ -927,4 +2921,321 @@ namespace vb {
 	    vkDestroyShaderModule(ctx->device, shader, nullptr);
 	shader_modules.clear();
     }
+
+    void PipelineBatch::add(GraphicsPipeline& pipeline, void* pNext, VkPipelineCreateFlags flags) {
+	entries.push_back({&pipeline, pNext, flags});
+    }
+
+    VkPipelineLayout PipelineBatch::find_layout(const GraphicsPipeline& pipeline) {
+	if(ctx->layout_cache)
+	    return ctx->layout_cache->pipeline_layout(pipeline.descriptor_set_layouts, pipeline.push_constants);
+	auto same_ranges = [](const std::vector<VkPushConstantRange>& a,
+		const std::vector<VkPushConstantRange>& b) {
+	    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+		[](const VkPushConstantRange& x, const VkPushConstantRange& y) {
+		    return x.stageFlags == y.stageFlags && x.offset == y.offset && x.size == y.size;
+		});
+	};
+	for(auto& layout: layouts)
+	    if(layout.descriptor_set_layouts == pipeline.descriptor_set_layouts
+		    && same_ranges(layout.push_constants, pipeline.push_constants))
+		return layout.layout;
+	Layout layout = {pipeline.descriptor_set_layouts, pipeline.push_constants};
+	VkPipelineLayoutCreateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+	    .setLayoutCount = (uint32_t)layout.descriptor_set_layouts.size(),
+	    .pSetLayouts = layout.descriptor_set_layouts.empty()
+		? nullptr : layout.descriptor_set_layouts.data(),
+	    .pushConstantRangeCount = (uint32_t)layout.push_constants.size(),
+	    .pPushConstantRanges = layout.push_constants.empty()
+		? nullptr : layout.push_constants.data(),
+	};
+	if(vkCreatePipelineLayout(ctx->device, &info, nullptr, &layout.layout) != VK_SUCCESS)
+	    return VK_NULL_HANDLE;
+	layouts.push_back(layout);
+	stats.layouts++;
+	return layout.layout;
+    }
+
+    bool PipelineBatch::create(ThreadPool& pool) {
+	// Layouts are created up front, so workers only call thread safe vkCreateGraphicsPipelines.
+	std::vector<Entry> ready;
+	for(auto& entry: entries) {
+	    entry.pipeline->layout = find_layout(*entry.pipeline);
+	    entry.pipeline->owns_layout = false;
+	    if(entry.pipeline->layout) ready.push_back(entry);
+	    else stats.failed++;
+	}
+	std::atomic<uint32_t> failed = 0;
+	std::vector<uint64_t> durations(ready.size());
+	auto start = std::chrono::steady_clock::now();
+	pool.run(ready.size(), [&](uint32_t i, uint32_t) {
+	    auto pipeline_start = std::chrono::steady_clock::now();
+	    ready[i].pipeline->create_pipeline(ready[i].pNext, ready[i].flags);
+	    durations[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		    std::chrono::steady_clock::now() - pipeline_start).count();
+	    if(!ready[i].pipeline->all_valid()) failed++;
+	});
+	stats.wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	for(auto duration: durations) {
+	    stats.creation_ns += duration;
+	    stats.slowest_ns = std::max(stats.slowest_ns, duration);
+	}
+	stats.pipelines += ready.size() - failed;
+	stats.failed += failed;
+	bool all_created = ready.size() == entries.size() && failed == 0;
+	entries.clear();
+	return all_created;
+    }
+
+    void PipelineBatch::clean() {
+	for(auto& layout: layouts) vkDestroyPipelineLayout(ctx->device, layout.layout, nullptr);
+	layouts.clear();
+    }
+
+    bool PipelineRegistry::acquire(GraphicsPipeline& pipeline, void* pNext,
+	    VkPipelineCreateFlags flags) {
+	if(!pipeline.shareable()) {
+	    log("Pipeline with shaders added as VkShaderModule can't be shared");
+	    return false;
+	}
+	auto key = pipeline.key(pNext, flags);
+	auto h = hash_bytes(key.data(), key.size());
+	// Must be called with `mutex` held. Takes the registered pipeline, if there is one.
+	auto share = [&]() {
+	    auto [begin, end] = entries.equal_range(h);
+	    for(auto it = begin; it != end; it++) {
+		if(it->second.key != key) continue;
+		pipeline.pipeline = it->second.pipeline;
+		pipeline.layout = it->second.layout;
+		pipeline.registry = this;
+		pipeline.owns_layout = false;
+		it->second.references++;
+		stats.hits++;
+		return true;
+	    }
+	    return false;
+	};
+	{
+	    std::lock_guard lock {mutex};
+	    if(share()) return true;
+	}
+
+	pipeline.create(pNext, flags);
+	if(!pipeline.all_valid()) {
+	    pipeline.clean();
+	    return false;
+	}
+	std::lock_guard lock {mutex};
+	auto created = pipeline.pipeline;
+	auto created_layout = pipeline.owns_layout ? pipeline.layout : VK_NULL_HANDLE;
+	if(share()) {
+	    // Another thread registered the same pipeline while this one was compiling.
+	    vkDestroyPipeline(ctx->device, created, nullptr);
+	    if(created_layout) vkDestroyPipelineLayout(ctx->device, created_layout, nullptr);
+	    return true;
+	}
+	entries.emplace(h, Entry{std::move(key), pipeline.pipeline, pipeline.layout, 1, pipeline.owns_layout});
+	hashes.emplace(pipeline.pipeline, h);
+	pipeline.registry = this;
+	pipeline.owns_layout = false;
+	stats.misses++;
+	return true;
+    }
+
+    void PipelineRegistry::release(GraphicsPipeline& pipeline) {
+	auto key = pipeline.pipeline;
+	pipeline.registry = nullptr;
+	std::lock_guard lock {mutex};
+	auto h = hashes.find(key);
+	if(h == hashes.end()) return;
+	auto [begin, end] = entries.equal_range(h->second);
+	for(auto it = begin; it != end; it++) {
+	    if(it->second.pipeline != key) continue;
+	    if(--it->second.references == 0) {
+		vkDestroyPipeline(ctx->device, it->second.pipeline, nullptr);
+		if(it->second.owns_layout)
+		    vkDestroyPipelineLayout(ctx->device, it->second.layout, nullptr);
+		entries.erase(it);
+		hashes.erase(h);
+	    }
+	    return;
+	}
+    }
+
+    void PipelineRegistry::clean() {
+	std::lock_guard lock {mutex};
+	for(auto& [key, entry]: entries) {
+	    vkDestroyPipeline(ctx->device, entry.pipeline, nullptr);
+	    if(entry.owns_layout) vkDestroyPipelineLayout(ctx->device, entry.layout, nullptr);
+	}
+	entries.clear();
+	hashes.clear();
+    }
+
+    VkDescriptorSetLayout LayoutCache::set_layout(std::span<const VkDescriptorSetLayoutBinding> bindings,
+	    VkDescriptorSetLayoutCreateFlags flags, const void* pNext) {
+	// Binding flags are the only extension compared by content, as bindless layouts depend on them.
+	auto flags_info = (const VkDescriptorSetLayoutBindingFlagsCreateInfo*)pNext;
+	if(flags_info && (flags_info->sType != VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO
+		    || flags_info->bindingCount != bindings.size() || flags_info->pNext)) {
+	    VkDescriptorSetLayoutCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = pNext,
+		.flags = flags,
+		.bindingCount = (uint32_t)bindings.size(),
+		.pBindings = bindings.data(),
+	    };
+	    VkDescriptorSetLayout layout;
+	    if(vkCreateDescriptorSetLayout(ctx->device, &info, nullptr, &layout) != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+	    std::lock_guard lock {mutex};
+	    stats.uncached++;
+	    return layout;
+	}
+	SetLayout key = {flags};
+	std::vector<uint32_t> order(bindings.size());
+	for(uint32_t i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+	    return bindings[a].binding < bindings[b].binding;
+	});
+	auto immutable = [](const VkDescriptorSetLayoutBinding& binding) {
+	    return binding.pImmutableSamplers && (binding.descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER
+		    || binding.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	};
+	size_t sampler_count = 0;
+	for(auto& binding: bindings) if(immutable(binding)) sampler_count += binding.descriptorCount;
+	// Reserved up front, so bindings can point into it while it's filled.
+	key.immutable_samplers.reserve(sampler_count);
+	for(auto i: order) {
+	    auto binding = bindings[i];
+	    if(immutable(binding)) {
+		auto first = key.immutable_samplers.size();
+		key.immutable_samplers.insert(key.immutable_samplers.end(),
+			binding.pImmutableSamplers, binding.pImmutableSamplers + binding.descriptorCount);
+		binding.pImmutableSamplers = key.immutable_samplers.data() + first;
+	    } else binding.pImmutableSamplers = nullptr;
+	    key.bindings.push_back(binding);
+	    if(flags_info) key.binding_flags.push_back(flags_info->pBindingFlags[i]);
+	}
+
+	// Hashed field by field, as padding of Vulkan structures isn't guaranteed to be zeroed.
+	uint64_t h = hash_bytes(&key.flags, sizeof(key.flags));
+	auto add = [&](const auto& value) { h = hash_bytes(&value, sizeof(value), h); };
+	for(auto& binding: key.bindings) {
+	    add(binding.binding);
+	    add(binding.descriptorType);
+	    add(binding.descriptorCount);
+	    add(binding.stageFlags);
+	}
+	for(auto binding_flags: key.binding_flags) add(binding_flags);
+	for(auto sampler: key.immutable_samplers) add(sampler);
+	auto same = [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+	    return a.binding == b.binding && a.descriptorType == b.descriptorType
+		&& a.descriptorCount == b.descriptorCount && a.stageFlags == b.stageFlags
+		&& !a.pImmutableSamplers == !b.pImmutableSamplers;
+	};
+
+	std::lock_guard lock {mutex};
+	auto [begin, end] = set_layouts.equal_range(h);
+	for(auto it = begin; it != end; it++) {
+	    auto& entry = it->second;
+	    // Samplers are in binding order, so equal bindings with equal samplers use them the same way.
+	    if(entry.flags == key.flags && entry.binding_flags == key.binding_flags
+		    && entry.immutable_samplers == key.immutable_samplers
+		    && std::equal(entry.bindings.begin(), entry.bindings.end(),
+			key.bindings.begin(), key.bindings.end(), same)) {
+		stats.hits++;
+		return entry.layout;
+	    }
+	}
+	VkDescriptorSetLayoutBindingFlagsCreateInfo sorted_flags = {};
+	if(flags_info) {
+	    sorted_flags = *flags_info;
+	    sorted_flags.pBindingFlags = key.binding_flags.data();
+	}
+	VkDescriptorSetLayoutCreateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+	    .pNext = flags_info ? &sorted_flags : nullptr,
+	    .flags = flags,
+	    .bindingCount = (uint32_t)key.bindings.size(),
+	    .pBindings = key.bindings.data(),
+	};
+	if(vkCreateDescriptorSetLayout(ctx->device, &info, nullptr, &key.layout) != VK_SUCCESS)
+	    return VK_NULL_HANDLE;
+	stats.misses++;
+	auto layout = key.layout;
+	// Moving keeps vector storage, so bindings still point into the entry's samplers.
+	set_layouts.emplace(h, std::move(key));
+	owned_set_layouts.insert(layout);
+	return layout;
+    }
+
+    VkPipelineLayout LayoutCache::pipeline_layout(std::span<const VkDescriptorSetLayout> set_layouts,
+	    std::span<const VkPushConstantRange> push_constants) {
+	uint64_t h = hash_bytes(set_layouts.data(), set_layouts.size_bytes());
+	auto add = [&](const auto& value) { h = hash_bytes(&value, sizeof(value), h); };
+	for(auto& range: push_constants) {
+	    add(range.stageFlags);
+	    add(range.offset);
+	    add(range.size);
+	}
+	auto same = [](const VkPushConstantRange& a, const VkPushConstantRange& b) {
+	    return a.stageFlags == b.stageFlags && a.offset == b.offset && a.size == b.size;
+	};
+
+	std::lock_guard lock {mutex};
+	auto [begin, end] = pipeline_layouts.equal_range(h);
+	for(auto it = begin; it != end; it++) {
+	    auto& entry = it->second;
+	    if(std::equal(entry.set_layouts.begin(), entry.set_layouts.end(),
+			set_layouts.begin(), set_layouts.end())
+		    && std::equal(entry.push_constants.begin(), entry.push_constants.end(),
+			push_constants.begin(), push_constants.end(), same)) {
+		stats.hits++;
+		return entry.layout;
+	    }
+	}
+	PipelineLayout entry = {
+	    {set_layouts.begin(), set_layouts.end()},
+	    {push_constants.begin(), push_constants.end()},
+	};
+	VkPipelineLayoutCreateInfo info = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+	    .setLayoutCount = (uint32_t)entry.set_layouts.size(),
+	    .pSetLayouts = entry.set_layouts.empty() ? nullptr : entry.set_layouts.data(),
+	    .pushConstantRangeCount = (uint32_t)entry.push_constants.size(),
+	    .pPushConstantRanges = entry.push_constants.empty() ? nullptr : entry.push_constants.data(),
+	};
+	if(vkCreatePipelineLayout(ctx->device, &info, nullptr, &entry.layout) != VK_SUCCESS)
+	    return VK_NULL_HANDLE;
+	stats.misses++;
+	auto layout = entry.layout;
+	pipeline_layouts.emplace(h, std::move(entry));
+	owned_pipeline_layouts.insert(layout);
+	return layout;
+    }
+
+    bool LayoutCache::owns_set_layout(VkDescriptorSetLayout layout) {
+	std::lock_guard lock {mutex};
+	return owned_set_layouts.contains(layout);
+    }
+
+    bool LayoutCache::owns_pipeline_layout(VkPipelineLayout layout) {
+	std::lock_guard lock {mutex};
+	return owned_pipeline_layouts.contains(layout);
+    }
+
+    void LayoutCache::clean() {
+	std::lock_guard lock {mutex};
+	for(auto& [key, entry]: pipeline_layouts)
+	    vkDestroyPipelineLayout(ctx->device, entry.layout, nullptr);
+	for(auto& [key, entry]: set_layouts)
+	    vkDestroyDescriptorSetLayout(ctx->device, entry.layout, nullptr);
+	pipeline_layouts.clear();
+	set_layouts.clear();
+	owned_set_layouts.clear();
+	owned_pipeline_layouts.clear();
+    }
 }
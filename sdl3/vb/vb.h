@@ -1,7 +1,14 @@
 #pragma once
 
 #define VK_NO_PROTOTYPES
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <functional>
 #include <optional>
 #include <span>
@@ -59,6 +66,28 @@ namespace vb {
 	static VkQueueFlags queue_to_flag(const Queue& queue);
     };
 
+    /**
+     * Queue family ownership transfer of uploaded resources from `src_family` to `dst_family`.
+     *
+     * `release` barriers are recorded on source queue after the copies, and matching `acquire` barriers on destination queue,
+     * which has to wait for the release with a semaphore. When `enabled` is false, `release` records a plain barrier
+     * straight to destination stage and `acquire` records nothing.
+     */
+    struct OwnershipTransfer {
+	uint32_t src_family = VK_QUEUE_FAMILY_IGNORED;
+	uint32_t dst_family = VK_QUEUE_FAMILY_IGNORED;
+	bool enabled = false;
+
+	void release(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout,
+		VkImageLayout new_layout, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) const;
+	void acquire(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout,
+		VkImageLayout new_layout, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) const;
+	void release(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+		VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) const;
+	void acquire(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+		VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) const;
+    };
+
     /**
      * Structure configuring `SDL_Window` and `VkInstance`.
      */
@@ -113,9 +142,12 @@ namespace vb {
         std::vector<std::string> optional_extensions;
     
         VkPhysicalDeviceFeatures vk10features;
+	// Enabled only if the picked device supports them, like `textureCompression*` for assets in any of the formats.
+	VkPhysicalDeviceFeatures optional_vk10features;
         VkPhysicalDeviceVulkan11Features vk11features;
         VkPhysicalDeviceVulkan12Features vk12features;
         VkPhysicalDeviceVulkan13Features vk13features;
+	void* pNext = nullptr;
     };
 
     /**
@@ -131,6 +163,10 @@ namespace vb {
         VkPresentModeKHR present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
     };
 
+    struct StagingRing;
+    struct PipelineCache;
+    struct LayoutCache;
+
     /**
      * Structure containing all basic `Vulkan` and `SDL3` handles.
      */
@@ -163,8 +199,16 @@ namespace vb {
 	    uint32_t index;
 	    VkFence fence = VK_NULL_HANDLE;
 	    VkCommandBuffer buffer = VK_NULL_HANDLE;
+	    VkSemaphore semaphore = VK_NULL_HANDLE;
 	};
 	std::optional<CommandSubmitter> command_submitter = std::nullopt;
+	std::optional<CommandSubmitter> transfer_submitter = std::nullopt;
+	bool force_ownership_transfer = false;
+	StagingRing* staging_ring = nullptr;
+	PipelineCache* pipeline_cache = nullptr;
+	LayoutCache* layout_cache = nullptr;
+	uint32_t api_version = VK_API_VERSION_1_0;
+	std::vector<std::string> device_extensions;
 
 	[[nodiscard]] Context() {};
 	~Context();
@@ -210,10 +254,78 @@ namespace vb {
 	 */
 	bool submit_command_to_queue(std::function<void(VkCommandBuffer cmd)>&& fn);
 
+	/**
+	 * Initialize immediate command submitter on transfer queue, used by `Buffer` and `Image` uploads.
+	 *
+	 * @param cmd Allocated `VkCommandBuffer` from pool on `queue_index` family.
+	 * @param queue `VkQueue` to submit to.
+	 * @param queue_index Index of queue to submit to.
+	 */
+	bool init_transfer_submitter(VkCommandBuffer cmd, VkQueue queue, uint32_t queue_index);
+
+	/**
+	 * Ownership transfer from transfer submitter's to immediate command submitter's queue family.
+	 *
+	 * Enabled when both submitters are initialized and their families differ, or `force_ownership_transfer` is set.
+	 */
+	[[nodiscard]] OwnershipTransfer upload_ownership();
+
+	/**
+	 * Submit upload with transfer submitter and wait for it.
+	 *
+	 * With ownership transfer enabled `transfer` is submitted on transfer queue and `acquire` on immediate command submitter's queue after it.
+	 * Otherwise both are recorded into a single submit of immediate command submitter.
+	 *
+	 * @param transfer Lambda or function that records copies and release barriers.
+	 * @param acquire Lambda or function that records acquire barriers and work that needs destination family. Defaults to `nullptr`.
+	 * @return `false` on failure. Anything already submitted has finished by then, so staging memory can be released.
+	 */
+	bool submit_upload_to_queue(
+		std::function<void(VkCommandBuffer cmd, const OwnershipTransfer& ownership)>&& transfer,
+		std::function<void(VkCommandBuffer cmd, const OwnershipTransfer& ownership)>&& acquire = nullptr);
+
+	/**
+	 * Set `StagingRing` used by `Buffer::upload`, `Image` and `UploadQueue` uploads instead of allocating a staging `VkBuffer` per upload.
+	 *
+	 * Context doesn't own the ring, it has to outlive all uploads and be cleaned before `Context`.
+	 */
+	void set_staging_ring(StagingRing* ring) {
+	    staging_ring = ring;
+	}
+
+	/**
+	 * Set `PipelineCache` used by all pipeline creation.
+	 *
+	 * Context doesn't own the cache, it has to outlive all pipeline creation and be cleaned before `Context`.
+	 */
+	void set_pipeline_cache(PipelineCache* cache) {
+	    pipeline_cache = cache;
+	}
+
+	/**
+	 * Set `LayoutCache` used by `DescriptorPool::create_layout`, `GraphicsPipeline::create` and `PipelineBatch`.
+	 *
+	 * Context doesn't own the cache, it has to outlive all layouts taken from it and be cleaned before `Context`.
+	 */
+	void set_layout_cache(LayoutCache* cache) {
+	    layout_cache = cache;
+	}
+
+	/**
+	 * @return `VkPipelineCache` of set `PipelineCache` or `VK_NULL_HANDLE`, for pipelines created outside of `vb`.
+	 */
+	VkPipelineCache pipeline_cache_handle();
+
+	/**
+	 * @return `true` if device extension `name` was enabled in `create_device`.
+	 */
+	bool has_device_extension(const char* name);
+
 	/**
 	 * Get a pointer to one of created queues.
 	 *
 	 * @param type Type of queue to get.
+	 * @return `nullptr` if queue of `type` wasn't requested in `create_device`.
 	 */
 	QueueIndex* find_queue(const Queue& type);
 
@@ -242,6 +354,8 @@ namespace vb {
 	protected:
 	    bool create_swapchain_image_views();
 	    void destroy_swapchain();
+	    bool submit(CommandSubmitter& submitter, std::function<void(VkCommandBuffer cmd)>& fn,
+		    VkSemaphore wait_semaphore, VkSemaphore signal_semaphore, bool wait);
     };
 
     /**
@@ -250,6 +364,80 @@ namespace vb {
     void transition_image(VkCommandBuffer cmd, VkImage image,
 	    VkImageLayout old_layout, VkImageLayout new_layout);
 
+    /**
+     * Pipeline stages and memory accesses of commands using a resource.
+     */
+    struct Access {
+	VkPipelineStageFlags2 stage;
+	VkAccessFlags2 access;
+    };
+
+    /**
+     * Derives `Access` of commands using image in `layout`.
+     *
+     * Read only layouts are assumed to be sampled in fragment and compute shaders, `VK_IMAGE_LAYOUT_GENERAL` to be compute storage image.
+     * `VK_IMAGE_LAYOUT_UNDEFINED` waits for all commands without making any access available, so reused images
+     * aren't overwritten while earlier commands still read them. Callers knowing the last users of the image should
+     * pass them to `Barriers::image` as `previous` instead. `VK_IMAGE_LAYOUT_PRESENT_SRC_KHR` has no stages,
+     * presentation is ordered by semaphores.
+     */
+    Access layout_access(VkImageLayout layout);
+
+    /**
+     * Collects memory, buffer and image barriers and records them with a single `vkCmdPipelineBarrier2`.
+     * Needs Vulkan 1.3 or `synchronization2` feature.
+     */
+    struct Barriers {
+	std::vector<VkMemoryBarrier2> memory_barriers;
+	std::vector<VkBufferMemoryBarrier2> buffer_barriers;
+	std::vector<VkImageMemoryBarrier2> image_barriers;
+	struct {
+	    uint64_t calls = 0;
+	    uint64_t barriers = 0;
+	} stats;
+
+	/**
+	 * Adds layout transition of all mip levels and array layers of `image`, with stages and accesses derived by `layout_access`.
+	 *
+	 * @param aspect Aspect of `image`. Defaults to `0`, depth for depth attachment layouts and color otherwise.
+	 * @param wait_stage Extra source stage. Swapchain images need the stage acquire semaphore is waited at,
+	 * so the transition doesn't start before the image is acquired.
+	 */
+	Barriers& image(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+		VkImageAspectFlags aspect = 0, VkPipelineStageFlags2 wait_stage = VK_PIPELINE_STAGE_2_NONE);
+
+	/**
+	 * Adds layout transition of all mip levels and array layers of `image` waiting only for `previous`,
+	 * the last commands using it, instead of stages derived from `old_layout`.
+	 *
+	 * Avoids waiting for all commands when reused image is transitioned from `VK_IMAGE_LAYOUT_UNDEFINED`.
+	 */
+	Barriers& image(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+		Access previous, VkImageAspectFlags aspect = 0);
+
+	/**
+	 * Adds image barrier with explicit stages and accesses.
+	 */
+	Barriers& image(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+		Access src, Access dst, const VkImageSubresourceRange& range);
+
+	/**
+	 * Adds barrier of `size` bytes of `buffer` from `offset`.
+	 */
+	Barriers& buffer(VkBuffer buffer, Access src, Access dst,
+		VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	/**
+	 * Adds global memory barrier.
+	 */
+	Barriers& memory(Access src, Access dst);
+
+	/**
+	 * Records all added barriers with one `vkCmdPipelineBarrier2` and clears them. Does nothing if there are none.
+	 */
+	void record(VkCommandBuffer cmd);
+    };
+
     /**
      * Blit source `VkImage` to `dest`.
      */
@@ -262,10 +450,83 @@ namespace vb {
     [[nodiscard]] VkSemaphore create_semaphore(VkDevice device, VkSemaphoreCreateFlags flags = 0);
     [[nodiscard]] VkFence create_fence(VkDevice device, VkFenceCreateFlags flags = 0);
     [[nodiscard]] VkShaderModule create_shader_module(VkDevice device, const char* path);
+    [[nodiscard]] VkShaderModule create_shader_module(VkDevice device, std::span<const char> code);
+
+    /**
+     * @return `true` if `code` is 4 byte aligned, whole words and starts with SPIR-V magic number.
+     */
+    bool is_spirv(std::span<const char> code);
+
+    /**
+     * Read only mapping of whole file, unmapped on destruction. Mapping is page aligned.
+     * `data` is null if file couldn't be opened or is empty.
+     */
+    struct MappedFile {
+	const char* data = nullptr;
+	size_t size = 0;
+
+	MappedFile(const char* path);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+	std::span<const char> bytes() const { return {data, size}; }
+    };
+
+    /**
+     * 64-bit FNV-1a hash of `size` bytes at `data`, continuing from `seed`.
+     */
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
 
     struct ContextDependant { Context* ctx; };
     struct OptionalValidator { virtual bool all_valid() = 0; };
 
+    /**
+     * Persistent pool of worker threads running parallel loops.
+     *
+     * Calling thread takes part in every `run` as worker 0, so pool created with 0 workers runs loops serially.
+     */
+    struct ThreadPool {
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::function<void(uint32_t index, uint32_t worker)> job;
+	uint32_t count = 0;
+	std::atomic<uint32_t> next = 0;
+	uint32_t active = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+	[[nodiscard]] ThreadPool() {}
+
+	/**
+	 * Starts worker threads.
+	 *
+	 * @param threads Number of threads taking part in `run`, including the calling one. Defaults to `std::thread::hardware_concurrency()`.
+	 */
+	void create(uint32_t threads = 0);
+
+	/**
+	 * Calls `fn` for every index in `[0, count)` spread across workers and blocks until all calls return.
+	 *
+	 * @param count Number of indices.
+	 * @param fn Function called with loop index and index of worker in `[0, size())`, usable for per-worker data.
+	 */
+	void run(uint32_t count, std::function<void(uint32_t index, uint32_t worker)>&& fn);
+
+	/**
+	 * @return Number of workers taking part in `run`, including the calling thread.
+	 */
+	uint32_t size() { return workers.size() + 1; }
+
+	/**
+	 * Stops and joins worker threads.
+	 */
+	void clean();
+
+	protected:
+	    void work(uint32_t worker);
+    };
+
     /**
      * `VkCommandPool` helper.
      */
@@ -284,7 +545,26 @@ namespace vb {
 	 */
 	void create(uint32_t queue_index,
 		VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-	[[nodiscard]] VkCommandBuffer allocate();
+
+	/**
+	 * Allocates one command buffer.
+	 *
+	 * @param level `VkCommandBufferLevel` of the buffer. Defaults to `VK_COMMAND_BUFFER_LEVEL_PRIMARY`.
+	 */
+	[[nodiscard]] VkCommandBuffer allocate(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	[[nodiscard]] VkCommandBuffer allocate_secondary() { return allocate(VK_COMMAND_BUFFER_LEVEL_SECONDARY); }
+
+	/**
+	 * Allocates `buffers.size()` command buffers with a single `vkAllocateCommandBuffers`.
+	 *
+	 * @return `false` if allocation failed, `buffers` are left null then.
+	 */
+	bool allocate(std::span<VkCommandBuffer> buffers, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+	/**
+	 * Resets all command buffers allocated from the pool at once. None of them can be pending.
+	 */
+	bool reset(VkCommandPoolResetFlags flags = 0);
 	void clean();
     };
 
@@ -324,14 +604,25 @@ namespace vb {
 	 * Creates `VkDescriptorSet` from this pool.
 	 *
 	 * @param layout `VkDescriptorSetLayout` that the set is used with.
-	 * @param count Sets count. Defaults to `1`.
 	 * @param pNext `pNext` pointer. Defaults to `nullptr`.
 	 */
 	[[nodiscard]] VkDescriptorSet create_set(VkDescriptorSetLayout layout,
-		uint32_t count = 1, void* pNext = nullptr);
+		void* pNext = nullptr);
+
+	/**
+	 * Creates one `VkDescriptorSet` per layout from this pool in single `vkAllocateDescriptorSets` call.
+	 *
+	 * @param layouts `VkDescriptorSetLayout`s that the sets are used with.
+	 * @param sets Output array with at least `layouts.size()` elements.
+	 * @param pNext `pNext` pointer. Defaults to `nullptr`.
+	 * @return `false` if allocation failed.
+	 */
+	[[nodiscard]] bool create_sets(std::span<const VkDescriptorSetLayout> layouts,
+		VkDescriptorSet* sets, void* pNext = nullptr);
 
 	/**
 	 * Creates `VkDescriptorSetLayout` based on bindings added with `add_binding`.
+	 * With context's `LayoutCache` set, identical layouts are shared.
 	 *
 	 * @param flags `VkDescriptorSetLayoutCreateFlags` bits.
 	 * @param pNext `pNext` pointer. Defaults to `nullptr`.
@@ -350,133 +641,1041 @@ namespace vb {
 	void clean_bindings();
 
 	/**
-	 * Destroys `VkDescriptorSetLayout`.
+	 * Destroys `VkDescriptorSetLayout`, unless it's owned by context's `LayoutCache`.
 	 */
 	void clean_layout(VkDescriptorSetLayout& layout);
     };
 
     /**
-     * `VkBuffer` helper.
+     * Growable `VkDescriptorSet` allocator.
+     * Chains new `VkDescriptorPool` whenever current one runs out of memory and resets all of them at once.
+     * Keep one per frame in flight and `reset` it after frame's fence to allocate transient sets every frame.
      */
-    struct Buffer: public ContextDependant, public OptionalValidator {
-	VkBuffer buffer = VK_NULL_HANDLE;
-	VmaAllocation allocation = VK_NULL_HANDLE;
-	VmaAllocationInfo info;
-	bool all_valid() { return buffer && allocation; }
+    struct DescriptorAllocator : public ContextDependant, public OptionalValidator {
+	/**
+	 * Descriptors of `type` reserved per set in each pool.
+	 */
+	struct Ratio {
+	    VkDescriptorType type;
+	    float ratio;
+	};
 
-	[[nodiscard]] Buffer(Context* context): ContextDependant{context} {}
+	std::vector<Ratio> ratios;
+	std::vector<VkDescriptorPool> ready;
+	std::vector<VkDescriptorPool> full;
+	VkDescriptorPoolCreateFlags flags = 0;
+	uint32_t sets_per_pool = 0;
+	uint32_t max_sets_per_pool = 4096;
+	uint32_t used_sets = 0;
+	bool all_valid() { return !ready.empty() || !full.empty(); }
+
+	struct {
+	    // Pools created over allocator's lifetime.
+	    uint32_t pools = 0;
+	    // Sets allocated over allocator's lifetime.
+	    uint64_t sets = 0;
+	    // Times a pool ran out of memory and next one had to be used.
+	    uint32_t exhausted = 0;
+	    // Most sets in use at once since last `reset`, which sizes the pool replacing chained ones and starts over.
+	    uint32_t peak_sets = 0;
+	} stats;
+
+	[[nodiscard]] DescriptorAllocator(Context* context): ContextDependant{context} {}
 
 	/**
-	 * Creates new `VkBuffer`.
+	 * Creates first `VkDescriptorPool`.
+	 *
+	 * @param ratios Descriptor types with their average count per set.
+	 * @param sets_per_pool Max sets in first pool. Following pools double it up to `max_sets_per_pool`.
+	 * @param flags `VkDescriptorPoolCreateFlags` bits used for every pool.
 	 */
-	void create(const size_t size, VkBufferCreateFlags usage, VmaMemoryUsage mem_usage);
+	void create(std::span<const Ratio> ratios, uint32_t sets_per_pool = 64,
+		VkDescriptorPoolCreateFlags flags = 0);
 
 	/**
-	 * Destroys `VkBuffer` and `VmaAllocation`.
+	 * Allocates `VkDescriptorSet`, chaining new pool if current one is exhausted.
+	 *
+	 * @param layout `VkDescriptorSetLayout` that the set is used with.
+	 * @param pNext `pNext` pointer. Defaults to `nullptr`.
+	 */
+	[[nodiscard]] VkDescriptorSet allocate(VkDescriptorSetLayout layout, void* pNext = nullptr);
+
+	/**
+	 * Allocates one `VkDescriptorSet` per layout in single `vkAllocateDescriptorSets` call,
+	 * chaining new pool if current one is exhausted.
+	 *
+	 * @param layouts `VkDescriptorSetLayout`s that the sets are used with.
+	 * @param sets Output array with at least `layouts.size()` elements.
+	 * @param pNext `pNext` pointer. Defaults to `nullptr`.
+	 * @return `false` if allocation failed.
+	 */
+	[[nodiscard]] bool allocate(std::span<const VkDescriptorSetLayout> layouts,
+		VkDescriptorSet* sets, void* pNext = nullptr);
+
+	/**
+	 * Resets all pools, freeing every set allocated from them.
+	 * If more than one pool was needed since last reset, they are replaced with one pool big enough for it.
+	 */
+	void reset();
+
+	/**
+	 * Returns fraction of sets in all pools that is currently allocated.
+	 */
+	float utilization() const;
+
+	/**
+	 * Destroys all pools.
 	 */
 	void clean();
+
+	protected:
+	    uint32_t capacity = 0;
+
+	    VkDescriptorPool get_pool(uint32_t min_sets);
+	    VkDescriptorPool create_pool(uint32_t sets);
     };
 
     /**
-     * `VkImage` helper.
+     * Semaphore waited on by `submit`. `value` is ignored for binary semaphores.
      */
-    struct Image: public ContextDependant, public OptionalValidator {
-	VkImage image = VK_NULL_HANDLE;
-	VkImageView image_view = VK_NULL_HANDLE;
-	VmaAllocation allocation = VK_NULL_HANDLE;
-	bool all_valid() { return image && image_view && allocation; }
+    struct SemaphoreWait {
+	VkSemaphore semaphore;
+	uint64_t value;
+	VkPipelineStageFlags stage;
+    };
 
-	VkExtent3D extent;
-	VkFormat format;
-	uint32_t mip_level = 1;
-	[[nodiscard]] Image(Context* context): ContextDependant{context} {}
+    /**
+     * Semaphore signaled by `submit`. `value` is ignored for binary semaphores.
+     */
+    struct SemaphoreSignal {
+	VkSemaphore semaphore;
+	uint64_t value;
+    };
+
+    /**
+     * Submits `cmds` to `queue` with a single `vkQueueSubmit`, waiting on and signaling any mix of binary and timeline semaphores.
+     *
+     * @param fence `VkFence` to signal. Defaults to `VK_NULL_HANDLE`.
+     */
+    bool submit(VkQueue queue, std::span<const VkCommandBuffer> cmds,
+	    std::span<const SemaphoreWait> waits = {}, std::span<const SemaphoreSignal> signals = {},
+	    VkFence fence = VK_NULL_HANDLE);
+
+    /**
+     * Vulkan 1.2 timeline `VkSemaphore`, needs `timelineSemaphore` feature.
+     *
+     * Submits signal increasing values, so one semaphore replaces fence and binary semaphore pairs:
+     * CPU waits on a value with `wait`, polls it with `is_complete`, and submits on other queues wait on it through `SemaphoreWait`.
+     */
+    struct Timeline : public ContextDependant, public OptionalValidator {
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	// Last value handed out by `next`.
+	uint64_t last = 0;
+	// Highest value known to be reached, so finished work isn't queried again.
+	uint64_t completed = 0;
+	struct {
+	    uint64_t waits = 0;
+	} stats;
+	bool all_valid() { return semaphore; }
+
+	[[nodiscard]] Timeline(Context* context): ContextDependant{context} {}
 
 	/**
-	 * Creates new `VkImage`.
+	 * Creates timeline `VkSemaphore`.
 	 *
-	 * @param extent Image's dimensions in `VkExtent3D`.
-	 * @param mipmap Sets `mipLevels`. Defaults to `false`.
-	 * @param samples Sets `samples`. Defaults to `VK_SAMPLE_COUNT_1_BIT`.
-	 * @param format `VkFormat` of image. Defaults to `VK_FORMAT_B8G8R8A8_SRGB`.
-	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 * @param initial Initial value. Defaults to `0`.
 	 */
-	void create(VkExtent3D extent, bool mipmap = false,
-		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
-		VkFormat format = VK_FORMAT_B8G8R8A8_SRGB,
-		VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
-		| VK_IMAGE_USAGE_STORAGE_BIT  | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
-		| VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	void create(uint64_t initial = 0);
 
 	/**
-	 * Creates new `VkImage` from data pointer.
-	 *
-	 * @param data `void*` to image data that will be copied into `VkImage` by staging `VkBuffer`.
-	 * @param extent Image's dimensions in `VkExtent3D`.
-	 * @param mipmap Sets `mipLevels`. Defaults to `false`.
-	 * @param samples Sets `samples`. Defaults to `VK_SAMPLE_COUNT_1_BIT`.
-	 * @param format `VkFormat` of image. Defaults to `VK_FORMAT_B8G8R8A8_SRGB`.
-	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 * @return Next value to signal.
 	 */
-	void create(void* data, VkExtent3D extent, bool mipmap = false,
-		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
-		VkFormat format = VK_FORMAT_R8G8B8A8_SRGB,
-		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT
-		| VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	uint64_t next() { return ++last; }
 
 	/**
-	 * Creates new `VkImage` from file with `stb_image`. Calls `vb::Image::create(void*, VkExtent3D, format, usage, mipmap)` internally.
-	 *
-	 * @param path Path to image file.
-	 * @param mipmap Sets `mipLevels`. Defaults to `false`.
-	 * @param samples Sets `samples`. Defaults to `VK_SAMPLE_COUNT_1_BIT`.
-	 * @param format `VkFormat` of image. Defaults to `VK_FORMAT_B8G8R8A8_SRGB`.
-	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 * @return Current value of the semaphore.
 	 */
-	void create(const char* path, bool mipmap = false,
-		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
-		VkFormat format = VK_FORMAT_R8G8B8A8_SRGB,
-		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT
-		| VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	uint64_t value();
 
 	/**
-	 * Destroys `VkImage`, `VkImageView` and `VmaAllocation`.
+	 * Checks without blocking if semaphore reached `value`.
+	 */
+	[[nodiscard]] bool is_complete(uint64_t value);
+
+	/**
+	 * Waits on CPU for semaphore to reach `value`.
+	 */
+	bool wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+	/**
+	 * Signals `value` from CPU.
+	 */
+	bool signal(uint64_t value);
+
+	SemaphoreWait wait_info(uint64_t value, VkPipelineStageFlags stage) { return {semaphore, value, stage}; }
+	SemaphoreSignal signal_info(uint64_t value) { return {semaphore, value}; }
+
+	/**
+	 * Destroys `VkSemaphore`. Nothing can be pending on it.
 	 */
 	void clean();
     };
 
     /**
-     * `VkPipeline` helper for graphics pipeline.
-     *
-     * `VkDynamicState` defaults are `VK_DYNAMIC_STATE_VIEWPORT` and `VK_DYNAMIC_STATE_SCISSOR`.
-     *
-     * `VkPipelineInputAssemblyStateCreateInfo` defauls to `VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST` and `primitiveRestart` disabled.
+     * Frames in flight, independent of swapchain image count.
      *
-     * `VkPipelineRasterizationStateCreateInfo` defaults to `VK_POLYGON_MODE_FILL`, `VK_CULL_MODE_BACK_BIT` and `VK_FRONT_FACE_CLOCKWISE`.
-     *
-     * `VkPipelineMultisampleStateCreateInfo` defaults to disabled sample shading with `rasterizationSamples` set to `VK_SAMPLE_COUNT_1_BIT`.
-     *
-     * `VkPipelineDepthStencilStateCreateInfo` defaults to disabled depth and stencil testing.
-     *
-     * `VkPipelineColorBlendStateCreateInfo` defaults to disabled `logicOp` with 1 attachment (disabled blending, and `colorWriteMask` of `VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT`.
+     * Each frame has its own `VkCommandPool` reset in bulk, deferred deletion queue and transient `DescriptorAllocator`,
+     * all recycled once `timeline` reaches the value frame's submit signaled. Present semaphores belong to swapchain images
+     * instead of frames, so a semaphore is never signaled again while its image still waits for presentation.
      */
-    struct GraphicsPipeline: public ContextDependant, public OptionalValidator {
-       	VkPipelineVertexInputStateCreateInfo vertex_input = {
-	    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-	};
-	VkPipelineInputAssemblyStateCreateInfo input_assembly = {
-	    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-	    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-	    .primitiveRestartEnable = VK_FALSE,
-	};
-	VkPipelineTessellationStateCreateInfo tessellation = {
-	    .sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO,
-	};
-	VkPipelineViewportStateCreateInfo viewport = {
-	    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-	    .viewportCount = 1,
-	    .scissorCount = 1,
+    struct FrameRing : public ContextDependant, public OptionalValidator {
+	struct Frame {
+	    VkCommandPool pool = VK_NULL_HANDLE;
+	    VkCommandBuffer cmd = VK_NULL_HANDLE;
+	    VkSemaphore image_available = VK_NULL_HANDLE;
+	    uint64_t value = 0;
+	    std::vector<std::function<void()>> deletions;
+	    DescriptorAllocator descriptors;
 	};
-	VkPipelineRasterizationStateCreateInfo rasterization = {
+	std::vector<Frame> frames;
+	std::vector<VkSemaphore> render_finished;
+	Timeline timeline;
+	uint64_t frame_number = 0;
+	uint32_t image_index = 0;
+	bool all_valid() { return !frames.empty() && timeline.all_valid(); }
+
+	[[nodiscard]] FrameRing(Context* context): ContextDependant{context}, timeline{context} {}
+
+	/**
+	 * Creates frames and present semaphores for current swapchain.
+	 *
+	 * @param queue_index Index of queue family that frames' command buffers are submitted to.
+	 * @param frames_in_flight Frames CPU can record ahead of GPU. Defaults to `2`.
+	 * @param ratios Sizes of every frame's transient `DescriptorAllocator`. Left empty, it isn't created.
+	 */
+	void create(uint32_t queue_index, uint32_t frames_in_flight = 2,
+		std::span<const DescriptorAllocator::Ratio> ratios = {});
+
+	uint32_t size() const { return frames.size(); }
+
+	/**
+	 * @return Index of current frame, for per frame resources.
+	 */
+	uint32_t index() const { return frame_number % frames.size(); }
+
+	Frame& current() { return frames[index()]; }
+
+	/**
+	 * Waits for current frame's previous submit, runs its deferred deletions, resets its command pool and descriptors,
+	 * acquires next swapchain image and begins frame's command buffer.
+	 *
+	 * @return Acquired image index, `std::nullopt` if swapchain had to be recreated.
+	 */
+	[[nodiscard]] std::optional<uint32_t> begin();
+
+	/**
+	 * Ends and submits current frame's command buffer, presents acquired image and advances to next frame.
+	 *
+	 * @param queue `VkQueue` to submit and present on.
+	 * @param wait_stage Stage that waits for acquired image. Defaults to `VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT`.
+	 * @param waits Additional semaphores to wait on, e.g. `Timeline` values of async compute or transfer work.
+	 */
+	bool end(VkQueue queue, VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		std::span<const SemaphoreWait> waits = {});
+
+	/**
+	 * Runs `fn` once GPU is done with current frame, next time this frame begins.
+	 */
+	void defer(std::function<void()>&& fn) {
+	    current().deletions.push_back(std::move(fn));
+	}
+
+	/**
+	 * Runs all deferred deletions and destroys frames. GPU has to be idle.
+	 */
+	void clean();
+
+	protected:
+	    bool create_present_semaphores();
+    };
+
+    /**
+     * Command pools of `ThreadPool` workers, one per worker for every frame in flight.
+     *
+     * `VkCommandPool` can't be used by two threads at once, so each worker takes secondary command buffers
+     * from its own pool. Buffers are handed out in order and recycled together by resetting frame's pools in `begin`,
+     * after `FrameRing::begin` waited for the frame.
+     */
+    struct ThreadCommandPools : public ContextDependant, public OptionalValidator {
+	struct Worker {
+	    CommandPool pool;
+	    std::vector<VkCommandBuffer> buffers;
+	    uint32_t used = 0;
+	};
+	std::vector<std::vector<Worker>> frames;
+	uint32_t frame = 0;
+	bool all_valid() { return !frames.empty(); }
+
+	[[nodiscard]] ThreadCommandPools(Context* context): ContextDependant{context} {}
+
+	/**
+	 * @param queue_index Index of queue family that primary command buffers executing the secondaries are submitted to.
+	 * @param workers Number of workers, usually `ThreadPool::size()`.
+	 * @param frames_in_flight Same as `FrameRing::size()`.
+	 */
+	void create(uint32_t queue_index, uint32_t workers, uint32_t frames_in_flight = 2);
+
+	/**
+	 * Resets pools of `frame`, which GPU has to be done with, and hands out its buffers until next `begin`.
+	 */
+	bool begin(uint32_t frame);
+
+	/**
+	 * Begins next secondary command buffer of `worker`, continuing dynamic rendering that the primary begins
+	 * with `VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT`. Nothing is inherited but attachment formats,
+	 * so pipeline, dynamic state and descriptor sets have to be bound again.
+	 *
+	 * @param worker Index of calling worker, as passed by `ThreadPool::run`.
+	 * @param rendering Attachment formats and flags of the rendering, flags without the contents bit.
+	 * @return Begun command buffer, `VK_NULL_HANDLE` on failure.
+	 */
+	[[nodiscard]] VkCommandBuffer secondary(uint32_t worker, const VkCommandBufferInheritanceRenderingInfo& rendering);
+
+	/**
+	 * Destroys all pools. GPU has to be idle.
+	 */
+	void clean();
+    };
+
+    /**
+     * `VkBuffer` helper.
+     */
+    struct Buffer: public ContextDependant, public OptionalValidator {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	VmaAllocationInfo info;
+	bool all_valid() { return buffer && allocation; }
+
+	[[nodiscard]] Buffer(Context* context): ContextDependant{context} {}
+
+	/**
+	 * Creates new `VkBuffer`.
+	 */
+	void create(const size_t size, VkBufferCreateFlags usage, VmaMemoryUsage mem_usage);
+
+	/**
+	 * Copies `data` into the buffer with `Context::submit_upload_to_queue` and waits for it. Buffer has to be created with `VK_BUFFER_USAGE_TRANSFER_DST_BIT`.
+	 *
+	 * Goes through context's `StagingRing` (in chunks if `size` exceeds it) when it's initialized and idle, otherwise allocates a temporary staging `VkBuffer`.
+	 *
+	 * @param data Pointer to data to copy.
+	 * @param size Size of data in bytes.
+	 * @param offset Offset in this buffer to copy to. Defaults to `0`.
+	 */
+	bool upload(const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+
+	/**
+	 * Destroys `VkBuffer` and `VmaAllocation`.
+	 */
+	void clean();
+    };
+
+    /**
+     * Descriptor buffer (`VK_EXT_descriptor_buffer`) memory sub-allocated into descriptor sets.
+     *
+     * One persistently mapped `VkBuffer` is bump allocated in ranges aligned to `descriptorBufferOffsetAlignment`.
+     * Set layouts have to be created with `VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT`.
+     * Sets can be allocated with one copy per frame in flight, so descriptors of the next frame are written
+     * without waiting for the GPU to stop reading the current ones.
+     */
+    struct DescriptorHeap: public ContextDependant, public OptionalValidator {
+	struct Set {
+	    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	    VkDeviceSize offset = 0;
+	    // Aligned layout size, distance between versions.
+	    VkDeviceSize size = 0;
+	    uint32_t versions = 1;
+	};
+	Buffer buffer;
+	VkDeviceAddress address = 0;
+	VkBufferUsageFlags usage = 0;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize used = 0;
+	VkPhysicalDeviceDescriptorBufferPropertiesEXT properties {
+	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT,
+	};
+	bool all_valid() { return buffer.all_valid() && address; }
+
+	[[nodiscard]] DescriptorHeap(Context* context): ContextDependant{context}, buffer{context} {}
+
+	/**
+	 * Creates host visible descriptor `VkBuffer`. Needs `VkPhysicalDeviceDescriptorBufferFeaturesEXT::descriptorBuffer`
+	 * and VMA allocator created with `VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT`.
+	 *
+	 * @param capacity Size in bytes, `set_size` of every set times its versions is enough.
+	 * @param samplers Set if heap holds samplers or combined image samplers. Defaults to `true`.
+	 */
+	void create(VkDeviceSize capacity, bool samplers = true);
+
+	/**
+	 * @return Size of one version of set with `layout` in this heap. Can be called before `create` to size it.
+	 */
+	[[nodiscard]] VkDeviceSize set_size(VkDescriptorSetLayout layout);
+
+	/**
+	 * @return Size of single descriptor of `type`, `0` for unsupported types.
+	 */
+	[[nodiscard]] size_t descriptor_size(VkDescriptorType type);
+
+	/**
+	 * Reserves range for set with `layout`.
+	 *
+	 * @param versions Number of copies, e.g. frames in flight. Defaults to `1`.
+	 * @return `std::nullopt` if heap is full.
+	 */
+	std::optional<Set> allocate(VkDescriptorSetLayout layout, uint32_t versions = 1);
+
+	/**
+	 * @return Offset of `version` of `set` from start of the heap.
+	 */
+	VkDeviceSize offset(const Set& set, uint32_t version = 0) {
+	    return set.offset + (version % set.versions) * set.size;
+	}
+
+	/**
+	 * Writes descriptor described by `info` into `binding` of `set`'s `version`.
+	 *
+	 * @param array_index Element of arrayed binding. Defaults to `0`.
+	 */
+	void write(const Set& set, uint32_t version, uint32_t binding, const VkDescriptorGetInfoEXT& info,
+		uint32_t array_index = 0);
+
+	/**
+	 * Writes sampled, storage or combined image sampler descriptor.
+	 */
+	void write_image(const Set& set, uint32_t version, uint32_t binding, VkDescriptorType type,
+		const VkDescriptorImageInfo& image, uint32_t array_index = 0);
+
+	/**
+	 * Writes uniform or storage buffer descriptor of `range` bytes from `address`.
+	 */
+	void write_buffer(const Set& set, uint32_t version, uint32_t binding, VkDescriptorType type,
+		VkDeviceAddress buffer_address, VkDeviceSize range, uint32_t array_index = 0);
+
+	/**
+	 * Records binding of the heap as descriptor buffer `0`.
+	 */
+	void bind(VkCommandBuffer cmd);
+
+	/**
+	 * Records `vkCmdSetDescriptorBufferOffsetsEXT` pointing set number `first_set` of `layout` at `set`'s `version`.
+	 * Heap has to be bound with `bind`.
+	 */
+	void bind_set(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout layout,
+		uint32_t first_set, const Set& set, uint32_t version = 0);
+
+	/**
+	 * Frees all sets at once. Has to be called only when the GPU stopped reading them.
+	 */
+	void reset() { used = 0; }
+
+	/**
+	 * Destroys `VkBuffer`.
+	 */
+	void clean();
+
+    protected:
+	void query_properties();
+    };
+
+    /**
+     * Persistently mapped staging ring buffer.
+     *
+     * One `VMA_MEMORY_USAGE_CPU_TO_GPU` `VkBuffer` carved up by lock-free bump allocator.
+     * Allocations never wrap around the end of the buffer. `head` and `tail` are monotonically increasing positions,
+     * so space is reclaimed by passing `Allocation::end` (or `mark()`) of the newest finished allocation to `release`.
+     * Allocations have to be released in the order they were made.
+     */
+    struct StagingRing: public ContextDependant, public OptionalValidator {
+	struct Allocation {
+	    VkBuffer buffer = VK_NULL_HANDLE;
+	    VkDeviceSize offset = 0;
+	    VkDeviceSize size = 0;
+	    void* data = nullptr;
+	    uint64_t end = 0;
+	};
+	Buffer buffer;
+	VkDeviceSize capacity = 0;
+	std::atomic<uint64_t> head = 0;
+	std::atomic<uint64_t> tail = 0;
+	struct {
+	    std::atomic<uint64_t> allocations = 0;
+	    std::atomic<uint64_t> bytes = 0;
+	    std::atomic<uint64_t> stalls = 0;
+	} stats;
+	bool all_valid() { return buffer.all_valid() && capacity; }
+
+	[[nodiscard]] StagingRing(Context* context): ContextDependant{context}, buffer{context} {}
+
+	/**
+	 * Creates and maps ring's `VkBuffer`.
+	 *
+	 * @param capacity Size in bytes. Rounded up to multiple of 256.
+	 */
+	void create(VkDeviceSize capacity);
+
+	/**
+	 * Allocates `size` bytes without blocking.
+	 *
+	 * @param size Size in bytes. Can't exceed `capacity`.
+	 * @param alignment Power of two alignment of allocation's offset, up to 256. Defaults to `16`.
+	 * @param exclusive Only allocate if nothing else is in flight, checked atomically with the allocation.
+	 * For users that release their allocation before anyone else could. Defaults to `false`.
+	 * @return `std::nullopt` if there isn't enough free space until older allocations are released.
+	 */
+	[[nodiscard]] std::optional<Allocation> allocate(VkDeviceSize size, VkDeviceSize alignment = 16,
+		bool exclusive = false);
+
+	/**
+	 * Copies `data` into `allocation` and flushes it if memory isn't host coherent.
+	 */
+	void write(const Allocation& allocation, const void* data);
+
+	/**
+	 * Frees everything allocated before `position`.
+	 */
+	void release(uint64_t position);
+
+	/**
+	 * Current head position, everything allocated so far ends before it.
+	 */
+	uint64_t mark() { return head.load(std::memory_order_acquire); }
+
+	/**
+	 * Bytes allocated and not released yet.
+	 */
+	VkDeviceSize in_flight() { return mark() - tail.load(std::memory_order_acquire); }
+
+	/**
+	 * Destroys ring's `VkBuffer`. Nothing can be in flight.
+	 */
+	void clean();
+    };
+
+    /**
+     * Batched, asynchronous upload helper.
+     *
+     * Jobs are recorded into one of `ring_size` command buffers and submitted together on `flush`.
+     * Each flush returns a ticket (monotonically increasing, `0` means nothing was submitted)
+     * that can be polled with `is_complete` or waited on with `wait`, or waited on by other queues through `completion`.
+     *
+     * Batches signal `timeline`, `2 * ticket` once finished. With ownership transfer upload submit signals `2 * ticket - 1`
+     * which owner's submit waits on.
+     */
+    struct UploadQueue: public ContextDependant, public OptionalValidator {
+	struct Slot {
+	    VkCommandBuffer cmd = VK_NULL_HANDLE;
+	    VkCommandBuffer acquire_cmd = VK_NULL_HANDLE;
+	    uint64_t ticket = 0;
+	    bool recording = false;
+	    VkDeviceSize staging_size = 0;
+	    std::vector<Buffer> staging_buffers;
+	    uint64_t staging_mark = 0;
+	};
+	VkCommandPool pool = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t queue_index = 0;
+	VkCommandPool owner_pool = VK_NULL_HANDLE;
+	VkQueue owner_queue = VK_NULL_HANDLE;
+	uint32_t owner_index = 0;
+	uint32_t ring_size = 0;
+	std::vector<Slot> slots;
+	size_t current = 0;
+	Timeline timeline;
+	uint64_t last_ticket = 0;
+	uint64_t completed_ticket = 0;
+	VkDeviceSize flush_threshold = 64 * 1024 * 1024;
+	struct {
+	    uint64_t submits = 0;
+	    uint64_t jobs = 0;
+	    uint64_t waits = 0;
+	} stats;
+	bool all_valid() { return pool && ring_size && slots.size() == ring_size && timeline.all_valid(); }
+
+	[[nodiscard]] UploadQueue(Context* context): ContextDependant{context}, timeline{context} {}
+
+	/**
+	 * Creates `VkCommandPool`, command buffers for every batch in the ring and timeline `VkSemaphore`.
+	 *
+	 * @param queue_index Index of queue family on which the jobs are submitted.
+	 * @param queue `VkQueue` to submit to.
+	 * @param ring_size Number of batches that can be in flight at once. Defaults to `2`.
+	 */
+	void create(uint32_t queue_index, VkQueue queue, uint32_t ring_size = 2);
+
+	/**
+	 * Sets queue family that uses uploaded resources.
+	 *
+	 * If it differs from upload queue's family (or context's `force_ownership_transfer` is set),
+	 * every batch gets a second command buffer submitted to `queue` after the upload one, which acquires ownership of uploaded resources.
+	 * Has to be called after `create`.
+	 *
+	 * @param queue_index Index of owner queue family.
+	 * @param queue Owner `VkQueue`.
+	 * @return `false` if owner's command pool or buffers couldn't be created, nothing is left allocated then.
+	 */
+	bool set_owner(uint32_t queue_index, VkQueue queue);
+
+	/**
+	 * Ownership transfer from upload queue's to owner's family.
+	 */
+	[[nodiscard]] OwnershipTransfer ownership() {
+	    return {queue_index, owner_index, owner_pool != VK_NULL_HANDLE};
+	}
+
+	/**
+	 * Records a job into currently open batch. Opens a new batch (waiting for the oldest one in the ring if needed) when there's none.
+	 *
+	 * @param fn Lambda or function that records into already begun command buffer.
+	 */
+	void record(std::function<void(VkCommandBuffer cmd)>&& fn);
+
+	/**
+	 * Records a job into currently open batch's owner command buffer, executed after all of the batch's upload jobs.
+	 * Without ownership transfer it's recorded into the same command buffer as `record` jobs.
+	 *
+	 * @param fn Lambda or function that records into already begun command buffer.
+	 */
+	void record_acquire(std::function<void(VkCommandBuffer cmd)>&& fn);
+
+	/**
+	 * Takes ownership of staging `Buffer` used by jobs of currently open batch and destroys it when the batch finishes.
+	 *
+	 * Flushes the batch automatically when kept staging memory exceeds `flush_threshold`.
+	 */
+	void keep(Buffer staging);
+
+	/**
+	 * Allocates staging memory for currently open batch from context's `StagingRing`.
+	 *
+	 * If the ring is full, flushes the open batch and waits for the oldest batch in flight to reclaim its space.
+	 *
+	 * @return `std::nullopt` if there's no ring, `size` exceeds it or space couldn't be reclaimed.
+	 */
+	[[nodiscard]] std::optional<StagingRing::Allocation> allocate_staging(VkDeviceSize size,
+		VkDeviceSize alignment = 16);
+
+	/**
+	 * Records copy of `data` into `destination` buffer. Uploads larger than half of the staging ring are split into chunks.
+	 *
+	 * Ownership of the copied range is transferred to owner family, and it's visible to all commands afterwards.
+	 *
+	 * @param destination `VkBuffer` created with `VK_BUFFER_USAGE_TRANSFER_DST_BIT`.
+	 * @param data Pointer to data to copy. Copied before returning.
+	 * @param size Size of data in bytes.
+	 * @param offset Offset in `destination` to copy to. Defaults to `0`.
+	 */
+	bool upload(VkBuffer destination, const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+
+	/**
+	 * Submits currently open batch with a single `vkQueueSubmit`.
+	 *
+	 * If submitting fails, batch's staging memory is released once all previously submitted batches finish.
+	 *
+	 * @return Ticket of submitted batch, last ticket if there was nothing to submit or `0` on failure.
+	 */
+	uint64_t flush();
+
+	/**
+	 * Checks without blocking if batch with `ticket` has finished.
+	 */
+	[[nodiscard]] bool is_complete(uint64_t ticket);
+
+	/**
+	 * Waits for batch with `ticket` to finish.
+	 */
+	bool wait(uint64_t ticket, uint64_t timeout = UINT64_MAX);
+
+	/**
+	 * @return Wait for batch with `ticket` to finish, for submits on other queues using uploaded resources.
+	 */
+	SemaphoreWait completion(uint64_t ticket, VkPipelineStageFlags stage) {
+	    return timeline.wait_info(ticket * 2, stage);
+	}
+
+	/**
+	 * Flushes and waits for all submitted batches.
+	 *
+	 * @return `false` if open batch couldn't be submitted or waiting failed.
+	 */
+	bool finish();
+
+	/**
+	 * Waits for all batches, destroys staging buffers, timeline `VkSemaphore` and `VkCommandPool`.
+	 */
+	void clean();
+
+	protected:
+	    Slot* open_slot();
+	    void retire(uint64_t ticket);
+    };
+
+    struct MipGenerator;
+
+    /**
+     * `VkImage` helper.
+     */
+    struct Image: public ContextDependant, public OptionalValidator {
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView image_view = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	bool all_valid() { return image && image_view && allocation; }
+
+	VkExtent3D extent;
+	VkFormat format;
+	uint32_t mip_level = 1;
+	MipGenerator* mip_generator = nullptr;
+	bool storage_mipmaps = false;
+	bool defer_mipmaps = false;
+	[[nodiscard]] Image(Context* context): ContextDependant{context} {}
+
+	/**
+	 * Sets `MipGenerator` used for mipmaps of this image instead of blits. Has to be called before `create`.
+	 */
+	void set_mip_generator(MipGenerator* generator) { mip_generator = generator; }
+
+	/**
+	 * Makes uploads with mipmaps leave all levels in `VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL`, so `generate_mipmaps` can be recorded later, e.g. in a separate batch.
+	 */
+	void set_defer_mipmaps(bool defer) { defer_mipmaps = defer; }
+
+	/**
+	 * Creates new `VkImage`.
+	 *
+	 * @param extent Image's dimensions in `VkExtent3D`.
+	 * @param mipmap Sets `mipLevels`. Defaults to `false`.
+	 * @param samples Sets `samples`. Defaults to `VK_SAMPLE_COUNT_1_BIT`.
+	 * @param format `VkFormat` of image. Defaults to `VK_FORMAT_B8G8R8A8_SRGB`.
+	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 */
+	void create(VkExtent3D extent, bool mipmap = false,
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+		VkFormat format = VK_FORMAT_B8G8R8A8_SRGB,
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+		| VK_IMAGE_USAGE_STORAGE_BIT  | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+		| VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+	/**
+	 * Creates new `VkImage` from data pointer.
+	 *
+	 * @param data `void*` to image data that will be copied into `VkImage` through context's `StagingRing` or a staging `VkBuffer`.
+	 * @param extent Image's dimensions in `VkExtent3D`.
+	 * @param mipmap Sets `mipLevels`. Defaults to `false`.
+	 * @param samples Sets `samples`. Defaults to `VK_SAMPLE_COUNT_1_BIT`.
+	 * @param format `VkFormat` of image. Defaults to `VK_FORMAT_B8G8R8A8_SRGB`.
+	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 */
+	void create(void* data, VkExtent3D extent, bool mipmap = false,
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+		VkFormat format = VK_FORMAT_R8G8B8A8_SRGB,
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT
+		| VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+	/**
+	 * Creates new `VkImage` from data pointer without blocking. Copy is recorded into `queue`'s open batch and is done after the batch is flushed and finished.
+	 *
+	 * @param queue `UploadQueue` that records the copy and allocates staging memory.
+	 * @param data `void*` to image data that will be copied into `VkImage` through `queue`'s staging memory.
+	 * @param extent Image's dimensions in `VkExtent3D`.
+	 * @param mipmap Sets `mipLevels`. Defaults to `false`.
+	 * @param samples Sets `samples`. Defaults to `VK_SAMPLE_COUNT_1_BIT`.
+	 * @param format `VkFormat` of image. Defaults to `VK_FORMAT_R8G8B8A8_SRGB`.
+	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 */
+	void create(UploadQueue& queue, void* data, VkExtent3D extent, bool mipmap = false,
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+		VkFormat format = VK_FORMAT_R8G8B8A8_SRGB,
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT
+		| VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+	/**
+	 * Creates new `VkImage` from file with `stb_image`. Calls `vb::Image::create(void*, VkExtent3D, format, usage, mipmap)` internally.
+	 *
+	 * @param path Path to image file.
+	 * @param mipmap Sets `mipLevels`. Defaults to `false`.
+	 * @param samples Sets `samples`. Defaults to `VK_SAMPLE_COUNT_1_BIT`.
+	 * @param format `VkFormat` of image. Defaults to `VK_FORMAT_B8G8R8A8_SRGB`.
+	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 */
+	void create(const char* path, bool mipmap = false,
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+		VkFormat format = VK_FORMAT_R8G8B8A8_SRGB,
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT
+		| VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+	/**
+	 * Creates new `VkImage` from KTX2 file in memory, in the file's `VkFormat` and with all the mip levels it stores.
+	 *
+	 * Supports 2D images without supercompression, so block compressed formats (BC, ETC2, ASTC) are copied as is.
+	 * Basis Universal and Zstandard payloads are rejected. Compressed formats need matching `textureCompression*` feature enabled in `ContextDeviceInfo`.
+	 *
+	 * @param data Pointer to whole KTX2 file, copied into `VkImage` through a staging `VkBuffer`.
+	 * @param size Size of `data` in bytes.
+	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 */
+	void create_ktx2(const void* data, size_t size,
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+	/**
+	 * Creates new `VkImage` from KTX2 file in memory without blocking. See `create_ktx2(const void*, size_t, VkImageUsageFlags)`.
+	 *
+	 * @param queue `UploadQueue` that records the copies and allocates staging memory.
+	 * @param data Pointer to whole KTX2 file, copied level by level through `queue`'s staging memory.
+	 * @param size Size of `data` in bytes.
+	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 */
+	void create_ktx2(UploadQueue& queue, const void* data, size_t size,
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+	/**
+	 * Creates new `VkImage` from KTX2 file. Calls `vb::Image::create_ktx2(const void*, size_t, VkImageUsageFlags)` internally.
+	 *
+	 * @param path Path to KTX2 file.
+	 * @param usage `VkImageUsageFlags` bits. Defaults to `VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT`.
+	 */
+	void create_ktx2(const char* path,
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+	/**
+	 * Records mip chain generation from level 0, with `MipGenerator` if the image was created with one that supports it or with blits otherwise.
+	 *
+	 * All levels have to be in `VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL` and are left in `VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL`.
+	 */
+	void generate_mipmaps(VkCommandBuffer cmd);
+
+	/**
+	 * Destroys `VkImage`, `VkImageView` and `VmaAllocation`.
+	 */
+	void clean();
+
+	protected:
+	    void record_begin_upload(VkCommandBuffer cmd);
+	    void record_copy(VkCommandBuffer cmd, VkBuffer source, VkDeviceSize offset,
+		    uint32_t first_row, uint32_t rows);
+	    void record_copy_level(VkCommandBuffer cmd, VkBuffer source, VkDeviceSize offset,
+		    uint32_t level);
+	    void record_release(VkCommandBuffer cmd, const OwnershipTransfer& ownership, bool mipmap);
+	    void record_acquire(VkCommandBuffer cmd, const OwnershipTransfer& ownership, bool mipmap);
+	    void record_blit_mipmaps(VkCommandBuffer cmd);
+    };
+
+    /**
+     * Compute mipmap generator, that writes whole mip chain with a single dispatch of single pass downsampling shader (`samples/shaders/spd.comp`).
+     *
+     * Every workgroup reduces 64x64 tile of level 0 into levels 1-6 and the last one to finish reduces level 6 into the rest,
+     * so the chain takes two barriers instead of two per level.
+     *
+     * Supports `VK_FORMAT_R8G8B8A8_UNORM` and `VK_FORMAT_R8G8B8A8_SRGB` images with up to 13 levels, written through `UNORM` storage views.
+     * Descriptor sets and views of recorded dispatches are kept until `reset`.
+     */
+    struct MipGenerator: public ContextDependant, public OptionalValidator {
+	static constexpr uint32_t max_levels = 13;
+	static constexpr VkDeviceSize counter_stride = 256;
+	VkShaderModule shader = VK_NULL_HANDLE;
+	VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	Buffer counters;
+	uint32_t max_images = 0;
+	uint32_t used = 0;
+	bool storage_supported = false;
+	std::vector<VkImageView> views;
+	struct {
+	    uint64_t dispatches = 0;
+	    uint64_t fallbacks = 0;
+	} stats;
+	bool all_valid() { return shader && set_layout && layout && pipeline && pool && counters.all_valid(); }
+
+	[[nodiscard]] MipGenerator(Context* context): ContextDependant{context}, counters{context} {}
+
+	/**
+	 * Creates compute `VkPipeline` and resources for `max_images` dispatches between resets.
+	 *
+	 * @param path Path to compiled shader.
+	 * @param max_images Number of dispatches that can be recorded before `reset`, at least `1`. Defaults to `64`.
+	 */
+	void create(const char* path, uint32_t max_images = 64);
+
+	/**
+	 * Checks if image of `format` with `levels` mip levels can be processed.
+	 */
+	[[nodiscard]] bool supports(VkFormat format, uint32_t levels);
+
+	/**
+	 * Records dispatch generating `image`'s mip chain. See `Image::generate_mipmaps` for layouts.
+	 *
+	 * @return `false` if nothing was recorded, because the image isn't supported or there are no free descriptor sets.
+	 */
+	bool record(VkCommandBuffer cmd, Image& image);
+
+	/**
+	 * Frees descriptor sets and views. All recorded dispatches have to be finished.
+	 */
+	void reset();
+
+	/**
+	 * Resets and destroys `VkPipeline`, its layouts, `VkDescriptorPool` and counters `VkBuffer`.
+	 */
+	void clean();
+    };
+
+    /**
+     * `VkPipelineCache` persisted in a file between runs.
+     *
+     * Hits and misses are counted from pipeline creation feedback, which needs Vulkan 1.3 instance and device.
+     */
+    struct PipelineCache: public ContextDependant, public OptionalValidator {
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	std::string path;
+	bool feedback_supported = false;
+	struct {
+	    size_t loaded_bytes = 0;
+	    size_t saved_bytes = 0;
+	    std::atomic<uint64_t> hits = 0;
+	    std::atomic<uint64_t> misses = 0;
+	    std::atomic<uint64_t> creation_ns = 0;
+	} stats;
+	bool all_valid() { return cache; }
+
+	/**
+	 * Creation feedback of a single pipeline, chained by `chain` and counted by `record`.
+	 */
+	struct Feedback {
+	    VkPipelineCreationFeedback pipeline = {};
+	    VkPipelineCreationFeedbackCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+	    };
+	};
+
+	[[nodiscard]] PipelineCache(Context* context): ContextDependant{context} {}
+
+	/**
+	 * Creates `VkPipelineCache` with initial data read from `path`.
+	 *
+	 * File is ignored if its header is truncated or doesn't match current device's vendor ID, device ID and `pipelineCacheUUID`.
+	 *
+	 * @param path Path to cache file. Doesn't have to exist.
+	 */
+	void create(const char* path);
+
+	/**
+	 * Writes cache data to temporary file next to `path` and renames it over `path`, so interrupted save doesn't leave a broken cache.
+	 */
+	bool save();
+
+	/**
+	 * Chains `feedback` in front of `pNext` if creation feedback is supported.
+	 *
+	 * @return Pointer to use as `pNext` of pipeline create info.
+	 */
+	const void* chain(Feedback& feedback, const void* pNext);
+
+	/**
+	 * Counts `feedback` of created pipeline as hit or miss.
+	 */
+	void record(const Feedback& feedback);
+
+	/**
+	 * Destroys `VkPipelineCache` without saving it.
+	 */
+	void clean();
+    };
+
+    /**
+     * Cache of shaders shared between pipelines, keyed by path and by their SPIR-V, so the same file added twice is loaded once
+     * and different files with the same content share one shader. Paths are assumed not to change until `clean`.
+     *
+     * Files are memory mapped and checked to be SPIR-V. With `VK_KHR_maintenance5` no `VkShaderModule` is created at all
+     * and pipelines get `VkShaderModuleCreateInfo` chained to their stages instead.
+     */
+    struct ShaderCache: public ContextDependant {
+	struct Shader {
+	    VkShaderModule module = VK_NULL_HANDLE;
+	    std::vector<uint32_t> code;
+	    VkShaderModuleCreateInfo info;
+	    uint64_t hash = 0;
+	};
+	std::unordered_multimap<uint64_t, Shader> shaders;
+	// Shader of every loaded path, so repeated loads don't map and hash the file again.
+	std::unordered_map<std::string, const Shader*> paths;
+	std::mutex mutex;
+	bool inline_modules = false;
+	struct {
+	    uint64_t hits = 0;
+	    uint64_t misses = 0;
+	    size_t mapped_bytes = 0;
+	} stats;
+	[[nodiscard]] ShaderCache(Context* context): ContextDependant{context} {}
+
+	/**
+	 * @param maintenance5 Set if `VkPhysicalDeviceMaintenance5FeaturesKHR::maintenance5` was enabled through `ContextDeviceInfo::pNext`, to skip `VkShaderModule` creation.
+	 */
+	void create(bool maintenance5 = false);
+
+	/**
+	 * Returns shader with SPIR-V from `path`, creating it on first request of that content.
+	 *
+	 * @return `nullptr` if file can't be mapped, isn't SPIR-V or module creation failed.
+	 */
+	const Shader* load(const char* path);
+
+	/**
+	 * Fills `module` or `pNext` of `stage` with `shader`.
+	 */
+	static void set_stage(VkPipelineShaderStageCreateInfo& stage, const Shader* shader);
+
+	/**
+	 * Destroys all cached `VkShaderModule`s.
+	 */
+	void clean();
+    };
+
+    struct PipelineRegistry;
+
+    /**
+     * `VkPipeline` helper for graphics pipeline.
+     *
+     * `VkDynamicState` defaults are `VK_DYNAMIC_STATE_VIEWPORT` and `VK_DYNAMIC_STATE_SCISSOR`.
+     *
+     * `VkPipelineInputAssemblyStateCreateInfo` defauls to `VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST` and `primitiveRestart` disabled.
+     *
+     * `VkPipelineRasterizationStateCreateInfo` defaults to `VK_POLYGON_MODE_FILL`, `VK_CULL_MODE_BACK_BIT` and `VK_FRONT_FACE_CLOCKWISE`.
+     *
+     * `VkPipelineMultisampleStateCreateInfo` defaults to disabled sample shading with `rasterizationSamples` set to `VK_SAMPLE_COUNT_1_BIT`.
+     *
+     * `VkPipelineDepthStencilStateCreateInfo` defaults to disabled depth and stencil testing.
+     *
+     * `VkPipelineColorBlendStateCreateInfo` defaults to disabled `logicOp` with 1 attachment (disabled blending, and `colorWriteMask` of `VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT`.
+     */
+    struct GraphicsPipeline: public ContextDependant, public OptionalValidator {
+       	VkPipelineVertexInputStateCreateInfo vertex_input = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+	};
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+	    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+	    .primitiveRestartEnable = VK_FALSE,
+	};
+	VkPipelineTessellationStateCreateInfo tessellation = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO,
+	};
+	VkPipelineViewportStateCreateInfo viewport = {
+	    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+	    .viewportCount = 1,
+	    .scissorCount = 1,
+	};
+	VkPipelineRasterizationStateCreateInfo rasterization = {
 	    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
 	    .polygonMode = VK_POLYGON_MODE_FILL,
 	    .cullMode = VK_CULL_MODE_BACK_BIT,
@@ -509,6 +1708,8 @@ namespace vb {
 	};
 
 	std::vector<VkShaderModule> shader_modules;
+	// SPIR-V of every stage, empty for stages added as bare `VkShaderModule`.
+	std::vector<std::vector<char>> shader_code;
 	std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
 	std::vector<VkPushConstantRange> push_constants;
 	std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
@@ -532,14 +1733,21 @@ namespace vb {
 	void set_subpass_index(uint32_t index) { subpass_index = index; }
 	
 	/**
-	 * Adds a shader from `VkShaderModule`.
+	 * Adds a shader from `VkShaderModule`. Without SPIR-V at hand, the pipeline can't be shared through `PipelineRegistry`.
 	 */
 	void add_shader(VkShaderModule& shader_module, VkShaderStageFlagBits stage);
 
 	/**
-	 * Loads and creates a shader from `path`.
+	 * Loads and creates a shader from `path`, keeping its SPIR-V for `key`.
 	 */
 	void add_shader(const char* path, VkShaderStageFlagBits stage);
+
+	/**
+	 * Adds a shared shader from `cache`. It isn't destroyed by `clean_shaders`.
+	 *
+	 * @return `false` if the shader couldn't be loaded, nothing is added then.
+	 */
+	bool add_shader(ShaderCache& cache, const char* path, VkShaderStageFlagBits stage);
 	
 	/**
 	 * Adds a `VkPushConstantRange`.
@@ -614,15 +1822,44 @@ namespace vb {
 	
 	VkPipelineLayout layout = VK_NULL_HANDLE;
 	VkPipeline pipeline = VK_NULL_HANDLE;
+	bool owns_layout = true;
+	PipelineRegistry* registry = nullptr;
 	bool all_valid() { return layout && pipeline; }
+
+	/**
+	 * Serializes full create state: fixed function state, shader SPIR-V, dynamic states, layout, render pass and rendering formats.
+	 * Pipelines with equal keys can share one `VkPipeline`.
+	 *
+	 * Unknown structures in `pNext` chain are identified by their address, so pipelines with them are never considered equal.
+	 *
+	 * @param pNext `pNext` that would be passed to `create`.
+	 * @param flags `VkPipelineCreateFlags` that would be passed to `create`.
+	 */
+	std::vector<char> key(const void* pNext = nullptr, VkPipelineCreateFlags flags = 0) const;
+
+	/**
+	 * Hash of `key`.
+	 */
+	uint64_t hash(const void* pNext = nullptr, VkPipelineCreateFlags flags = 0) const;
+
+	/**
+	 * @return `true` if SPIR-V of every stage is known, so `key` identifies the pipeline.
+	 */
+	bool shareable() const;
 	
 	/**
-	 * Creates `VkPipeline` and `VkPipelineLayout`.
+	 * Creates `VkPipeline` and `VkPipelineLayout`. With context's `LayoutCache` set, the layout is shared through it.
 	 */
 	void create(void* pNext = nullptr, VkPipelineCreateFlags flags = 0);
 
 	/**
-	 * Destroys `VkPipeline` and `VkPipelineLayout`.
+	 * Creates only `VkPipeline` with already set `layout`. Safe to call from multiple threads for different pipelines.
+	 */
+	void create_pipeline(void* pNext = nullptr, VkPipelineCreateFlags flags = 0);
+
+	/**
+	 * Destroys `VkPipeline` and `VkPipelineLayout`, unless the layout is shared through `PipelineBatch` or `LayoutCache`.
+	 * Pipelines acquired from `PipelineRegistry` release their reference instead.
 	 *
 	 * Does not destroy loaded `VkShaderModule`s!
 	 */
@@ -633,5 +1870,178 @@ namespace vb {
 	 */
 	void clean_shaders();
     };
+
+    /**
+     * Creates many `GraphicsPipeline`s at once, spread across `ThreadPool` workers against context's `PipelineCache`.
+     *
+     * Pipelines with identical descriptor set layouts and push constant ranges share one `VkPipelineLayout` owned by the batch,
+     * so `clean` has to be called after all of its pipelines are cleaned. With context's `LayoutCache` set, it owns them instead.
+     */
+    struct PipelineBatch: public ContextDependant {
+	struct Entry {
+	    GraphicsPipeline* pipeline;
+	    void* pNext;
+	    VkPipelineCreateFlags flags;
+	};
+	struct Layout {
+	    std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
+	    std::vector<VkPushConstantRange> push_constants;
+	    VkPipelineLayout layout = VK_NULL_HANDLE;
+	};
+	std::vector<Entry> entries;
+	std::vector<Layout> layouts;
+	struct {
+	    uint32_t pipelines = 0;
+	    uint32_t layouts = 0;
+	    uint32_t failed = 0;
+	    // Sum of single pipeline creation times, their maximum and time of whole `create` calls.
+	    // `creation_ns / wall_ns` is the speedup over creating pipelines one by one.
+	    uint64_t creation_ns = 0;
+	    uint64_t slowest_ns = 0;
+	    uint64_t wall_ns = 0;
+	} stats;
+	[[nodiscard]] PipelineBatch(Context* context): ContextDependant{context} {}
+
+	/**
+	 * Adds configured `GraphicsPipeline` to be created by `create`. `pipeline` and `pNext` have to stay alive until then.
+	 *
+	 * @param pNext Passed as `pNext` of `VkGraphicsPipelineCreateInfo`.
+	 * @param flags `VkPipelineCreateFlags` bits.
+	 */
+	void add(GraphicsPipeline& pipeline, void* pNext = nullptr, VkPipelineCreateFlags flags = 0);
+
+	/**
+	 * Creates shared `VkPipelineLayout`s and then all added pipelines on `pool`. Clears added pipelines.
+	 *
+	 * @return `false` if any layout or pipeline failed to create.
+	 */
+	bool create(ThreadPool& pool);
+
+	/**
+	 * Destroys shared `VkPipelineLayout`s.
+	 */
+	void clean();
+
+	protected:
+	    VkPipelineLayout find_layout(const GraphicsPipeline& pipeline);
+    };
+
+    /**
+     * Content addressed registry of `VkPipeline`s shared between `GraphicsPipeline`s with identical create state.
+     *
+     * Entries are found by `GraphicsPipeline::hash`, compared by `GraphicsPipeline::key` and reference counted,
+     * last `release` destroys the pipeline and its layout. Pipelines are created outside of the lock,
+     * so acquires from many threads compile in parallel.
+     */
+    struct PipelineRegistry: public ContextDependant {
+	struct Entry {
+	    std::vector<char> key;
+	    VkPipeline pipeline = VK_NULL_HANDLE;
+	    VkPipelineLayout layout = VK_NULL_HANDLE;
+	    uint32_t references = 0;
+	    bool owns_layout = true;
+	};
+	std::unordered_multimap<uint64_t, Entry> entries;
+	// Hash of every registered `VkPipeline`, so `release` doesn't search all entries.
+	std::unordered_map<VkPipeline, uint64_t> hashes;
+	std::mutex mutex;
+	struct {
+	    uint64_t hits = 0;
+	    uint64_t misses = 0;
+	} stats;
+	[[nodiscard]] PipelineRegistry(Context* context): ContextDependant{context} {}
+
+	/**
+	 * Sets `pipeline`'s `VkPipeline` and `VkPipelineLayout` to shared ones with the same state, creating them on first request.
+	 * If two threads create the same pipeline at once, the later one discards its own and takes the registered one.
+	 *
+	 * @param pNext Passed as `pNext` of `VkGraphicsPipelineCreateInfo` and part of the key.
+	 * @param flags `VkPipelineCreateFlags` bits.
+	 * @return `false` if pipeline isn't `GraphicsPipeline::shareable`, or had to be created and failed.
+	 */
+	bool acquire(GraphicsPipeline& pipeline, void* pNext = nullptr, VkPipelineCreateFlags flags = 0);
+
+	/**
+	 * Drops `pipeline`'s reference. Called by `GraphicsPipeline::clean`.
+	 */
+	void release(GraphicsPipeline& pipeline);
+
+	/**
+	 * Destroys all pipelines left in the registry.
+	 */
+	void clean();
+    };
+
+    /**
+     * Hash consed `VkDescriptorSetLayout`s and `VkPipelineLayout`s, so identical layouts share one handle.
+     *
+     * Pipelines created from the same set layouts and push constant ranges get the same `VkPipelineLayout`,
+     * so they're compatible and bound descriptor sets stay valid across pipeline switches.
+     * Cached layouts live until `clean`.
+     */
+    struct LayoutCache: public ContextDependant {
+	struct SetLayout {
+	    VkDescriptorSetLayoutCreateFlags flags;
+	    // Sorted by binding index, with `binding_flags` in the same order.
+	    std::vector<VkDescriptorSetLayoutBinding> bindings;
+	    std::vector<VkDescriptorBindingFlags> binding_flags;
+	    // Copy of immutable samplers of all bindings, their `pImmutableSamplers` point into it.
+	    std::vector<VkSampler> immutable_samplers;
+	    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	};
+	struct PipelineLayout {
+	    std::vector<VkDescriptorSetLayout> set_layouts;
+	    std::vector<VkPushConstantRange> push_constants;
+	    VkPipelineLayout layout = VK_NULL_HANDLE;
+	};
+	std::unordered_multimap<uint64_t, SetLayout> set_layouts;
+	std::unordered_multimap<uint64_t, PipelineLayout> pipeline_layouts;
+	// Every cached handle, for `owns_set_layout` and `owns_pipeline_layout`.
+	std::unordered_set<VkDescriptorSetLayout> owned_set_layouts;
+	std::unordered_set<VkPipelineLayout> owned_pipeline_layouts;
+	std::mutex mutex;
+	struct {
+	    uint64_t hits = 0;
+	    uint64_t misses = 0;
+	    // Set layouts with unknown `pNext` structures, created without caching.
+	    uint64_t uncached = 0;
+	} stats;
+	[[nodiscard]] LayoutCache(Context* context): ContextDependant{context} {}
+
+	/**
+	 * Returns `VkDescriptorSetLayout` with `bindings`, creating it on first request.
+	 *
+	 * Bindings, their immutable sampler handles and `VkDescriptorSetLayoutBindingFlagsCreateInfo` in `pNext` are compared by content.
+	 * With any other structure in `pNext`, contents of which the cache can't know, the layout is created
+	 * without caching and belongs to the caller, see `owns_set_layout`.
+	 *
+	 * @param bindings Bindings in any order.
+	 * @param flags `VkDescriptorSetLayoutCreateFlags` bits.
+	 * @param pNext `pNext` pointer. Defaults to `nullptr`.
+	 */
+	[[nodiscard]] VkDescriptorSetLayout set_layout(std::span<const VkDescriptorSetLayoutBinding> bindings,
+		VkDescriptorSetLayoutCreateFlags flags = 0, const void* pNext = nullptr);
+
+	/**
+	 * Returns `VkPipelineLayout` with `set_layouts` and `push_constants`, creating it on first request.
+	 */
+	[[nodiscard]] VkPipelineLayout pipeline_layout(std::span<const VkDescriptorSetLayout> set_layouts,
+		std::span<const VkPushConstantRange> push_constants);
+
+	/**
+	 * @return `true` if `layout` was created by this cache.
+	 */
+	bool owns_set_layout(VkDescriptorSetLayout layout);
+
+	/**
+	 * @return `true` if `layout` was created by this cache.
+	 */
+	bool owns_pipeline_layout(VkPipelineLayout layout);
+
+	/**
+	 * Destroys all cached layouts.
+	 */
+	void clean();
+    };
 }
 
@@ -117,6 +117,22 @@ namespace vb {
 	return ptr;
     }
 
+    struct SmartStagingRing : public StagingRing {
+	SmartStagingRing(Context* context): StagingRing{context} {}
+	~SmartStagingRing() {
+	    if(ctx->staging_ring == this) ctx->set_staging_ring(nullptr);
+	    clean();
+	}
+    };
+    using UniqueStagingRing = std::unique_ptr<SmartStagingRing>;
+
+    inline UniqueStagingRing create_unique_staging_ring(Context* context, VkDeviceSize capacity) {
+	auto ptr = std::make_unique<SmartStagingRing>(context);
+	ptr->create(capacity);
+	if(!ptr->all_valid()) return nullptr;
+	return ptr;
+    }
+
     struct SmartImage : public Image {
 	SmartImage(Context* context): Image{context} {}
 	~SmartImage() { clean(); }
@@ -1,11 +1,12 @@
 #include "vki.h"
 #include "vki_app.h"
 #include <GLFW/glfw3.h>
+#include <array>
 
 constexpr const char *title_ = "sample";
 constexpr uint32_t width_ = 1280;
 constexpr uint32_t height_ = 720;
-constexpr uint32_t api_ = vk::ApiVersion10;
+constexpr uint32_t api_ = vk::ApiVersion12;
 constexpr bool debug_ = true;
 
 struct gfxp {
@@ -18,6 +19,7 @@ struct gfxp {
 
 struct sample_app : public vki::app {
     vki::queue_info gfx;
+    vk::Queue queue;
 
     ~sample_app() {};
     sample_app() {
@@ -25,10 +27,12 @@ struct sample_app : public vki::app {
         vki::dev_info dev_info = {
             .device_queues = {{vk::QueueFlagBits::eGraphics}},
             .device_extensions = {vk::KHRSwapchainExtensionName},
+            .features_12 = {.timelineSemaphore = true},
         };
         assert(app::create_dev(dev_info));
 
         gfx = dev_info.device_queues[0];
+        queue = base.dev.getQueue(gfx.index, 0);
         assert(app::create_swp({gfx.index}));
         assert(app::create_frm(gfx.index));
 
@@ -38,7 +42,92 @@ struct sample_app : public vki::app {
     void run() {
         while (!glfwWindowShouldClose(window)) {
             glfwPollEvents();
+            if (!draw())
+                break;
         }
+        (void)base.dev.waitIdle();
+    }
+
+    void transition(vk::CommandBuffer cmd, vk::Image image, vk::ImageLayout from,
+                    vk::ImageLayout to, vk::PipelineStageFlags src, vk::PipelineStageFlags dst,
+                    vk::AccessFlags src_access, vk::AccessFlags dst_access) {
+        vk::ImageMemoryBarrier barrier = {
+            .srcAccessMask = src_access,
+            .dstAccessMask = dst_access,
+            .oldLayout = from,
+            .newLayout = to,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image = image,
+            .subresourceRange = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1},
+        };
+        cmd.pipelineBarrier(src, dst, {}, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    // Clears acquired image in current frame of frmpool, which waits on timeline value of its
+    // previous submit instead of a fence.
+    bool draw() {
+        if (!frmpool_.wait())
+            return false;
+        auto &frm = frmpool_.current();
+        auto [res, img_idx] =
+            base.dev.acquireNextImageKHR(swp.swapchain, UINT64_MAX, frm.img_available, nullptr);
+        if (res != vk::Result::eSuccess && res != vk::Result::eSuboptimalKHR)
+            return false;
+        auto image = swp.images[img_idx];
+
+        if (frm.cmd.reset() != vk::Result::eSuccess ||
+            frm.cmd.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit}) !=
+                vk::Result::eSuccess)
+            return false;
+        transition(frm.cmd, image, vk::ImageLayout::eUndefined,
+                   vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits::eTransfer,
+                   vk::PipelineStageFlagBits::eTransfer, {},
+                   vk::AccessFlagBits::eTransferWrite);
+        float shade = (frmpool_.idx % 256) / 255.0f;
+        vk::ClearColorValue color;
+        color.float32 = std::array<float, 4>{0.0f, shade, 1.0f - shade, 1.0f};
+        vk::ImageSubresourceRange range = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+        frm.cmd.clearColorImage(image, vk::ImageLayout::eTransferDstOptimal, &color, 1, &range);
+        transition(frm.cmd, image, vk::ImageLayout::eTransferDstOptimal,
+                   vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits::eTransfer,
+                   vk::PipelineStageFlagBits::eBottomOfPipe, vk::AccessFlagBits::eTransferWrite,
+                   {});
+        if (frm.cmd.end() != vk::Result::eSuccess)
+            return false;
+
+        // Binary render_done of acquired image for present and timeline value frmpool::wait checks next time.
+        auto render_done = frmpool_.render_done[img_idx];
+        vk::Semaphore signals[2] = {render_done, frmpool_.timeline};
+        uint64_t values[2] = {0, frmpool_.next()};
+        vk::TimelineSemaphoreSubmitInfo timeline_i = {
+            .signalSemaphoreValueCount = 2,
+            .pSignalSemaphoreValues = values,
+        };
+        vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eTransfer;
+        vk::SubmitInfo submit_i = {
+            .pNext = &timeline_i,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &frm.img_available,
+            .pWaitDstStageMask = &wait_stage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &frm.cmd,
+            .signalSemaphoreCount = 2,
+            .pSignalSemaphores = signals,
+        };
+        if (queue.submit(1, &submit_i, nullptr) != vk::Result::eSuccess)
+            return false;
+
+        vk::PresentInfoKHR present_i = {
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &render_done,
+            .swapchainCount = 1,
+            .pSwapchains = &swp.swapchain,
+            .pImageIndices = &img_idx,
+        };
+        auto present = queue.presentKHR(present_i);
+        frmpool_.idx++;
+        return present == vk::Result::eSuccess || present == vk::Result::eSuboptimalKHR;
     }
 };
 
@@ -2,13 +2,22 @@
 #include <stdexcept>
 
 namespace vki {
-bool frmpool::create(vk::Device dev, uint32_t queue_idx, uint32_t frm_count) {
-    auto [res, pool] = dev.createCommandPool({.queueFamilyIndex = queue_idx});
+bool frmpool::create(vk::Device dev, uint32_t queue_idx, uint32_t frm_count, uint32_t img_count) {
+    this->dev = dev;
+    // Frame's command buffer is reset and recorded again every time the frame comes around.
+    auto [res, pool] = dev.createCommandPool(
+        {.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer, .queueFamilyIndex = queue_idx});
     if (res != vk::Result::eSuccess)
         return false;
 
     cmd_pool = pool;
 
+    vk::SemaphoreTypeCreateInfo type_i = {.semaphoreType = vk::SemaphoreType::eTimeline};
+    auto [_res, sem] = dev.createSemaphore({.pNext = &type_i});
+    if (_res != vk::Result::eSuccess)
+        return false;
+    timeline = sem;
+
     frames.resize(frm_count);
     for (auto &f : frames) {
         f.cmd = dev.allocateCommandBuffers({.commandPool = cmd_pool,
@@ -16,20 +25,28 @@ bool frmpool::create(vk::Device dev, uint32_t queue_idx, uint32_t frm_count) {
                                             .commandBufferCount = 1})
                     .value[0];
         f.img_available = dev.createSemaphore({}).value;
-        f.render_done = dev.createSemaphore({}).value;
-        f.can_render = dev.createFence({.flags = vk::FenceCreateFlagBits::eSignaled}).value;
     }
+    render_done.resize(img_count);
+    for (auto &sem : render_done)
+        sem = dev.createSemaphore({}).value;
 
     return true;
 }
 
+bool frmpool::wait(uint64_t timeout) {
+    auto done = current().done;
+    return dev.waitSemaphores({.semaphoreCount = 1, .pSemaphores = &timeline, .pValues = &done},
+                              timeout) == vk::Result::eSuccess;
+}
+
 frmpool::~frmpool() {
     for (auto &f : frames) {
         dev.freeCommandBuffers(cmd_pool, 1, &f.cmd);
         dev.destroySemaphore(f.img_available);
-        dev.destroySemaphore(f.render_done);
-        dev.destroyFence(f.can_render);
     }
+    for (auto sem : render_done)
+        dev.destroySemaphore(sem);
+    dev.destroySemaphore(timeline);
     dev.destroyCommandPool(cmd_pool);
 }
 
@@ -67,7 +84,7 @@ bool app::create_swp(std::vector<uint32_t> queue_family_indices, vk::SurfaceForm
 }
 
 bool app::create_frm(uint32_t frame_queue_idx) {
-    if (!frmpool_.create(base.dev, frame_queue_idx, swp.image_count))
+    if (!frmpool_.create(base.dev, frame_queue_idx, swp.image_count, swp.image_count))
         return false;
     glfwShowWindow(window);
     return true;
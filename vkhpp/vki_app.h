@@ -7,21 +7,32 @@ namespace vki {
 struct frm {
     vk::CommandBuffer cmd = nullptr;
     vk::Semaphore img_available = nullptr;
-    vk::Semaphore render_done = nullptr;
-    vk::Fence can_render = nullptr;
+    // Value of frmpool::timeline signaled by frame's last submit.
+    uint64_t done = 0;
 };
 
+// Frames are synchronized with one timeline semaphore (Vulkan 1.2 timelineSemaphore feature) instead of per frame fences.
 struct frmpool {
     vk::CommandPool cmd_pool = nullptr;
     std::vector<frm> frames = {};
-    uint8_t idx = 0;
+    // Waited on by present of swapchain image with the same index. Indexed by image, not frame, since
+    // presentation engine may still hold it when frame comes around but not when its image is acquired again.
+    std::vector<vk::Semaphore> render_done = {};
+    vk::Semaphore timeline = nullptr;
+    uint64_t value = 0;
+    uint64_t idx = 0;
 
     vk::Device dev;
 
     frmpool() = default;
     ~frmpool();
 
-    bool create(vk::Device dev, uint32_t queue_idx, uint32_t frm_count);
+    bool create(vk::Device dev, uint32_t queue_idx, uint32_t frm_count, uint32_t img_count);
+    frm &current() { return frames[idx % frames.size()]; }
+    // Waits until GPU finished previous submit of current frame.
+    bool wait(uint64_t timeout = UINT64_MAX);
+    // Reserves timeline value for current frame's submit, to be signaled with vk::TimelineSemaphoreSubmitInfo.
+    uint64_t next() { return current().done = ++value; }
 };
 
 struct app {